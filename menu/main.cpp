@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
 #include "unzip.h"
 #include "zip.h"
 #include "menu.h"
@@ -11,8 +12,13 @@
 #include "apu.h"
 #include "gfx.h"
 #include "soundux.h"
+#include "sdsp.h"
 #include "snapshot.h"
+#include "rewind.h"
+#include "runahead.h"
+#include "dirty.h"
 #include "scaler.h"
+#include "memplan.h"
 
 #define SNES_SCREEN_WIDTH  256
 #define SNES_SCREEN_HEIGHT 192
@@ -21,6 +27,10 @@
 #define FIXED_POINT_REMAINDER 0xffffUL
 #define FIXED_POINT_SHIFT 16
 
+// About ten seconds of history for most games, a state every other frame
+#define REWIND_BUFFER_SIZE (4 * 1024 * 1024)
+#define REWIND_INTERVAL 2
+
 static struct MENU_OPTIONS mMenuOptions;
 static int mEmuScreenHeight;
 static int mEmuScreenWidth;
@@ -28,6 +38,8 @@ static char mRomName[SAL_MAX_PATH]={""};
 static u32 mLastRate=0;
 
 static s8 mFpsDisplay[16]={""};
+static s8 mRewindDisplay[32]={""};
+static s8 mRunAheadDisplay[32]={""};
 static s8 mVolumeDisplay[16]={""};
 static s8 mQuickStateDisplay[16]={""};
 static u32 mFps=0;
@@ -36,10 +48,37 @@ static u32 mEnterMenu=0;
 static u32 mLoadRequested=0;
 static u32 mSaveRequested=0;
 static u32 mQuickStateTimer=0;
+static u32 mQuickStateSaving=0;
+// The slot a quick save went to; the status is about that file even if
+// another slot is picked before the write is done.
+static s32 mQuickStateSlot=0;
 static u32 mVolumeTimer=0;
 static u32 mVolumeDisplayTimer=0;
 static u32 mFramesCleared=0;
 static u32 mInMenu=0;
+static u32 mRewinding=0;
+static uint32 mJoypad[2]={0x80000000,0x80000000};
+static u32 mSRAMCheckTimer=0;
+static u32 mStartupBegin=0;
+static u32 mStartupStep=0;
+// SRAM as it was last written to or read from the .srm file.
+static u8 mSRAMSaved[0x20000];
+// SRAM handed to the background writer and not yet known to be on the
+// card; it only becomes mSRAMSaved once the write is confirmed. A failed
+// write leaves mSRAMRetry set, so the next look saves again.
+static u8 mSRAMQueued[0x20000];
+static s8 mSRAMQueuedFile[SAL_MAX_PATH];
+static u32 mSRAMQueuedSize=0;
+static u32 mSRAMWriting=0;
+static u32 mSRAMRetry=0;
+static s8 mSRAMDisplay[16]={""};
+static u32 mSRAMDisplayTimer=0;
+
+// Frames between two looks at SRAM for the autosave.
+#define SRAM_CHECK_INTERVAL	15
+
+extern struct SAVE_STATE mSaveState[10];
+extern s32 saveno;
 
 volatile bool argv_rom_loaded = false;
 
@@ -73,6 +112,13 @@ u32 SamplesDoneThisFrame = 0;
 void S9xGenerateSound (void)
 {
 	so.err_counter += so.err_rate;
+	/* Run-ahead frames are heard only once, as the real frame. */
+	if (S9xRunAheadHidden())
+		return;
+	/* Batched: the core mixes up to each DSP write itself and the whole
+	 * frame is collected in Run, so only the frame position advances. */
+	if (Settings.SoundFrameBatch)
+		return;
 	if ((Settings.SoundSync >= 2 && so.err_counter >= FIXED_POINT)
 	 || (Settings.SoundSync == 1 && so.err_counter >= FIXED_POINT * 128))
 	{
@@ -235,11 +281,30 @@ bool8_32 S9xDeinitUpdate (int Width, int Height, bool8_32)
 		{
 			mLastTimer=newTimer;
 			sprintf(mFpsDisplay,"%2d/%2d", mFps, Memory.ROMFramesPerSecond);
+			sprintf(mRewindDisplay,"RW %4u %4uK %5uus",
+				RewindStats.states, RewindStats.ring_used >> 10, RewindStats.last_usec);
+			// Share of the frame period spent on the hidden frames
+			sprintf(mRunAheadDisplay,"RA %u %5uus %3u%%",
+				RunAheadStats.frames, RunAheadStats.last_usec,
+				RunAheadStats.last_usec * Memory.ROMFramesPerSecond / 10000);
 			mFps=0;
 		}
 
 		sal_VideoDrawRect(0,0,5*8,8,SAL_RGB(0,0,0));
 		sal_VideoPrint(0,0,mFpsDisplay,SAL_RGB(31,31,31));
+
+		if (S9xRewindActive())
+		{
+			sal_VideoDrawRect(0,8,19*8,8,SAL_RGB(0,0,0));
+			sal_VideoPrint(0,8,mRewindDisplay,SAL_RGB(31,31,31));
+		}
+
+		if (mMenuOptions.runAhead)
+		{
+			int y = S9xRewindActive() ? 16 : 8;
+			sal_VideoDrawRect(0,y,17*8,8,SAL_RGB(0,0,0));
+			sal_VideoPrint(0,y,mRunAheadDisplay,SAL_RGB(31,31,31));
+		}
 	}
 
 	if(mVolumeDisplayTimer>0)
@@ -248,12 +313,28 @@ bool8_32 S9xDeinitUpdate (int Width, int Height, bool8_32)
 		sal_VideoPrint(100,0,mVolumeDisplay,SAL_RGB(31,31,31));
 	}
 
+	// A quick save reads "Saving" until the writer is done with it
+	if(mQuickStateSaving && !sal_FileSavePending(mSaveState[mQuickStateSlot].fullFilename))
+	{
+		mQuickStateSaving=0;
+		sprintf(mQuickStateDisplay, sal_FileSaveWait(mSaveState[mQuickStateSlot].fullFilename) == SAL_OK ? "Saved %d" : "Failed %d", mQuickStateSlot);
+		mQuickStateTimer=Memory.ROMFramesPerSecond;
+	}
+
 	if(mQuickStateTimer>0)
 	{
+		if(!mQuickStateSaving) mQuickStateTimer--;
 		sal_VideoDrawRect(200,0,8*8,8,SAL_RGB(0,0,0));
 		sal_VideoPrint(200,0,mQuickStateDisplay,SAL_RGB(31,31,31));
 	}
 
+	if(mSRAMDisplayTimer>0)
+	{
+		mSRAMDisplayTimer--;
+		sal_VideoDrawRect(200,8,8*8,8,SAL_RGB(0,0,0));
+		sal_VideoPrint(200,8,mSRAMDisplay,SAL_RGB(31,31,31));
+	}
+
 	sal_VideoFlip(0);
 }
 
@@ -271,13 +352,12 @@ const char *S9xGetFilename (const char *ex)
 	return (dir);
 }
 
-extern struct SAVE_STATE mSaveState[10];
-extern s32 saveno;
-
 uint32 S9xReadJoypad (int which1)
 {
 	uint32 val=0x80000000;
 	if (mInMenu || which1 > 1) return val;
+	// Hidden frames see the input of the real one before them
+	if (S9xRunAheadHidden()) return mJoypad[which1];
 
 	u32 joy = sal_InputPoll(which1);
 
@@ -288,7 +368,19 @@ uint32 S9xReadJoypad (int which1)
 		LoadStateFile(mSaveState[saveno].fullFilename);
 		return val;
 	} else if (joy & SAL_INPUT_QUICKSAVE) {
-		SaveStateFile(mSaveState[saveno].fullFilename);
+		CaptureStateThumb();
+		if (SaveStateFile(mSaveState[saveno].fullFilename)) {
+			mSaveState[saveno].inUse = 1;
+			mQuickStateSaving = 1;
+			mQuickStateSlot = saveno;
+			sprintf(mQuickStateDisplay, "Saving %d", saveno);
+		} else {
+			sprintf(mQuickStateDisplay, "Failed %d", saveno);
+		}
+		mQuickStateTimer = Memory.ROMFramesPerSecond;
+		return val;
+	} else if (joy & SAL_INPUT_REWIND) {
+		mRewinding = 1;
 		return val;
 	}
 
@@ -336,6 +428,7 @@ uint32 S9xReadJoypad (int which1)
 	if (joy & SAL_INPUT_L) 		val |= SNES_TL_MASK;
 	if (joy & SAL_INPUT_R) 		val |= SNES_TR_MASK;
 
+	mJoypad[which1] = val;
 	return val;
 }
 
@@ -361,7 +454,7 @@ const char *S9xGetFilenameInc (const char *e)
 
 void S9xSyncSpeed(void)
 {
-	if (IsPreviewingState())
+	if (IsPreviewingState() || S9xRunAheadHidden())
 		return;
 
 	if (Settings.SkipFrames == AUTO_FRAMERATE)
@@ -406,19 +499,106 @@ const char *S9xBasename (const char *f)
       return (f);
 }
 
+// Whether SRAM differs from the .srm file, or from what is on its way
+// there. Only pages the game wrote since the last look are compared; a
+// game that keeps writing the same bytes back does not cause a save.
+static u32 SRAMChanged(void)
+{
+	const u8 *saved = mSRAMWriting ? mSRAMQueued : mSRAMSaved;
+	u32 size = Memory.SRAMSaveSize();
+	u32 offset, len, changed = mSRAMRetry;
+
+	for (offset = 0; offset < size && !changed; offset += DIRTY_PAGE_SIZE)
+	{
+		len = size - offset < DIRTY_PAGE_SIZE ? size - offset : DIRTY_PAGE_SIZE;
+		if (S9xDirtyTest(DIRTY_SRAM, offset >> DIRTY_PAGE_SHIFT, DIRTY_SRAM_SAVE) &&
+			memcmp(&Memory.SRAM[offset], &saved[offset], len) != 0)
+			changed = 1;
+	}
+	S9xDirtyClear(DIRTY_SRAM_SAVE);
+	return changed;
+}
+
+static void SRAMSaved(s32 result, const u8 *data, u32 size)
+{
+	if (result == SAL_OK)
+	{
+		memcpy(mSRAMSaved, data, size);
+		mSRAMRetry = 0;
+		return;
+	}
+	mSRAMRetry = 1;
+	fprintf(stderr, "Failed to write SRAM\n");
+	strcpy(mSRAMDisplay, "SRAM err");
+	mSRAMDisplayTimer = Memory.ROMFramesPerSecond * 2;
+}
+
+// Settles the SRAM write handed to the background writer: with wait set
+// it blocks for it, otherwise it only looks whether it is done yet.
+static s32 SRAMWriteDone(u32 wait)
+{
+	s32 result;
+
+	if (!mSRAMWriting)
+		return SAL_OK;
+	if (!wait && sal_FileSavePending(mSRAMQueuedFile))
+		return SAL_OK;
+
+	mSRAMWriting = 0;
+	result = sal_FileSaveWait(mSRAMQueuedFile);
+	SRAMSaved(result, mSRAMQueued, mSRAMQueuedSize);
+	return result;
+}
+
+// Hands SRAM to the background writer; with wait set, returns once it is
+// on the card. The few cartridges with a clock chip store the clock
+// alongside and keep the blocking save.
+static s32 SRAMSave(u32 wait)
+{
+	const char *filename = S9xGetFilename (".srm");
+	u32 size = Memory.SRAMSaveSize();
+	s32 result = SAL_OK;
+
+	if (Settings.SRTC || Settings.SPC7110RTC)
+	{
+		SRAMWriteDone(1);
+		sal_FileSaveFlush();
+		if (!Memory.SaveSRAM ((s8*)filename))
+			result = SAL_ERROR;
+		SRAMSaved(result, Memory.SRAM, size);
+	}
+	else if (size)
+	{
+		memcpy(mSRAMQueued, Memory.SRAM, size);
+		strcpy(mSRAMQueuedFile, filename);
+		mSRAMQueuedSize = size;
+		result = sal_FileSaveAsync(filename, mSRAMQueued, size);
+		if (result == SAL_OK)
+		{
+			mSRAMWriting = 1;
+			mSRAMRetry = 0;
+			if (wait)
+				result = SRAMWriteDone(1);
+		}
+		else
+			SRAMSaved(result, mSRAMQueued, size);
+	}
+	return result;
+}
+
 void PSNESForceSaveSRAM (void)
 {
 	if(mRomName[0] != 0)
 	{
-		Memory.SaveSRAM ((s8*)S9xGetFilename (".srm"));
+		SRAMSave(1);
 	}
 }
 
 void S9xSaveSRAM (int showWarning)
 {
-	if (CPU.SRAMModified)
+	if (SRAMChanged())
 	{
-		if(!Memory.SaveSRAM ((s8*)S9xGetFilename (".srm")))
+		if(SRAMSave(1) != SAL_OK)
 		{
 			MenuMessageBox("Saving SRAM","Failed!","",MENU_MESSAGE_BOX_MODE_PAUSE);
 		}
@@ -440,21 +620,31 @@ bool8_32 S9xOpenSoundDevice(int a, unsigned char b, int c)
 
 void S9xAutoSaveSRAM (void)
 {
-	if (mMenuOptions.autoSaveSram)
+	SRAMWriteDone(0);
+	if (mMenuOptions.autoSaveSram && SRAMChanged())
 	{
-		Memory.SaveSRAM (S9xGetFilename (".srm"));
+		SRAMSave(0);
 		// sync(); // Only sync at exit or with a ROM change
 	}
 }
 
 void S9xLoadSRAM (void)
 {
+	// A save of the previous game still on its way must not land after
+	// this load.
+	SRAMWriteDone(1);
+	sal_FileSaveFlush();
 	Memory.LoadSRAM ((s8*)S9xGetFilename (".srm"));
+	memcpy(mSRAMSaved, Memory.SRAM, Memory.SRAMSaveSize());
+	mSRAMRetry = 0;
+	S9xDirtyClear(DIRTY_SRAM_SAVE);
+	mSRAMCheckTimer = 0;
 }
 
 static u32 LastAudioRate = 0;
 static u32 LastStereo = 0;
 static u32 LastHz = 0;
+static u32 LastSoundCore = SOUND_CORE_HLE;
 
 static
 int Run(int sound)
@@ -466,6 +656,9 @@ int Run(int sound)
 	LastPAL = PAL;
 
 	Settings.SoundSync = mMenuOptions.soundSync;
+	Settings.SoundFrameBatch = mMenuOptions.soundBatch ? TRUE : FALSE;
+	S9xResetSoundBatch();
+	Settings.SoundCore = mMenuOptions.soundCore ? SOUND_CORE_SDSP : SOUND_CORE_HLE;
 	Settings.SkipFrames = mMenuOptions.frameSkip == 0 ? AUTO_FRAMERATE : mMenuOptions.frameSkip - 1;
 	sal_TimerInit(Settings.FrameTime);
 
@@ -493,6 +686,15 @@ int Run(int sound)
 			LastAudioRate = mMenuOptions.soundRate;
 			LastStereo = mMenuOptions.stereo;
 			LastHz = Memory.ROMFramesPerSecond;
+			LastSoundCore = Settings.SoundCore;
+		}
+		else if (LastSoundCore != Settings.SoundCore)
+		{
+			// The DSP core always mixes at 32 kHz; pick the mix rate again
+			// and start it from a clean state.
+			S9xSDSPReset ();
+			S9xSetPlaybackRate(mMenuOptions.soundRate);
+			LastSoundCore = Settings.SoundCore;
 		}
 		sal_AudioSetMuted(0);
 
@@ -501,19 +703,56 @@ int Run(int sound)
 	}
 	sal_AudioResume();
 
+	if (mMenuOptions.rewind) {
+		if (!S9xRewindActive())
+			S9xRewindInit(REWIND_BUFFER_SIZE, REWIND_INTERVAL);
+	} else {
+		S9xRewindDeinit();
+	}
+	mRewinding = 0;
+
+	if (!mMenuOptions.runAhead)
+		S9xRunAheadDeinit();
+
   	while(!mEnterMenu)
   	{
+		// While the rewind combo is held each frame starts from an older
+		// state instead of being captured; the sound is muted meanwhile.
+		bool rewound = mRewinding && S9xRewindStep();
+		mRewinding = 0;
+		if (sound)
+			sal_AudioSetMuted(rewound);
+		if (!rewound)
+			S9xRewindCapture();
+
+		// With run-ahead the real frame is never drawn; the frames after it
+		// are, from a state put back afterwards.
+		if (mMenuOptions.runAhead)
+			IPPU.RenderThisFrame = FALSE;
+
 		//Run SNES for one glorious frame
 		S9xMainLoop ();
 
 		if (SamplesDoneThisFrame < sal_AudioGetSamplesPerFrame())
 			sal_AudioGenerate(sal_AudioGetSamplesPerFrame() - SamplesDoneThisFrame);
 		SamplesDoneThisFrame = 0;
+		S9xEndSoundFrame();
 		so.err_counter = 0;
+
+		if (mMenuOptions.runAhead)
+			S9xRunAheadFrame(mMenuOptions.runAhead);
+
+		if (++mSRAMCheckTimer >= SRAM_CHECK_INTERVAL)
+		{
+			mSRAMCheckTimer = 0;
+			S9xAutoSaveSRAM();
+		}
   	}
 
 	sal_AudioPause();
 
+	// The menu's saves show the frame the game was left at
+	CaptureStateThumb();
 	sal_VideoExitGame();
 
 	mEnterMenu=0;
@@ -549,6 +788,11 @@ int SnesRomLoad()
 	S9xReset();
 	S9xResetSound(1);
 	S9xLoadSRAM();
+	S9xRewindReset();
+
+	printf("memory: %uK planned (ROM %uK, SRAM %uK, BS-X %uK, fixed %uK), peak RSS %uK\n",
+		MemoryPlan.total >> 10, MemoryPlan.rom >> 10, MemoryPlan.sram >> 10,
+		MemoryPlan.bsram >> 10, MemoryPlan.fixed >> 10, S9xPeakRSS());
 	return SAL_OK;
 }
 
@@ -589,13 +833,16 @@ int SnesInit()
 	Settings.SupportHiRes = FALSE;
 	Settings.NetPlay = FALSE;
 	Settings.ServerName [0] = 0;
-	Settings.AutoSaveDelay = 1;
+	// SRAM is autosaved from Run, a few times a second, instead of by
+	// the core's timer.
+	Settings.AutoSaveDelay = 0;
 	Settings.ApplyCheats = TRUE;
 	Settings.TurboMode = FALSE;
 	Settings.TurboSkipFrames = 15;
 	Settings.ThreadSound = FALSE;
 	Settings.SoundSync = 1;
 	Settings.FixFrequency = TRUE;
+	Settings.SoundResample = TRUE;
 	//Settings.NoPatch = true;
 
 	Settings.SuperFX = TRUE;
@@ -709,17 +956,37 @@ void _splitpath (const char *path, char *drive, char *dir, char *fname,
 	}
 }
 
+// Time taken by each step to the menu, written to the console so slow
+// storage or a slow step shows up in a device's log.
+static void StartupTime(const char *step)
+{
+	struct timeval tv;
+	u32 now;
+
+	gettimeofday(&tv, NULL);
+	now = tv.tv_sec * 1000000 + tv.tv_usec;
+	if (!step)
+		mStartupBegin = now;
+	else
+		printf("startup: %-8s %7u us, %7u us total\n", step, now - mStartupStep, now - mStartupBegin);
+	mStartupStep = now;
+}
+
 extern "C"
 {
 
 int mainEntry(int argc, char* argv[])
 {
 	int ref = 0;
+	u32 resume = 0;
 
 	s32 event=EVENT_NONE;
 
+	StartupTime(NULL);
 	sal_Init();
+	StartupTime("sal");
 	sal_VideoInit(16);
+	StartupTime("video");
 
 	mRomName[0]=0;
 	if (argc >= 2) {
@@ -728,12 +995,19 @@ int mainEntry(int argc, char* argv[])
 	}
 
 	MenuInit(sal_DirectoryGetHome(), &mMenuOptions);
+	StartupTime("menu");
+
+	// Carry on with the game the emulator was left in; the menu's first
+	// run sees the ROM name and loads it without drawing anything.
+	if (!argv_rom_loaded && ResumeEnabled() && LoadResumeRom(mRomName) == SAL_OK)
+		resume = 1;
 
 	if(SnesInit() == SAL_ERROR)
 	{
 		sal_Reset();
 		return 0;
 	}
+	StartupTime("snes");
 
 	while(1)
 	{
@@ -743,7 +1017,7 @@ int mainEntry(int argc, char* argv[])
 
 		if(event==EVENT_LOAD_ROM)
 		{
-			if (mRomName[0] != 0)
+			if (mRomName[0] != 0 && !resume)
 			{
 				MenuMessageBox("Saving SRAM...","","",MENU_MESSAGE_BOX_MODE_MSG);
 				PSNESForceSaveSRAM();
@@ -760,6 +1034,14 @@ int mainEntry(int argc, char* argv[])
 				MenuMessageBox("Loading game settings...",mRomName,"",MENU_MESSAGE_BOX_MODE_MSG);
 				LoadCurrentOptions();
 
+				if (resume)
+				{
+					if (LoadResumeState() != SAL_OK)
+						fprintf(stderr, "No state to resume %s from\n", mRomName);
+					StartupTime("resume");
+					resume = 0;
+				}
+
 				event=EVENT_RUN_ROM;
 		  	}
 		}
@@ -785,6 +1067,13 @@ int mainEntry(int argc, char* argv[])
 		if(event==EVENT_EXIT_APP) break;
 	}
 
+	if (ResumeEnabled() && mRomName[0] != 0)
+	{
+		MenuMessageBox("Saving game to resume...","","",MENU_MESSAGE_BOX_MODE_MSG);
+		if (SaveResumeState(mRomName) != SAL_OK)
+			fprintf(stderr, "Failed to save the game to resume\n");
+	}
+
 	MenuMessageBox("Saving SRAM...","","",MENU_MESSAGE_BOX_MODE_MSG);
 	PSNESForceSaveSRAM();
 
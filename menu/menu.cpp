@@ -1,4 +1,5 @@
 #include <errno.h>
+#include <time.h>
 
 #include "sal.h"
 #include "menu.h"
@@ -7,6 +8,9 @@
 #include "gfx.h"
 #include "memmap.h"
 #include "soundux.h"
+#include "runahead.h"
+#include "rominfo.h"
+#include "preview.h"
 
 #define MAX_DISPLAY_CHARS			40
 #define ROM_SELECTOR_SAVE_DEFAULT_DIR	0
@@ -15,6 +19,7 @@
 #define ROM_SELECTOR_ROM_START			3
 
 static u16 mMenuBackground[SAL_SCREEN_WIDTH * SAL_SCREEN_HEIGHT];
+static SDL_Thread *mBackdropThread = NULL;
 
 static s32 mMenutileXscroll=0;
 static s32 mMenutileYscroll=0;
@@ -33,7 +38,32 @@ static s8 mSaveStateName[SAL_MAX_PATH]={""};       // holds the last filename to
 static s8 mRomName[SAL_MAX_PATH]={""};
 static s8 mSystemDir[SAL_MAX_PATH];
 static struct MENU_OPTIONS *mMenuOptions=NULL;
+static u32 mResumeOn=0;
 static u16 mTempFb[SNES_WIDTH*SNES_HEIGHT_EXTENDED*2];
+static SSnapshotMem mTempState;	// the game as it was when the save state menu opened
+static SSnapshotMem mStateFile;	// the last state saved, as written to its file
+
+// Stored in each state as sections of their own, so the slot list can
+// read what a slot holds without loading it.
+#define THUMB_WIDTH		(SNES_WIDTH / 2)
+#define THUMB_HEIGHT	(SNES_HEIGHT / 2)
+
+struct STATE_INFO	// "INF"
+{
+	u32 crc;	// of the ROM the state belongs to
+	u32 time;	// when it was saved
+};
+
+struct STATE_THUMB	// "THM"
+{
+	u16 width;
+	u16 height;
+	u16 pixels[THUMB_WIDTH * THUMB_HEIGHT];
+};
+
+static struct STATE_THUMB mThumb;		// picture of the game, for the next save
+static struct STATE_INFO mSlotInfo;		// of the slot under the cursor
+static struct STATE_THUMB mSlotThumb;
 
 static char errormsg[MAX_DISPLAY_CHARS];
 
@@ -61,6 +91,10 @@ void DefaultMenuOptions(void)
 	mMenuOptions->fullScreen = hwscale ? 3 : 1;
 	mMenuOptions->autoSaveSram = 1;
 	mMenuOptions->soundSync = 1;
+	mMenuOptions->soundBatch = 0;
+	mMenuOptions->soundCore = 0;
+	mMenuOptions->rewind = 0;
+	mMenuOptions->runAhead = 0;
 }
 
 s32 LoadMenuOptions(const char *path, const char *filename, const char *ext, const char *optionsmem, s32 maxSize, s32 showMessage)
@@ -153,6 +187,67 @@ void DelLastSelectedRomPos() // Remove the last selected rom position config fil
 	remove(lastselfile);
 }
 
+// With resume on, leaving the emulator keeps the game's state and the ROM
+// path beside lastselected.opt, and the next launch goes straight back
+// into the game instead of to the menu.
+s32 SaveResumeState(const char *romName)
+{
+	char resumefile[SAL_MAX_PATH];
+
+	strcpy(resumefile, sal_DirectoryGetHome());
+	sal_DirectoryCombine(resumefile, RESUME_STATE_FILENAME);
+	if (!SaveStateFile(resumefile) || sal_FileSaveWait(resumefile) != SAL_OK)
+		return SAL_ERROR;
+
+	strcpy(resumefile, sal_DirectoryGetHome());
+	sal_DirectoryCombine(resumefile, RESUME_ROM_FILENAME);
+	return sal_FileSaveAtomic(resumefile, (const u8 *) romName, strlen(romName));
+}
+
+// Resume on start belongs to the emulator rather than to a game, so it has
+// a file of its own, as the ROM directory does, and a game's options never
+// replace it.
+u32 ResumeEnabled(void)
+{
+	return mResumeOn;
+}
+
+// The ROM to resume, if there is one. It is only resumed once: should its
+// state be what brings the emulator down, the next launch shows the menu.
+s32 LoadResumeRom(s8 *romName)
+{
+	char resumefile[SAL_MAX_PATH];
+	u32 size = 0;
+
+	strcpy(resumefile, sal_DirectoryGetHome());
+	sal_DirectoryCombine(resumefile, RESUME_ROM_FILENAME);
+	if (sal_FileLoad(resumefile, (u8 *) romName, SAL_MAX_PATH - 1, &size) != SAL_OK)
+		return SAL_ERROR;
+	sal_FileDelete(resumefile);
+
+	romName[size] = 0;
+	if (size == 0 || sal_FileExists(romName) != SAL_TRUE) {
+		romName[0] = 0;
+		return SAL_ERROR;
+	}
+	return SAL_OK;
+}
+
+// Puts back the state saved on exit, once the ROM it was saved with is
+// loaded again.
+s32 LoadResumeState(void)
+{
+	char resumefile[SAL_MAX_PATH];
+	struct STATE_INFO info;
+
+	strcpy(resumefile, sal_DirectoryGetHome());
+	sal_DirectoryCombine(resumefile, RESUME_STATE_FILENAME);
+	if (S9xSnapshotReadSection(resumefile, "INF", (uint8 *) &info, sizeof(info)) != sizeof(info) ||
+		info.crc != Memory.ROMCRC32)
+		return SAL_ERROR;
+	return LoadStateFile(resumefile) ? SAL_OK : SAL_ERROR;
+}
+
 void MenuPause()
 {
 	sal_InputWaitForPress();
@@ -211,6 +306,11 @@ s32 MenuMessageBox(const char *message1, const char *message2, const char *messa
 
 void PrintTitle(const char *title)
 {
+	if (mBackdropThread)
+	{
+		SDL_WaitThread(mBackdropThread, NULL);
+		mBackdropThread = NULL;
+	}
 	sal_ImageDraw(mMenuBackground, SAL_SCREEN_WIDTH, SAL_SCREEN_HEIGHT, 0, 0);
 	sal_VideoPrint(8, 4, title, SAL_RGB(31, 8, 8));
 }
@@ -239,167 +339,234 @@ void DefaultRomListItems()
 	// mRomList[ROM_SELECTOR_DEFAULT_FOCUS].displayName[0]=0;
 }
 
-static
-void SwapDirectoryEntry(struct SAL_DIRECTORY_ENTRY *salFrom, struct SAL_DIRECTORY_ENTRY *salTo)
+// The list of each ROM directory is kept in an index file in the home
+// directory, sorted, along with the directory's modification time. As
+// long as that time is unchanged nothing was added, removed or renamed
+// there, and the list comes straight from the index without reading the
+// directory. Once it has changed the directory is read again in full:
+// reading it is the only way to see what changed, and the names and types
+// come from the directory entries themselves, with no stat where the file
+// system supplies the type. The costly per-file work, reading headers and
+// CRCs, is done by RomInfoScan only for files that are new or changed.
+#define ROM_INDEX_MAGIC		"PSLI"
+#define ROM_INDEX_VERSION	2
+#define ROM_LIST_GROW		256
+
+struct ROM_INDEX_HEADER
+{
+	s8 magic[4];
+	u32 version;
+	u32 mtime;
+	u32 count;
+	s8 dir[SAL_MAX_PATH];
+};
+// followed by count entries: type byte, name length byte, name
+
+static void RomIndexFilename(s8 *filename)
+{
+	s8 name[32];
+
+	sprintf(name, "romlib-%08x.idx", sal_FileGetCRC((u8 *) mRomDir, strlen(mRomDir)));
+	strcpy(filename, sal_DirectoryGetHome());
+	sal_DirectoryCombine(filename, name);
+}
+
+// Makes room for count entries after the default items.
+static s32 RomListReserve(s32 count)
+{
+	struct SAL_DIRECTORY_ENTRY *list;
+
+	list = (SAL_DIRECTORY_ENTRY *) realloc(mRomList, sizeof(struct SAL_DIRECTORY_ENTRY) * (ROM_SELECTOR_ROM_START + count));
+	if (list == NULL)
+		return SAL_ERROR;
+	mRomList = list;
+	return SAL_OK;
+}
+
+static int CompareDirectoryEntry(const void *from, const void *to)
+{
+	const struct SAL_DIRECTORY_ENTRY *a = (const struct SAL_DIRECTORY_ENTRY *) from;
+	const struct SAL_DIRECTORY_ENTRY *b = (const struct SAL_DIRECTORY_ENTRY *) to;
+
+	//Directories go at the top
+	if (a->type != b->type)
+		return a->type == SAL_FILE_TYPE_DIRECTORY ? -1 : 1;
+	return sal_StringCompare(a->displayName, b->displayName);
+}
+
+static s32 RomIndexLoad(u32 mtime)
 {
-	struct SAL_DIRECTORY_ENTRY temp;
-
-	//Copy salFrom to temp entry
-	strcpy(temp.displayName, salFrom->displayName);
-	strcpy(temp.filename, salFrom->filename);
-	temp.type = salFrom->type;
-
-	//Copy salTo to salFrom
-	strcpy(salFrom->displayName, salTo->displayName);
-	strcpy(salFrom->filename, salTo->filename);
-	salFrom->type = salTo->type;
-
-	//Copy temp entry to salTo
-	strcpy(salTo->displayName, temp.displayName);
-	strcpy(salTo->filename, temp.filename);
-	salTo->type = temp.type;
+	s8 filename[SAL_MAX_PATH];
+	struct ROM_INDEX_HEADER *header;
+	u8 *data, *p, *end;
+	u32 size = 0, i;
+	s32 result = SAL_ERROR;
+
+	RomIndexFilename(filename);
+	if (sal_FileGetSize(filename, &size) != SAL_OK || size < sizeof(*header))
+		return SAL_ERROR;
+	data = (u8 *) malloc(size);
+	if (data == NULL)
+		return SAL_ERROR;
+
+	header = (struct ROM_INDEX_HEADER *) data;
+	if (sal_FileLoad(filename, data, size, &size) != SAL_OK ||
+		memcmp(header->magic, ROM_INDEX_MAGIC, 4) != 0 ||
+		header->version != ROM_INDEX_VERSION ||
+		header->mtime != mtime ||
+		strcmp(header->dir, mRomDir) != 0 ||
+		RomListReserve(header->count) != SAL_OK)
+	{
+		free(data);
+		return SAL_ERROR;
+	}
+
+	p = data + sizeof(*header);
+	end = data + size;
+	for (i = 0; i < header->count; i++)
+	{
+		struct SAL_DIRECTORY_ENTRY *entry = &mRomList[ROM_SELECTOR_ROM_START + i];
+
+		if (end - p < 2 || end - p < 2 + p[1])
+			break;
+		entry->type = p[0];
+		memcpy(entry->filename, p + 2, p[1]);
+		entry->filename[p[1]] = 0;
+		strcpy(entry->displayName, entry->filename);
+		p += 2 + p[1];
+	}
+
+	if (i == header->count)
+	{
+		mRomCount = ROM_SELECTOR_ROM_START + i;
+		result = SAL_OK;
+	}
+	free(data);
+	return result;
+}
+
+static void RomIndexSave(u32 mtime)
+{
+	s8 filename[SAL_MAX_PATH];
+	struct ROM_INDEX_HEADER *header;
+	u32 size = sizeof(*header);
+	u8 *data, *p;
+	s32 i;
+
+	// A change made later within the same second would not move the
+	// time on; such a directory is read again next time instead.
+	if ((u32) time(NULL) - mtime < 2)
+		return;
+
+	for (i = ROM_SELECTOR_ROM_START; i < mRomCount; i++)
+		size += 2 + strlen(mRomList[i].filename);
+	data = (u8 *) malloc(size);
+	if (data == NULL)
+		return;
+
+	header = (struct ROM_INDEX_HEADER *) data;
+	memset(header, 0, sizeof(*header));
+	memcpy(header->magic, ROM_INDEX_MAGIC, 4);
+	header->version = ROM_INDEX_VERSION;
+	header->mtime = mtime;
+	header->count = mRomCount - ROM_SELECTOR_ROM_START;
+	strcpy(header->dir, mRomDir);
+
+	p = data + sizeof(*header);
+	for (i = ROM_SELECTOR_ROM_START; i < mRomCount; i++)
+	{
+		u32 len = strlen(mRomList[i].filename);
+
+		p[0] = mRomList[i].type;
+		p[1] = len;
+		memcpy(p + 2, mRomList[i].filename, len);
+		p += 2 + len;
+	}
+
+	RomIndexFilename(filename);
+	sal_FileSaveAsync(filename, data, size);
+	free(data);
 }
 
 int FileScan()
 {
-	s32 itemCount = 0, fileCount = 0, dirCount = 0;
-	s32 x, a, b, startIndex = ROM_SELECTOR_DEFAULT_FOCUS + 1;
-	s8 text[50];
+	s32 x = 0, capacity = 0, startIndex = ROM_SELECTOR_ROM_START;
 	s8 filename[SAL_MAX_PATH];
 	s8 path[SAL_MAX_PATH];
 	s8 ext[SAL_MAX_PATH];
 	struct SAL_DIR d;
+	u32 mtime = 0;
 
 	freeRomLists();
 
-#if 0
-	PrintTitle("File Scan");
-	sal_VideoPrint(8,120,"Scanning Directory...",SAL_RGB(31,31,31));
-	sal_VideoFlip(1);
-#endif
-
-	if (sal_DirectoryGetItemCount(mRomDir,&itemCount) == SAL_ERROR) {
+	if (sal_DirectoryGetModified(mRomDir, &mtime) != SAL_OK) {
 		return SAL_ERROR;
 	}
 
-	mRomCount = ROM_SELECTOR_ROM_START + itemCount;
-	mRomList = (SAL_DIRECTORY_ENTRY*)malloc(sizeof(struct SAL_DIRECTORY_ENTRY) * mRomCount);
-
-	//was there enough memory?
-	if (mRomList == NULL) {
-		MenuMessageBox("Could not allocate memory", "Too many files", "", MENU_MESSAGE_BOX_MODE_PAUSE);
-		//not enough memory - try the minimum
-		mRomList = (SAL_DIRECTORY_ENTRY*)malloc(sizeof(struct SAL_DIRECTORY_ENTRY)*ROM_SELECTOR_ROM_START);
-		mRomCount = ROM_SELECTOR_ROM_START;
-		if (mRomList == NULL) {
-			//still no joy
-			MenuMessageBox("Dude, I'm really broken now", "Restart system", "never do this again", MENU_MESSAGE_BOX_MODE_PAUSE);
-			mRomCount = -1;
-			return SAL_ERROR;
-		}
+	if (RomListReserve(0) != SAL_OK) {
+		//still no joy
+		MenuMessageBox("Dude, I'm really broken now", "Restart system", "never do this again", MENU_MESSAGE_BOX_MODE_PAUSE);
+		mRomCount = -1;
+		return SAL_ERROR;
 	}
+	mRomCount = ROM_SELECTOR_ROM_START;
 
-	//Add default items
-	DefaultRomListItems();
+	if (RomIndexLoad(mtime) == SAL_OK) {
+		DefaultRomListItems();
+		RomInfoScan(mRomDir, &mRomList[ROM_SELECTOR_ROM_START], mRomCount - ROM_SELECTOR_ROM_START);
+		return SAL_OK;
+	}
 
-	if (itemCount > 0) {
-		if (sal_DirectoryOpen(mRomDir, &d) == SAL_OK) {
-			//Dir opened, now stream out details
-			x = 0;
-			while (sal_DirectoryRead(&d, &mRomList[x+startIndex], mRomDir) == SAL_OK) {
-				//Dir entry read
-#if 0
-				PrintTitle("File Scan");
-				sprintf(text,"Fetched item %d of %d",x, itemCount-1);
-				sal_VideoPrint(8,120,text,SAL_RGB(31,31,31));
-				PrintBar(228-4);
-				sal_VideoPrint(0,228,mRomDir,SAL_RGB(0,0,0));
-				sal_VideoFlip(1);
-#endif
-				if (mRomList[x+startIndex].type == SAL_FILE_TYPE_FILE) {
-					sal_DirectorySplitFilename(mRomList[x + startIndex].filename, path, filename, ext);
-					if (
-						sal_StringCompare(ext, "zip") == 0 ||
-						sal_StringCompare(ext, "smc") == 0 ||
-						sal_StringCompare(ext, "sfc") == 0 ||
-						sal_StringCompare(ext, "fig") == 0 /* Super WildCard dump */ ||
-						sal_StringCompare(ext, "swc") == 0 /* Super WildCard dump */)
-					{
-						fileCount++;
-						x++;
-					}
-				} else {
-					dirCount++;
-					x++;
-				}
+	if (sal_DirectoryOpen(mRomDir, &d) != SAL_OK) {
+		return SAL_ERROR;
+	}
 
+	//Dir opened, now stream out details
+	for (;;) {
+		if (x == capacity) {
+			if (RomListReserve(capacity + ROM_LIST_GROW) != SAL_OK) {
+				MenuMessageBox("Could not allocate memory", "Too many files", "", MENU_MESSAGE_BOX_MODE_PAUSE);
+				break;
 			}
-			mRomCount = ROM_SELECTOR_ROM_START + dirCount + fileCount;
-			sal_DirectoryClose(&d);
-		} else {
-			return SAL_ERROR;
+			capacity += ROM_LIST_GROW;
 		}
+		if (sal_DirectoryRead(&d, &mRomList[x + startIndex], mRomDir) != SAL_OK)
+			break;
 
-#if 0
-		PrintTitle("File Scan");
-		sal_VideoPrint(8,120,"Sorting items...",SAL_RGB(31,31,31));
-		sal_VideoFlip(1);
-#endif
-		int lowIndex = 0;
-		//Put all directory entries at the top
-		for (a = startIndex; a < startIndex + dirCount; a++) {
-			if (mRomList[a].type == SAL_FILE_TYPE_FILE) {
-				for (b = a + 1; b < mRomCount; b++) {
-					if (mRomList[b].type == SAL_FILE_TYPE_DIRECTORY) {
-						SwapDirectoryEntry(&mRomList[a],&mRomList[b]);
-						break;
-					}
-				}
+		if (mRomList[x + startIndex].type == SAL_FILE_TYPE_FILE) {
+			sal_DirectorySplitFilename(mRomList[x + startIndex].filename, path, filename, ext);
+			if (
+				sal_ArchiveCheck(mRomList[x + startIndex].filename) ||
+				sal_StringCompare(ext, "smc") == 0 ||
+				sal_StringCompare(ext, "sfc") == 0 ||
+				sal_StringCompare(ext, "fig") == 0 /* Super WildCard dump */ ||
+				sal_StringCompare(ext, "swc") == 0 /* Super WildCard dump */)
+			{
+				x++;
 			}
+		} else {
+			x++;
 		}
+	}
+	sal_DirectoryClose(&d);
 
-		//Now sort directory entries
-		for (a = startIndex; a < startIndex + dirCount; a++) {
-			lowIndex = a;
-			for (b = a + 1; b < startIndex + dirCount; b++) {
-				if (sal_StringCompare(mRomList[b].displayName, mRomList[lowIndex].displayName) < 0) {
-					//this index is lower
-					lowIndex = b;
-				}
-			}
-			//lowIndex should index next lowest value
-			SwapDirectoryEntry(&mRomList[lowIndex], &mRomList[a]);
-		}
+	mRomCount = ROM_SELECTOR_ROM_START + x;
+	qsort(&mRomList[startIndex], x, sizeof(struct SAL_DIRECTORY_ENTRY), CompareDirectoryEntry);
 
-		//Now sort file entries
-		for (a = startIndex + dirCount; a < mRomCount; a++) {
-			lowIndex = a;
-			for (b = a + 1; b < mRomCount; b++) {
-				if (sal_StringCompare(mRomList[b].displayName, mRomList[lowIndex].displayName) < 0) {
-					//this index is lower
-					lowIndex = b;
-				}
-			}
-			//lowIndex should index next lowest value
-			SwapDirectoryEntry(&mRomList[lowIndex], &mRomList[a]);
-		}
-	}
+	//Add default items
+	DefaultRomListItems();
 
+	RomIndexSave(mtime);
+	RomInfoScan(mRomDir, &mRomList[startIndex], x);
 	return SAL_OK;
 }
 
-s32 UpdateRomCache()
+static void PreviewPath(s8 *path, const char *filename)
 {
-	s8 filename[SAL_MAX_PATH];
-	PrintTitle("CRC Lookup");
-	sal_VideoPrint(8, 120, "Saving cache to disk...", SAL_RGB(31, 31, 31));
-	sal_VideoFlip(1);
-
-	strcpy(filename, mRomDir);
-	sal_DirectoryCombine(filename, "romcache.dat");
-	sal_FileSave(filename, (u8*)&mRomList[0], sizeof(struct SAL_DIRECTORY_ENTRY)*(mRomCount));
+	s8 dummy[SAL_MAX_PATH], fileNameNoExt[SAL_MAX_PATH];
 
-	return SAL_OK;
+	sal_DirectorySplitFilename(filename, dummy, fileNameNoExt, dummy);
+	sprintf(path, "%s/previews/%s.%s", sal_DirectoryGetHome(), fileNameNoExt, "png");
 }
 
 s32 FileSelect()
@@ -407,7 +574,7 @@ s32 FileSelect()
 	s8 text[SAL_MAX_PATH];
 	s8 previewPath[SAL_MAX_PATH];
 	s8 previousRom[SAL_MAX_PATH];
-	u16 romPreview[262 * 186];
+	u16 romPreview[PREVIEW_WIDTH * PREVIEW_HEIGHT];
 	bool8 havePreview = FALSE;
 	s32 action = 0;
 	s32 smooth = 0;
@@ -420,6 +587,7 @@ s32 FileSelect()
 	s32 size = 0, check = SAL_OK;
 
 	previousRom[0] = '\0';
+	previewPath[0] = '\0';
 
 	if (FileScan() != SAL_OK) {
 		strcpy(mRomDir, sal_DirectoryGetUser());
@@ -530,18 +698,31 @@ s32 FileSelect()
 		PrintTitle("ROM selection");
 
 		if (strcmp(mRomList[focus].displayName, previousRom) != 0) {
-			char dummy[SAL_MAX_PATH], fileNameNoExt[SAL_MAX_PATH];
-			sal_DirectorySplitFilename(mRomList[focus].filename, dummy, fileNameNoExt, dummy);
-			sprintf(previewPath, "%s/previews/%s.%s", sal_DirectoryGetHome(), fileNameNoExt, "png");
-			strcpy(previousRom, mRomList[focus].displayName);
-			havePreview = sal_ImageLoad(previewPath, &romPreview, 262, 186) != SAL_ERROR;
-			if (havePreview) {
-				sal_VideoBitmapDim(romPreview, 262 * 186);
+			s8 want[PREVIEW_WANT_MAX][SAL_MAX_PATH];
+			s32 wantCount = 0;
+
+			// The focused entry's image first, then its neighbours', so
+			// they are ready when the focus moves on
+			for (i = 0; i < PREVIEW_WANT_MAX; i++) {
+				s32 entry = focus + (i & 1 ? (i + 1) / 2 : -(i / 2));
+				if (entry >= ROM_SELECTOR_ROM_START && entry < mRomCount)
+					PreviewPath(want[wantCount++], mRomList[entry].filename);
 			}
+			PreviewWant(want, wantCount);
+
+			previewPath[0] = '\0';
+			if (focus >= ROM_SELECTOR_ROM_START)
+				strcpy(previewPath, want[0]);
+			strcpy(previousRom, mRomList[focus].displayName);
+			havePreview = FALSE;
+		}
+
+		if (!havePreview && previewPath[0]) {
+			havePreview = PreviewGet(previewPath, romPreview) == SAL_OK;
 		}
 
 		if (havePreview) {
-			sal_ImageDraw(romPreview, 262, 186, 0, 16);
+			sal_ImageDraw(romPreview, PREVIEW_WIDTH, PREVIEW_HEIGHT, 0, 16);
 		}
 
 		smooth = smooth * 7 + (focus << 8);
@@ -577,6 +758,22 @@ s32 FileSelect()
 			}
 		}
 
+		// What the indexer has found out about the ROM so far; a path too
+		// long for text is never indexed either
+		if (focus >= ROM_SELECTOR_ROM_START && mRomList[focus].type == SAL_FILE_TYPE_FILE &&
+			strlen(mRomDir) + strlen(mRomList[focus].filename) + 2 <= SAL_MAX_PATH) {
+			struct ROM_INFO info;
+
+			strcpy(text, mRomDir);
+			sal_DirectoryCombine(text, mRomList[focus].filename);
+			if (RomInfoGet(text, &info) == SAL_OK) {
+				sal_VideoPrint(0, 204, info.title, SAL_RGB(31, 31, 31));
+				sprintf(text, "%s %s %s %08X", RomInfoMapName(&info), RomInfoChipName(&info),
+					RomInfoRegionName(&info), info.crc);
+				sal_VideoPrint(0, 216, text, SAL_RGB(31, 31, 31));
+			}
+		}
+
 		sal_VideoPrint(0, 4, mRomDir, SAL_RGB(31, 8, 8));
 
 		sal_VideoFlip(1);
@@ -584,6 +781,8 @@ s32 FileSelect()
 	}
 	sal_InputIgnore();
 
+	PreviewStop();
+	RomInfoStop();
 	freeRomLists();
 
 	return action;
@@ -626,48 +825,92 @@ static void ScanSaveStates(s8 *romname)
 static
 bool8 LoadStateTemp()
 {
-	char name[SAL_MAX_PATH];
 	bool8 ret;
-	sprintf(name, "%s%s%s", sal_DirectoryGetTemp(), SAL_DIR_SEP, ".svt");
-	if (!(ret = S9xUnfreezeGame(name))) {
-		fprintf(stderr, "Failed to read saved state at %s: %s\n", name, strerror(errno));
+	if (!(ret = (S9xUnfreezeFromMemory(&mTempState) == SUCCESS))) {
+		fprintf(stderr, "Failed to restore the state saved on entering the menu\n");
 	}
 	return ret;
 }
 
+// Halves the last frame drawn, averaging each 2x2 block. Called while the
+// game's frame is still in GFX.Screen: on a quick save, and on leaving the
+// game for the menu.
+void CaptureStateThumb()
+{
+	u32 x, y;
+
+	for (y = 0; y < THUMB_HEIGHT; y++) {
+		u16 *src = (u16 *) (GFX.Screen + y * 2 * GFX.Pitch);
+		u16 *src2 = (u16 *) ((u8 *) src + GFX.Pitch);
+		u16 *dst = &mThumb.pixels[y * THUMB_WIDTH];
+		for (x = 0; x < THUMB_WIDTH; x++, src += 2, src2 += 2) {
+			u16 top = ((src[0] & 0xF7DE) >> 1) + ((src[1] & 0xF7DE) >> 1);
+			u16 bottom = ((src2[0] & 0xF7DE) >> 1) + ((src2[1] & 0xF7DE) >> 1);
+			*dst++ = ((top & 0xF7DE) >> 1) + ((bottom & 0xF7DE) >> 1);
+		}
+	}
+	mThumb.width = THUMB_WIDTH;
+	mThumb.height = THUMB_HEIGHT;
+}
+
+// SAL_OK if the slot has a thumbnail of this very ROM.
+static
+s32 LoadSlotThumb(const s8 *filename)
+{
+	sal_FileSaveFlush();
+	if (S9xSnapshotReadSection(filename, "INF", (uint8 *) &mSlotInfo, sizeof(mSlotInfo)) != sizeof(mSlotInfo) ||
+		mSlotInfo.crc != Memory.ROMCRC32)
+		return SAL_ERROR;
+	if (S9xSnapshotReadSection(filename, "THM", (uint8 *) &mSlotThumb, sizeof(mSlotThumb)) != sizeof(mSlotThumb) ||
+		mSlotThumb.width != THUMB_WIDTH || mSlotThumb.height != THUMB_HEIGHT)
+		return SAL_ERROR;
+	return SAL_OK;
+}
+
 static
 void SaveStateTemp()
 {
-	char name[SAL_MAX_PATH];
-	sprintf(name, "%s%s%s", sal_DirectoryGetTemp(), SAL_DIR_SEP, ".svt");
-	if (!S9xFreezeGame(name)) {
-		fprintf(stderr, "Failed to write saved state at %s: %s\n", name, strerror(errno));
+	if (!S9xFreezeToMemory(&mTempState)) {
+		fprintf(stderr, "Failed to save the state on entering the menu\n");
 	}
 }
 
 static
 void DeleteStateTemp()
 {
-	char name[SAL_MAX_PATH];
-	sprintf(name, "%s%s%s", sal_DirectoryGetTemp(), SAL_DIR_SEP, ".svt");
-	sal_FileDelete(name);
+	// Keep the buffer for the next time the menu is opened.
+	mTempState.used = 0;
 }
 
 // static
 bool LoadStateFile(s8 *filename)
 {
 	bool ret;
+	// A save to this file may still be on its way to the card.
+	sal_FileSaveFlush();
 	if (!(ret = S9xUnfreezeGame(filename))) {
 		fprintf(stderr, "Failed to read saved state at %s: %s\n", filename, strerror(errno));
 	}
 	return ret;
 }
 
+// The state is taken at once, with the picture of the game last captured;
+// the background writer puts it in the file. sal_FileSaveWait on the file
+// tells whether it got there.
 // static
 bool SaveStateFile(s8 *filename)
 {
+	struct STATE_INFO info;
+	SSnapshotSection extra[2] = {
+		{ "INF", (uint8 *) &info, sizeof(info) },
+		{ "THM", (uint8 *) &mThumb, sizeof(mThumb) }
+	};
 	bool ret;
-	if (!(ret = S9xFreezeGame(filename))) {
+
+	info.crc = Memory.ROMCRC32;
+	info.time = (u32) time(NULL);
+	if (!(ret = S9xFreezeGameToMemory(&mStateFile, extra, 2) &&
+		sal_FileSaveAsync(filename, mStateFile.data, mStateFile.used) == SAL_OK)) {
 		fprintf(stderr, "Failed to write saved state at %s: %s\n", filename, strerror(errno));
 	}
 	return ret;
@@ -713,20 +956,20 @@ static s32 SaveStateSelect(s32 mode)
 		if (keys & INP_BUTTON_MENU_CANCEL) {
 			action = 0; // exit
 		}
-		else if ((keys & INP_BUTTON_MENU_PREVIEW_SAVESTATE) && (action == 12)) {
+		else if ((keys & INP_BUTTON_MENU_PREVIEW_SAVESTATE) && (action == 12 || action == 14)) {
 			action = 3;  // preview slot mode
 		}
 		else if (keys & INP_BUTTON_MENU_SELECT) {
 			if (saveno == -1) {
 				action = 0; // exit
 			}
-			else if ((mode == 0) && ((action == 2) || (action == 5) || (action == 12))) {
+			else if ((mode == 0) && ((action == 2) || (action == 5) || (action == 12) || (action == 14))) {
 				action = 6;  // pre-save mode
 			}
-			else if ((mode == 1) && ((action == 5) || (action == 12))) {
+			else if ((mode == 1) && ((action == 5) || (action == 12) || (action == 14))) {
 				action = 8;  // pre-load mode
 			}
-			else if (((mode == 2) && ((action == 5) || (action == 12))) || ((keys & SAL_INPUT_X) && (mode == 0))) {
+			else if (((mode == 2) && ((action == 5) || (action == 12) || (action == 14))) || ((keys & SAL_INPUT_X) && (mode == 0))) {
 				if (MenuMessageBox("Are you sure you want to delete", "this save?", "", MENU_MESSAGE_BOX_MODE_YESNO) == SAL_OK) {
 					action = 13;  //delete slot with no preview
 				}
@@ -815,14 +1058,36 @@ static s32 SaveStateSelect(s32 mode)
 			case 13:
 				sal_VideoPrint(87, 145 - 36, "Deleting...", SAL_RGB(31, 31, 31));
 				break;
+			case 14: {
+				time_t saved = mSlotInfo.time;
+				sal_ImageDraw(mSlotThumb.pixels, THUMB_WIDTH, THUMB_HEIGHT, (262 - THUMB_WIDTH) / 2, 40);
+				strftime(text, sizeof(text), "%Y-%m-%d %H:%M", localtime(&saved));
+				sal_VideoPrint((262 - (strlen(text) << 3)) >> 1, 158, text, SAL_RGB(31, 31, 31));
+				sal_VideoPrint((262 - (strlen(MENU_TEXT_PREVIEW_SAVESTATE) << 3)) >> 1, 170, MENU_TEXT_PREVIEW_SAVESTATE, SAL_RGB(31, 31, 31));
+				sal_VideoDrawRect(0, 186, 262, 16, SAL_RGB(22, 0, 0));
+				switch (mode) {
+					case 1:
+						sal_VideoPrint((262 - (strlen(MENU_TEXT_LOAD_SAVESTATE) << 3)) >> 1, 190, MENU_TEXT_LOAD_SAVESTATE, SAL_RGB(31, 31, 31));
+						break;
+					case 2:
+						sal_VideoPrint((262 - (strlen(MENU_TEXT_DELETE_SAVESTATE) << 3)) >> 1, 190, MENU_TEXT_DELETE_SAVESTATE, SAL_RGB(31, 31, 31));
+						break;
+					default:
+						sal_VideoPrint((262 - (strlen(MENU_TEXT_OVERWRITE_SAVESTATE) << 3)) >> 1, 190, MENU_TEXT_OVERWRITE_SAVESTATE, SAL_RGB(31, 31, 31));
+						break;
+				}
+				break;
+			}
 		}
 
 		sal_VideoFlip(1);
 
 		switch (action) {
 			case 1:
+				// A slot with a thumbnail is shown from it; older saves
+				// and other games' are still previewed by running them.
 				if (mSaveState[saveno].inUse) {
-					action = 3;
+					action = LoadSlotThumb(mSaveState[saveno].fullFilename) == SAL_OK ? 14 : 3;
 				} else {
 					action = 2;
 				}
@@ -849,7 +1114,8 @@ static s32 SaveStateSelect(s32 mode)
 			case 6:
 				//Reload state in case user has been previewing
 				LoadStateTemp();
-				if (SaveStateFile(mSaveState[saveno].fullFilename)) {
+				if (SaveStateFile(mSaveState[saveno].fullFilename) &&
+					sal_FileSaveWait(mSaveState[saveno].fullFilename) == SAL_OK) {
 					mSaveState[saveno].inUse = 1;
 					action = 1;
 				} else {
@@ -867,6 +1133,7 @@ static s32 SaveStateSelect(s32 mode)
 				action = 1;
 				break;
 			case 13:
+				sal_FileSaveFlush();
 				sal_FileDelete(mSaveState[saveno].fullFilename);
 				mSaveState[saveno].inUse = 0;
 				action = 1;
@@ -1051,6 +1318,14 @@ void AudioSettingsMenuUpdateText(s32 menu_index)
 			}
 			break;
 
+		case AUDIO_SETTINGS_MENU_SOUND_BATCH:
+			sprintf(mMenuText[menu_index], "Mix once per frame          %s", mMenuOptions->soundBatch ? " ON" : "OFF");
+			break;
+
+		case AUDIO_SETTINGS_MENU_SOUND_CORE:
+			sprintf(mMenuText[menu_index], "Accurate DSP core           %s", mMenuOptions->soundCore ? " ON" : "OFF");
+			break;
+
 		case AUDIO_SETTINGS_MENU_SOUND_ON:
 			sprintf(mMenuText[menu_index], "Sound                       %s", mMenuOptions->soundEnabled ? " ON" : "OFF");
 			break;
@@ -1084,6 +1359,21 @@ void SettingsMenuUpdateText(s32 menu_index)
 			sprintf(mMenuText[menu_index], "Save SRAM                %s", mMenuOptions->autoSaveSram ? "  AUTO" : "MANUAL");
 			break;
 
+		case SETTINGS_MENU_REWIND:
+			sprintf(mMenuText[menu_index], "Rewind                      %s", mMenuOptions->rewind ? " ON" : "OFF");
+			break;
+
+		case SETTINGS_MENU_RESUME:
+			sprintf(mMenuText[menu_index], "Resume on start             %s", mResumeOn ? " ON" : "OFF");
+			break;
+
+		case SETTINGS_MENU_RUN_AHEAD:
+			if (mMenuOptions->runAhead)
+				sprintf(mMenuText[menu_index], "Run-ahead frames              %d", mMenuOptions->runAhead);
+			else
+				strcpy(mMenuText[menu_index], "Run-ahead frames            OFF");
+			break;
+
 #if 0
 		case SETTINGS_MENU_CPU_SPEED:
 			sprintf(mMenuText[menu_index], "Cpu Speed:                  %d", mMenuOptions->cpuSpeed);
@@ -1122,6 +1412,9 @@ void SettingsMenuUpdateTextAll(void)
 	SettingsMenuUpdateText(SETTINGS_MENU_SAVE_GLOBAL_SETTINGS);
 	SettingsMenuUpdateText(SETTINGS_MENU_SAVE_CURRENT_SETTINGS);
 	SettingsMenuUpdateText(SETTINGS_MENU_AUTO_SAVE_SRAM);
+	SettingsMenuUpdateText(SETTINGS_MENU_REWIND);
+	SettingsMenuUpdateText(SETTINGS_MENU_RUN_AHEAD);
+	SettingsMenuUpdateText(SETTINGS_MENU_RESUME);
 	SettingsMenuUpdateText(MENU_CREDITS);
 }
 
@@ -1132,6 +1425,8 @@ void AudioSettingsMenuUpdateTextAll(void)
 	AudioSettingsMenuUpdateText(AUDIO_SETTINGS_MENU_SOUND_STEREO);
 	AudioSettingsMenuUpdateText(AUDIO_SETTINGS_MENU_SOUND_RATE);
 	AudioSettingsMenuUpdateText(AUDIO_SETTINGS_MENU_SOUND_SYNC);
+	AudioSettingsMenuUpdateText(AUDIO_SETTINGS_MENU_SOUND_BATCH);
+	AudioSettingsMenuUpdateText(AUDIO_SETTINGS_MENU_SOUND_CORE);
 }
 
 static
@@ -1178,6 +1473,12 @@ void MenuReloadOptions()
 	DefaultMenuOptions();
 }
 
+static int BackdropThread(void *unused)
+{
+	sal_ImageLoad("backdrop.png", &mMenuBackground, SAL_SCREEN_WIDTH, SAL_SCREEN_HEIGHT);
+	return 0;
+}
+
 void MenuInit(const char *systemDir, struct MENU_OPTIONS *menuOptions)
 {
 	s8 filename[SAL_MAX_PATH];
@@ -1190,13 +1491,20 @@ void MenuInit(const char *systemDir, struct MENU_OPTIONS *menuOptions)
 	if (LoadMenuOptions(mSystemDir, DEFAULT_ROM_DIR_FILENAME, DEFAULT_ROM_DIR_EXT, mRomDir, SAL_MAX_PATH, 0) != SAL_OK) {
 		strcpy(mRomDir,systemDir);
 	}
+	if (LoadMenuOptions(mSystemDir, RESUME_ON_FILENAME, RESUME_ON_EXT, (s8 *) &mResumeOn, sizeof(mResumeOn), 0) != SAL_OK) {
+		mResumeOn = 0;
+	}
 
 	pix = &mMenuBackground[0];
 	for (x = 0; x < SAL_SCREEN_WIDTH * SAL_SCREEN_HEIGHT; x++) {
 		*pix++ = SAL_RGB(0,0,0);
 	}
 
-	sal_ImageLoad("backdrop.png", &mMenuBackground, SAL_SCREEN_WIDTH, SAL_SCREEN_HEIGHT);
+	// Decoded while the emulator starts up; the first title drawn waits
+	// for it.
+	mBackdropThread = SDL_CreateThread(BackdropThread, NULL);
+	if (!mBackdropThread)
+		BackdropThread(NULL);
 
 	MenuReloadOptions();
 }
@@ -1312,6 +1620,14 @@ s32 AudioSettingsMenu(void)
 					}
 					break;
 
+				case AUDIO_SETTINGS_MENU_SOUND_BATCH:
+					mMenuOptions->soundBatch ^= 1;
+					break;
+
+				case AUDIO_SETTINGS_MENU_SOUND_CORE:
+					mMenuOptions->soundCore ^= 1;
+					break;
+
 				case AUDIO_SETTINGS_MENU_SOUND_RATE:
 					if (keys & SAL_INPUT_RIGHT) {
 						mMenuOptions->soundRate = sal_AudioRateNext(mMenuOptions->soundRate);
@@ -1382,6 +1698,18 @@ s32 SettingsMenu(void)
 				sal_VideoPrint(60, 180, "Press A to save now", SAL_RGB(31, 31, 31));
 				break;
 
+			case SETTINGS_MENU_REWIND:
+				sal_VideoPrint(48, 180, "Hold SELECT+Y to rewind", SAL_RGB(31, 31, 31));
+				break;
+
+			case SETTINGS_MENU_RUN_AHEAD:
+				sal_VideoPrint(56, 180, "Hides the game's input lag", SAL_RGB(31, 31, 31));
+				break;
+
+			case SETTINGS_MENU_RESUME:
+				sal_VideoPrint(36, 180, "Exit saves, start carries on", SAL_RGB(31, 31, 31));
+				break;
+
 			case SETTINGS_MENU_SAVE_CURRENT_SETTINGS:
 				if (mRomName[0] != 0) {
 					switch (menuGameSettings) {
@@ -1464,6 +1792,23 @@ s32 SettingsMenu(void)
 					mMenuOptions->autoSaveSram ^= 1;
 					break;
 
+				case SETTINGS_MENU_REWIND:
+					mMenuOptions->rewind ^= 1;
+					break;
+
+				case SETTINGS_MENU_RESUME:
+					mResumeOn ^= 1;
+					SaveMenuOptions(mSystemDir, RESUME_ON_FILENAME, RESUME_ON_EXT, (s8 *) &mResumeOn, sizeof(mResumeOn), 0);
+					break;
+
+				case SETTINGS_MENU_RUN_AHEAD:
+					if (keys & SAL_INPUT_RIGHT) {
+						if (++mMenuOptions->runAhead > RUN_AHEAD_MAX_FRAMES) mMenuOptions->runAhead = 0;
+					} else {
+						if (mMenuOptions->runAhead-- == 0) mMenuOptions->runAhead = RUN_AHEAD_MAX_FRAMES;
+					}
+					break;
+
 				case SETTINGS_MENU_SAVE_GLOBAL_SETTINGS:
 					menuGlobalSettings = menuGlobalSettings > 0 ? 0 : 1;
 					break;
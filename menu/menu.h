@@ -10,6 +10,10 @@
 #define MENU_OPTIONS_EXT			"opt"
 #define DEFAULT_ROM_DIR_FILENAME	"romdir"
 #define DEFAULT_ROM_DIR_EXT			"opt"
+#define RESUME_ROM_FILENAME			"resume.opt"
+#define RESUME_STATE_FILENAME		"resume.sv"
+#define RESUME_ON_FILENAME			"resumeon"
+#define RESUME_ON_EXT				"opt"
 
 #define SAVESTATE_MODE_SAVE			0
 #define SAVESTATE_MODE_LOAD			1
@@ -36,6 +40,9 @@ enum SETTINGS_MENU_ENUM
 	VIDEO_MENU_SETTINGS = 0,
 	AUDIO_MENU_SETTINGS,
 	SETTINGS_MENU_AUTO_SAVE_SRAM,
+	SETTINGS_MENU_REWIND,
+	SETTINGS_MENU_RUN_AHEAD,
+	SETTINGS_MENU_RESUME,
 	SETTINGS_MENU_SAVE_CURRENT_SETTINGS,
 	SETTINGS_MENU_SAVE_GLOBAL_SETTINGS,
 	MENU_CREDITS,
@@ -49,6 +56,8 @@ enum AUDIO_SETTINGS_MENU_ENUM
 	AUDIO_SETTINGS_MENU_SOUND_RATE,
 	AUDIO_SETTINGS_MENU_SOUND_STEREO,
 	AUDIO_SETTINGS_MENU_SOUND_SYNC,
+	AUDIO_SETTINGS_MENU_SOUND_BATCH,
+	AUDIO_SETTINGS_MENU_SOUND_CORE,
 	AUDIO_SETTINGS_MENU_COUNT
 };
 
@@ -127,10 +136,10 @@ struct MENU_OPTIONS
   unsigned int cpuSpeed;
   unsigned int soundRate;
   unsigned int soundSync;
-  unsigned int spare02;
-  unsigned int spare03;
-  unsigned int spare04;
-  unsigned int spare05;
+  unsigned int soundBatch;
+  unsigned int soundCore;
+  unsigned int rewind;
+  unsigned int runAhead;
   unsigned int spare06;
   unsigned int spare07;
   unsigned int spare08;
@@ -171,6 +180,11 @@ u32 IsPreviewingState();
 
 bool LoadStateFile(s8 *filename);
 bool SaveStateFile(s8 *filename);
+void CaptureStateThumb();
+s32 SaveResumeState(const char *romName);
+s32 LoadResumeRom(s8 *romName);
+s32 LoadResumeState(void);
+u32 ResumeEnabled(void);
 
 
 #endif /* _MENU_H_ */
@@ -0,0 +1,209 @@
+/* ROM browser preview images.
+ *
+ * The browser tells PreviewWant which images it wants, the focused entry's
+ * first and then its neighbours', and a worker thread decodes them into a
+ * small cache, least recently used first out. PreviewGet only copies an
+ * image that is already decoded, so scrolling never waits for the SD card
+ * or libpng. A missing or broken image is remembered too, and not looked
+ * for again while it stays in the cache.
+ */
+#include "sal.h"
+#include "preview.h"
+
+#define PREVIEW_CACHE_SIZE	8
+
+enum PREVIEW_STATE
+{
+	PREVIEW_EMPTY = 0,
+	PREVIEW_LOADING,
+	PREVIEW_READY,
+	PREVIEW_MISSING
+};
+
+struct PREVIEW
+{
+	s8 path[SAL_MAX_PATH];
+	s32 state;
+	u32 used;
+	u16 *pixels;
+};
+
+static struct PREVIEW mCache[PREVIEW_CACHE_SIZE];
+static u32 mCacheClock = 0;
+
+static s8 mWant[PREVIEW_WANT_MAX][SAL_MAX_PATH];
+static s32 mWantCount = 0;
+
+static SDL_Thread *mPreviewThread = NULL;
+static SDL_mutex *mPreviewLock = NULL;
+static SDL_cond *mPreviewWake = NULL;
+static s32 mPreviewQuit = 0;
+
+static struct PREVIEW *FindPreview(const char *path)
+{
+	s32 i;
+
+	for (i = 0; i < PREVIEW_CACHE_SIZE; i++)
+		if (mCache[i].state != PREVIEW_EMPTY && strcmp(mCache[i].path, path) == 0)
+			return &mCache[i];
+	return NULL;
+}
+
+static s32 Wanted(const char *path)
+{
+	s32 i;
+
+	for (i = 0; i < mWantCount; i++)
+		if (strcmp(mWant[i], path) == 0)
+			return SAL_TRUE;
+	return SAL_FALSE;
+}
+
+// The next wanted image that is not in the cache, and the slot to decode
+// it into: an empty one, or else the least recently used one that is not
+// wanted itself. Called with the lock held.
+static struct PREVIEW *NextPreview(void)
+{
+	struct PREVIEW *slot = NULL;
+	s32 i, j;
+
+	for (i = 0; i < mWantCount; i++)
+	{
+		if (FindPreview(mWant[i]))
+			continue;
+
+		for (j = 0; j < PREVIEW_CACHE_SIZE; j++)
+		{
+			struct PREVIEW *p = &mCache[j];
+
+			if (p->state == PREVIEW_LOADING || (p->state != PREVIEW_EMPTY && Wanted(p->path)))
+				continue;
+			if (!slot || p->state == PREVIEW_EMPTY ||
+				(slot->state != PREVIEW_EMPTY && p->used < slot->used))
+				slot = p;
+		}
+		if (slot)
+			strcpy(slot->path, mWant[i]);
+		return slot;
+	}
+	return NULL;
+}
+
+static int PreviewThread(void *unused)
+{
+	struct PREVIEW *slot;
+	s32 ok;
+
+	SDL_LockMutex(mPreviewLock);
+	while (!mPreviewQuit)
+	{
+		slot = NextPreview();
+		if (!slot)
+		{
+			SDL_CondWait(mPreviewWake, mPreviewLock);
+			continue;
+		}
+		slot->state = PREVIEW_LOADING;
+		slot->used = ++mCacheClock;
+		SDL_UnlockMutex(mPreviewLock);
+
+		if (!slot->pixels)
+			slot->pixels = (u16 *) malloc(PREVIEW_WIDTH * PREVIEW_HEIGHT * sizeof(u16));
+		ok = slot->pixels && sal_ImageLoad(slot->path, slot->pixels, PREVIEW_WIDTH, PREVIEW_HEIGHT) != SAL_ERROR;
+		if (ok)
+			sal_VideoBitmapDim(slot->pixels, PREVIEW_WIDTH * PREVIEW_HEIGHT);
+
+		SDL_LockMutex(mPreviewLock);
+		slot->state = ok ? PREVIEW_READY : PREVIEW_MISSING;
+	}
+	SDL_UnlockMutex(mPreviewLock);
+	return 0;
+}
+
+static s32 PreviewStart(void)
+{
+	if (mPreviewThread)
+		return SAL_OK;
+
+	mPreviewLock = SDL_CreateMutex();
+	mPreviewWake = SDL_CreateCond();
+	mPreviewQuit = 0;
+	if (mPreviewLock && mPreviewWake)
+		mPreviewThread = SDL_CreateThread(PreviewThread, NULL);
+	if (mPreviewThread)
+		return SAL_OK;
+
+	if (mPreviewWake) SDL_DestroyCond(mPreviewWake);
+	if (mPreviewLock) SDL_DestroyMutex(mPreviewLock);
+	mPreviewWake = NULL;
+	mPreviewLock = NULL;
+	return SAL_ERROR;
+}
+
+/* Replaces the list of wanted images, most wanted first. */
+void PreviewWant(const s8 (*paths)[SAL_MAX_PATH], s32 count)
+{
+	s32 i;
+
+	if (PreviewStart() != SAL_OK)
+		return;
+	if (count > PREVIEW_WANT_MAX)
+		count = PREVIEW_WANT_MAX;
+
+	SDL_LockMutex(mPreviewLock);
+	for (i = 0; i < count; i++)
+		strcpy(mWant[i], paths[i]);
+	mWantCount = count;
+	SDL_CondSignal(mPreviewWake);
+	SDL_UnlockMutex(mPreviewLock);
+}
+
+/* Copies the image to pixels if it has been decoded; SAL_ERROR if it is
+ * still on its way, or does not exist. */
+s32 PreviewGet(const char *path, u16 *pixels)
+{
+	struct PREVIEW *p;
+	s32 result = SAL_ERROR;
+
+	if (!mPreviewThread)
+		return SAL_ERROR;
+
+	SDL_LockMutex(mPreviewLock);
+	p = FindPreview(path);
+	if (p && p->state == PREVIEW_READY)
+	{
+		memcpy(pixels, p->pixels, PREVIEW_WIDTH * PREVIEW_HEIGHT * sizeof(u16));
+		p->used = ++mCacheClock;
+		result = SAL_OK;
+	}
+	SDL_UnlockMutex(mPreviewLock);
+	return result;
+}
+
+/* Stops the worker and gives the cache's memory back for the game. */
+void PreviewStop(void)
+{
+	s32 i;
+
+	if (!mPreviewThread)
+		return;
+
+	SDL_LockMutex(mPreviewLock);
+	mPreviewQuit = 1;
+	SDL_CondSignal(mPreviewWake);
+	SDL_UnlockMutex(mPreviewLock);
+	SDL_WaitThread(mPreviewThread, NULL);
+	mPreviewThread = NULL;
+
+	SDL_DestroyCond(mPreviewWake);
+	SDL_DestroyMutex(mPreviewLock);
+	mPreviewWake = NULL;
+	mPreviewLock = NULL;
+
+	for (i = 0; i < PREVIEW_CACHE_SIZE; i++)
+	{
+		free(mCache[i].pixels);
+		memset(&mCache[i], 0, sizeof(mCache[i]));
+	}
+	mWantCount = 0;
+}
@@ -0,0 +1,14 @@
+#ifndef _PREVIEW_H_
+#define _PREVIEW_H_
+
+#include "sal.h"
+
+#define PREVIEW_WIDTH		262
+#define PREVIEW_HEIGHT		186
+#define PREVIEW_WANT_MAX	5
+
+void PreviewWant(const s8 (*paths)[SAL_MAX_PATH], s32 count);
+s32 PreviewGet(const char *path, u16 *pixels);
+void PreviewStop(void);
+
+#endif /* _PREVIEW_H_ */
@@ -0,0 +1,487 @@
+/* ROM metadata indexer.
+ *
+ * RomInfoScan hands the files of the directory being browsed to a worker
+ * thread, which reads each cartridge header and takes the CRC32 of the
+ * image. What it finds is kept in ROM_INFO_FILENAME in the home directory,
+ * keyed by path, size and modification time, so only new or changed files
+ * are ever read again. The browser asks RomInfoGet for what is known so
+ * far and never waits for the worker.
+ */
+#include <zlib.h>
+
+#include "sal.h"
+#include "rominfo.h"
+
+#define ROM_INFO_MAGIC		"PSRI"
+#define ROM_INFO_VERSION	1
+#define ROM_INFO_HEAD_SIZE	(0x10000 + 0x200)	// both header locations, after a copier header
+#define ROM_INFO_CHUNK		0x10000
+
+struct ROM_INFO_ENTRY
+{
+	s8 *path;
+	u32 hash;
+	u32 size;
+	u32 mtime;
+	struct ROM_INFO info;
+};
+
+// Only the worker changes the table, under mInfoLock; it reads it without.
+static struct ROM_INFO_ENTRY *mEntries = NULL;
+static s32 mEntryCount = 0;
+static s32 mEntryCapacity = 0;
+static s32 mEntriesLoaded = 0;
+static s32 mEntriesChanged = 0;
+
+static s8 (*mQueue)[SAL_MAX_PATH] = NULL;
+static s32 mQueueCount = 0;
+static s32 mQueueNext = 0;
+
+static SDL_Thread *mInfoThread = NULL;
+static SDL_mutex *mInfoLock = NULL;
+static SDL_cond *mInfoWake = NULL;
+static volatile s32 mInfoQuit = 0;
+
+static u8 mHead[ROM_INFO_HEAD_SIZE];
+static u8 mChunk[ROM_INFO_CHUNK];
+
+static u32 PathHash(const char *path)
+{
+	return crc32(0L, (const Bytef *) path, strlen(path));
+}
+
+static struct ROM_INFO_ENTRY *FindEntry(const char *path)
+{
+	u32 hash = PathHash(path);
+	s32 i;
+
+	for (i = 0; i < mEntryCount; i++)
+		if (mEntries[i].hash == hash && strcmp(mEntries[i].path, path) == 0)
+			return &mEntries[i];
+	return NULL;
+}
+
+static s32 AddEntry(const char *path, u32 size, u32 mtime, const struct ROM_INFO *info)
+{
+	struct ROM_INFO_ENTRY *entry = FindEntry(path);
+	s8 *copy = NULL;
+
+	if (!entry)
+	{
+		copy = strdup(path);
+		if (!copy)
+			return SAL_ERROR;
+	}
+
+	SDL_LockMutex(mInfoLock);
+	if (!entry)
+	{
+		if (mEntryCount == mEntryCapacity)
+		{
+			s32 capacity = mEntryCapacity ? mEntryCapacity * 2 : 256;
+			struct ROM_INFO_ENTRY *entries = (struct ROM_INFO_ENTRY *)
+				realloc(mEntries, capacity * sizeof(struct ROM_INFO_ENTRY));
+			if (!entries)
+			{
+				SDL_UnlockMutex(mInfoLock);
+				free(copy);
+				return SAL_ERROR;
+			}
+			mEntries = entries;
+			mEntryCapacity = capacity;
+		}
+		entry = &mEntries[mEntryCount++];
+		entry->path = copy;
+		entry->hash = PathHash(path);
+	}
+	entry->size = size;
+	entry->mtime = mtime;
+	entry->info = *info;
+	SDL_UnlockMutex(mInfoLock);
+
+	mEntriesChanged = 1;
+	return SAL_OK;
+}
+
+/* The index file: magic, version and count, then per entry its size,
+ * mtime and CRC32, the map, type and region bytes, and the title and the
+ * path, each preceded by its length. Numbers are in host byte order; the
+ * file never leaves the device. */
+static void LoadEntries(void)
+{
+	s8 filename[SAL_MAX_PATH];
+	s8 path[SAL_MAX_PATH];
+	struct ROM_INFO info;
+	u32 size = 0, count, version, fsize, mtime, i;
+	u8 *data, *p, *end;
+
+	strcpy(filename, sal_DirectoryGetHome());
+	sal_DirectoryCombine(filename, ROM_INFO_FILENAME);
+	if (sal_FileGetSize(filename, &size) != SAL_OK || size < 12)
+		return;
+	data = (u8 *) malloc(size);
+	if (!data)
+		return;
+	if (sal_FileLoad(filename, data, size, &size) != SAL_OK ||
+		memcmp(data, ROM_INFO_MAGIC, 4) != 0)
+	{
+		free(data);
+		return;
+	}
+
+	memcpy(&version, data + 4, 4);
+	memcpy(&count, data + 8, 4);
+	p = data + 12;
+	end = data + size;
+	for (i = 0; version == ROM_INFO_VERSION && i < count && !mInfoQuit; i++)
+	{
+		memset(&info, 0, sizeof(info));
+		if (end - p < 16 || end - p < 16 + p[15])
+			break;
+		memcpy(&fsize, p, 4);
+		memcpy(&mtime, p + 4, 4);
+		memcpy(&info.crc, p + 8, 4);
+		info.map = p[12];
+		info.type = p[13];
+		info.region = p[14];
+		memcpy(info.title, p + 16, p[15] > ROM_INFO_TITLE_LEN ? ROM_INFO_TITLE_LEN : p[15]);
+		p += 16 + p[15];
+
+		if (end - p < 1 || end - p < 1 + p[0])
+			break;
+		memcpy(path, p + 1, p[0]);
+		path[p[0]] = 0;
+		p += 1 + p[0];
+
+		AddEntry(path, fsize, mtime, &info);
+	}
+	free(data);
+	mEntriesChanged = 0;
+}
+
+static void SaveEntries(void)
+{
+	s8 filename[SAL_MAX_PATH];
+	u32 size = 12, count = 0, version = ROM_INFO_VERSION;
+	u8 *data, *p;
+	s32 i;
+
+	// A failed save is not retried until something else changes.
+	mEntriesChanged = 0;
+	for (i = 0; i < mEntryCount; i++)
+		size += 17 + strlen(mEntries[i].info.title) + strlen(mEntries[i].path);
+	data = (u8 *) malloc(size);
+	if (!data)
+		return;
+
+	p = data + 12;
+	for (i = 0; i < mEntryCount; i++)
+	{
+		struct ROM_INFO_ENTRY *entry = &mEntries[i];
+		u32 titleLen = strlen(entry->info.title);
+		u32 pathLen = strlen(entry->path);
+
+		if (pathLen > 255)
+			continue;
+		memcpy(p, &entry->size, 4);
+		memcpy(p + 4, &entry->mtime, 4);
+		memcpy(p + 8, &entry->info.crc, 4);
+		p[12] = entry->info.map;
+		p[13] = entry->info.type;
+		p[14] = entry->info.region;
+		p[15] = titleLen;
+		memcpy(p + 16, entry->info.title, titleLen);
+		p += 16 + titleLen;
+		p[0] = pathLen;
+		memcpy(p + 1, entry->path, pathLen);
+		p += 1 + pathLen;
+		count++;
+	}
+	memcpy(data, ROM_INFO_MAGIC, 4);
+	memcpy(data + 4, &version, 4);
+	memcpy(data + 8, &count, 4);
+
+	strcpy(filename, sal_DirectoryGetHome());
+	sal_DirectoryCombine(filename, ROM_INFO_FILENAME);
+	sal_FileSaveAtomic(filename, data, p - data);
+	free(data);
+}
+
+// Rates how much the header at h, 0x7FC0 or 0xFFC0 into the image, looks
+// like a real one, in the spirit of CMemory::ScoreLoROM/ScoreHiROM.
+static s32 ScoreHeader(const u8 *h, s32 hirom)
+{
+	u16 complement = h[0x1C] | (h[0x1D] << 8);
+	u16 checksum = h[0x1E] | (h[0x1F] << 8);
+	u16 reset = h[0x3C] | (h[0x3D] << 8);
+	s32 score = 0, i;
+
+	if ((u16) (checksum + complement) == 0xFFFF && checksum != 0)
+		score += 4;
+	if ((h[0x15] & 0xE0) == 0x20)
+		score += 2;
+	if ((h[0x15] & 0x01) == hirom)
+		score += 1;
+	if (reset >= 0x8000)
+		score += 2;
+	else
+		score -= 4;
+	for (i = 0; i < ROM_INFO_TITLE_LEN; i++)
+		if (h[i] < 0x20 || (h[i] > 0x7E && h[i] < 0xA0))
+			score--;
+	return score;
+}
+
+static void ParseHeader(u32 got, u32 total, struct ROM_INFO *info)
+{
+	u32 offset = (total & 0x1FFF) == 0x200 ? 0x200 : 0;
+	const u8 *lo = got >= offset + 0x8000 ? mHead + offset + 0x7FC0 : NULL;
+	const u8 *hi = got >= offset + 0x10000 ? mHead + offset + 0xFFC0 : NULL;
+	const u8 *h = lo;
+	s32 i;
+
+	if (hi && (!lo || ScoreHeader(hi, 1) > ScoreHeader(lo, 0)))
+		h = hi;
+	if (!h)
+		return;
+
+	info->map = h[0x15];
+	info->type = h[0x16];
+	info->region = h[0x19];
+	for (i = 0; i < ROM_INFO_TITLE_LEN; i++)
+		info->title[i] = h[i] >= 0x20 && h[i] <= 0x7E ? h[i] : ' ';
+	for (i = ROM_INFO_TITLE_LEN; i > 0 && info->title[i - 1] == ' '; i--);
+	info->title[i] = 0;
+}
+
+// The whole file goes through the CRC; an archive already holds its ROM's.
+static s32 ReadRom(const char *path, struct ROM_INFO *info)
+{
+	u32 got = 0, total = 0;
+
+	memset(info, 0, sizeof(*info));
+
+	if (sal_ArchiveCheck(path))
+	{
+		struct SAL_ARCHIVE_ENTRY entry;
+
+		if (sal_ArchiveInfo(path, &entry) != SAL_OK ||
+			sal_ArchiveRead(path, mHead, ROM_INFO_HEAD_SIZE, &got) != SAL_OK)
+			return SAL_ERROR;
+
+		total = entry.size;
+		info->crc = entry.crc;
+	}
+	else
+	{
+		FILE *stream = fopen(path, "rb");
+		u32 crc = crc32(0L, Z_NULL, 0);
+		size_t n;
+
+		if (!stream)
+			return SAL_ERROR;
+		while (!mInfoQuit && (n = fread(mChunk, 1, ROM_INFO_CHUNK, stream)) > 0)
+		{
+			crc = crc32(crc, mChunk, n);
+			if (got < ROM_INFO_HEAD_SIZE)
+			{
+				u32 copy = ROM_INFO_HEAD_SIZE - got < n ? ROM_INFO_HEAD_SIZE - got : n;
+				memcpy(mHead + got, mChunk, copy);
+				got += copy;
+			}
+			total += n;
+		}
+		fclose(stream);
+		// Stopped half way; the file is read again next time.
+		if (mInfoQuit)
+			return SAL_ERROR;
+		info->crc = crc;
+	}
+
+	ParseHeader(got, total, info);
+	return SAL_OK;
+}
+
+static int InfoThread(void *unused)
+{
+	s8 path[SAL_MAX_PATH];
+	struct ROM_INFO info;
+	struct ROM_INFO_ENTRY *entry;
+	struct stat st;
+
+	if (!mEntriesLoaded)
+	{
+		LoadEntries();
+		mEntriesLoaded = 1;
+	}
+
+	SDL_LockMutex(mInfoLock);
+	while (!mInfoQuit)
+	{
+		if (mQueueNext >= mQueueCount)
+		{
+			if (mEntriesChanged)
+			{
+				SDL_UnlockMutex(mInfoLock);
+				SaveEntries();
+				SDL_LockMutex(mInfoLock);
+				continue;
+			}
+			SDL_CondWait(mInfoWake, mInfoLock);
+			continue;
+		}
+		strcpy(path, mQueue[mQueueNext++]);
+		SDL_UnlockMutex(mInfoLock);
+
+		if (stat(path, &st) == 0)
+		{
+			entry = FindEntry(path);
+			if (!entry || entry->size != (u32) st.st_size || entry->mtime != (u32) st.st_mtime)
+			{
+				if (ReadRom(path, &info) == SAL_OK)
+					AddEntry(path, st.st_size, st.st_mtime, &info);
+			}
+		}
+
+		SDL_LockMutex(mInfoLock);
+	}
+	SDL_UnlockMutex(mInfoLock);
+
+	if (mEntriesChanged)
+		SaveEntries();
+	return 0;
+}
+
+static s32 InfoStart(void)
+{
+	if (mInfoThread)
+		return SAL_OK;
+
+	mInfoLock = SDL_CreateMutex();
+	mInfoWake = SDL_CreateCond();
+	mInfoQuit = 0;
+	if (mInfoLock && mInfoWake)
+		mInfoThread = SDL_CreateThread(InfoThread, NULL);
+	if (mInfoThread)
+		return SAL_OK;
+
+	if (mInfoWake) SDL_DestroyCond(mInfoWake);
+	if (mInfoLock) SDL_DestroyMutex(mInfoLock);
+	mInfoWake = NULL;
+	mInfoLock = NULL;
+	return SAL_ERROR;
+}
+
+/* Queues the ROM files of a directory listing, dropping whatever was still
+ * queued from the last one. */
+void RomInfoScan(const char *dir, const struct SAL_DIRECTORY_ENTRY *list, s32 count)
+{
+	s8 (*queue)[SAL_MAX_PATH];
+	s32 i, n = 0;
+
+	if (InfoStart() != SAL_OK)
+		return;
+
+	queue = (s8 (*)[SAL_MAX_PATH]) malloc(count * SAL_MAX_PATH + 1);
+	if (!queue)
+		return;
+	for (i = 0; i < count; i++)
+	{
+		if (list[i].type != SAL_FILE_TYPE_FILE ||
+			strlen(dir) + strlen(list[i].filename) + 2 > SAL_MAX_PATH)
+			continue;
+		strcpy(queue[n], dir);
+		sal_DirectoryCombine(queue[n], list[i].filename);
+		n++;
+	}
+
+	SDL_LockMutex(mInfoLock);
+	free(mQueue);
+	mQueue = queue;
+	mQueueCount = n;
+	mQueueNext = 0;
+	SDL_CondSignal(mInfoWake);
+	SDL_UnlockMutex(mInfoLock);
+}
+
+/* Stops the worker, so it takes nothing from the game; it saves what it
+ * has found, and the next scan carries on where it left off. */
+void RomInfoStop(void)
+{
+	if (!mInfoThread)
+		return;
+
+	SDL_LockMutex(mInfoLock);
+	mInfoQuit = 1;
+	SDL_CondSignal(mInfoWake);
+	SDL_UnlockMutex(mInfoLock);
+	SDL_WaitThread(mInfoThread, NULL);
+	mInfoThread = NULL;
+
+	SDL_DestroyCond(mInfoWake);
+	SDL_DestroyMutex(mInfoLock);
+	mInfoWake = NULL;
+	mInfoLock = NULL;
+
+	free(mQueue);
+	mQueue = NULL;
+	mQueueCount = mQueueNext = 0;
+}
+
+s32 RomInfoGet(const char *path, struct ROM_INFO *info)
+{
+	struct ROM_INFO_ENTRY *entry;
+
+	if (!mInfoThread)
+		return SAL_ERROR;
+
+	SDL_LockMutex(mInfoLock);
+	entry = FindEntry(path);
+	if (entry)
+		*info = entry->info;
+	SDL_UnlockMutex(mInfoLock);
+	return entry ? SAL_OK : SAL_ERROR;
+}
+
+const char *RomInfoMapName(const struct ROM_INFO *info)
+{
+	switch (info->map & 0x0F)
+	{
+		case 0:
+		case 2:
+			return "LoROM";
+		case 1:
+			return "HiROM";
+		case 3:
+			return "SA-1 ROM";
+		case 5:
+			return "ExHiROM";
+	}
+	return "Unknown";
+}
+
+// After CMemory::KartContents.
+const char *RomInfoChipName(const struct ROM_INFO *info)
+{
+	static const char *CoPro[16] = {
+		"DSP", "SuperFX", "OBC1", "SA-1", "S-DD1", "S-RTC", "CoPro#6",
+		"CoPro#7", "CoPro#8", "CoPro#9", "CoPro#10", "CoPro#11", "CoPro#12",
+		"CoPro#13", "Super Game Boy", "CoPro-Custom"
+	};
+
+	if ((info->type & 0x0F) < 3)
+		return "";
+	return CoPro[info->type >> 4];
+}
+
+const char *RomInfoRegionName(const struct ROM_INFO *info)
+{
+	static const char *Regions[14] = {
+		"Japan", "USA", "Europe", "Sweden", "Finland", "Denmark", "France",
+		"Holland", "Spain", "Germany", "Italy", "China", "Indonesia", "Korea"
+	};
+
+	if (info->region >= 14)
+		return "";
+	return Regions[info->region];
+}
@@ -0,0 +1,28 @@
+#ifndef _ROMINFO_H_
+#define _ROMINFO_H_
+
+#include "sal.h"
+
+#define ROM_INFO_FILENAME		"rominfo.dat"
+#define ROM_INFO_TITLE_LEN		21
+
+// What the cartridge header says about a ROM, read by a background thread
+// while the ROM browser is open.
+struct ROM_INFO
+{
+	u32 crc;		// CRC32 of the image as stored, copier header included
+	u8 map;			// header map mode byte
+	u8 type;		// header cartridge type byte: ROM, RAM, coprocessor
+	u8 region;		// header destination code
+	s8 title[ROM_INFO_TITLE_LEN + 1];
+};
+
+void RomInfoScan(const char *dir, const struct SAL_DIRECTORY_ENTRY *list, s32 count);
+void RomInfoStop(void);
+s32 RomInfoGet(const char *path, struct ROM_INFO *info);
+
+const char *RomInfoMapName(const struct ROM_INFO *info);
+const char *RomInfoChipName(const struct ROM_INFO *info);
+const char *RomInfoRegionName(const struct ROM_INFO *info);
+
+#endif /* _ROMINFO_H_ */
@@ -39,6 +39,13 @@ struct SAL_DIRECTORY_ENTRY
 	s32 type;
 };
 
+struct SAL_ARCHIVE_ENTRY
+{
+	s8 name[SAL_MAX_PATH];
+	u32 size;
+	u32 crc;
+};
+
 struct SAL_DIR
 {
 	DIR *dir;
@@ -118,12 +125,25 @@ s32 sal_ZipGetFirstCrc(const char *filename, s32 *crc);
 void sal_ZipGetFirstFilename(const char *filename, s8 *longfilename);
 s32 sal_ZipCheck(const char *filename);
 
+s32 sal_ArchiveCheck(const char *filename);
+s32 sal_ArchiveInfo(const char *filename, struct SAL_ARCHIVE_ENTRY *entry);
+s32 sal_ArchiveRead(const char *filename, u8 *buffer, u32 size, u32 *got);
+
 s32 sal_FileLoad(const char *filename, u8 *buffer, u32 maxsize, u32 *filesize);
 s32 sal_FileSave(const char *filename, u8 *buffer, u32 bufferSize);
 s32 sal_FileDelete(const char *filename);
 s32 sal_FileExists(const char *filename);
 s32 sal_FileGetSize(const char *filename, u32 *filesize);
 u32 sal_FileGetCRC(u8 *data, u32 size);
+/* Write to a temporary file and rename it over filename. The async form
+ * copies buffer and hands the write to a background thread; Wait returns
+ * the outcome of the last write of that file. */
+s32 sal_FileSaveAtomic(const char *filename, const u8 *buffer, u32 size);
+s32 sal_FileSaveAsync(const char *filename, const u8 *buffer, u32 size);
+u32 sal_FileSavePending(const char *filename);
+s32 sal_FileSaveWait(const char *filename);
+void sal_FileSaveFlush(void);
+void sal_FileSaveClose(void);
 
 const char * sal_DirectoryGetHome(void);
 const char * sal_DirectoryGetUser(void);
@@ -133,6 +153,7 @@ void sal_DirectoryGetParent(s8 *path);
 s32 sal_DirectoryGetCurrent(s8 *path, u32 size);
 void sal_DirectoryCombine(s8 *path, const char *name);
 s32 sal_DirectoryGetItemCount(const char *path, s32 *returnItemCount);
+s32 sal_DirectoryGetModified(const char *path, u32 *mtime);
 // s32 sal_DirectoryGet(const char *path, struct SAL_DIRECTORY_ENTRY *dir, s32 startIndex, s32 count);
 s32 sal_DirectoryCreate(const char *path);
 s32 sal_DirectoryOpen(const char *path, struct SAL_DIR *d);
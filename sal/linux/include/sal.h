@@ -60,6 +60,7 @@ extern "C" {
 #define SAL_INPUT_MENU		(1<<SAL_INPUT_INDEX_MENU)
 #define SAL_INPUT_QUICKLOAD		(1<<SAL_INPUT_INDEX_MENU+1)
 #define SAL_INPUT_QUICKSAVE		(1<<SAL_INPUT_INDEX_MENU+2)
+#define SAL_INPUT_REWIND		(1<<SAL_INPUT_INDEX_MENU+3)
 
 #define SAL_SCREEN_WIDTH			320
 #define SAL_SCREEN_HEIGHT			240
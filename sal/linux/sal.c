@@ -54,6 +54,7 @@ static u32 sal_Input(int held, u32 j)
 		if (SDL_JoystickGetButton(joy[j], 8) && SDL_JoystickGetButton(joy[j], 9)) inputHeld[j] |= SAL_INPUT_MENU;
 		if (SDL_JoystickGetButton(joy[j], 8) && SDL_JoystickGetButton(joy[j], 4)) inputHeld[j] |= SAL_INPUT_QUICKLOAD;
 		if (SDL_JoystickGetButton(joy[j], 8) && SDL_JoystickGetButton(joy[j], 5)) inputHeld[j] |= SAL_INPUT_QUICKSAVE;
+		if (SDL_JoystickGetButton(joy[j], 8) && SDL_JoystickGetButton(joy[j], 3)) inputHeld[j] |= SAL_INPUT_REWIND;
 	}
 
 	if (j == 0) {
@@ -76,6 +77,7 @@ static u32 sal_Input(int held, u32 j)
 		if (keys[SDLK_END] || keys[SDLK_HOME] || (keys[SDLK_ESCAPE] && keys[SDLK_RETURN])) inputHeld[j] |= SAL_INPUT_MENU;
 		if (keys[SDLK_ESCAPE] && keys[SDLK_TAB]) inputHeld[j] |= SAL_INPUT_QUICKLOAD;
 		if (keys[SDLK_ESCAPE] && keys[SDLK_BACKSPACE]) inputHeld[j] |= SAL_INPUT_QUICKSAVE;
+		if (keys[SDLK_ESCAPE] && keys[SDLK_LSHIFT]) inputHeld[j] |= SAL_INPUT_REWIND;
 
 		SDL_Event event;
 		if (!SDL_PollEvent(&event)) {
@@ -283,6 +285,7 @@ void sal_VideoPaletteSet(u32 index, u32 color)
 
 void sal_Reset(void)
 {
+	sal_FileSaveClose();
 	for(int j = 0; j < SDL_NumJoysticks(); j++)
 		SDL_JoystickClose(joy[j]);
 	sal_AudioClose();
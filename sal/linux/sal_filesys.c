@@ -41,6 +41,17 @@ s32 sal_DirectoryGetItemCount(const char *path, s32 *returnItemCount)
 	return SAL_OK;
 }
 
+s32 sal_DirectoryGetModified(const char *path, u32 *mtime)
+{
+	struct stat s;
+
+	if (stat(path, &s) != 0)
+		return SAL_ERROR;
+
+	*mtime=s.st_mtime;
+	return SAL_OK;
+}
+
 s32 sal_DirectoryOpen(const char *path, struct SAL_DIR *d)
 {
 	d->dir=opendir(path);
@@ -83,9 +94,23 @@ s32 sal_DirectoryRead(struct SAL_DIR *d, struct SAL_DIRECTORY_ENTRY *dir, s8 *ba
 			de=readdir(d->dir);
 			if(de)
 			{
-				sprintf(path, "%s/%s", base_dir, de->d_name);
 				strcpy(dir->filename,de->d_name);
 				strcpy(dir->displayName,de->d_name);
+#ifdef _DIRENT_HAVE_D_TYPE
+				// Most file systems give the type away for free;
+				// only links and the rest need a stat.
+				if (de->d_type == DT_DIR)
+				{
+					dir->type=SAL_FILE_TYPE_DIRECTORY;
+					return SAL_OK;
+				}
+				if (de->d_type == DT_REG)
+				{
+					dir->type=SAL_FILE_TYPE_FILE;
+					return SAL_OK;
+				}
+#endif
+				sprintf(path, "%s/%s", base_dir, de->d_name);
 				if (stat(path, &s) != 0) return SAL_ERROR;
 				if (s.st_mode & S_IFDIR)
 				  dir->type=SAL_FILE_TYPE_DIRECTORY;
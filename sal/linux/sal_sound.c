@@ -14,6 +14,10 @@ volatile static unsigned int ReadPos, WritePos;
 // 2 channels per sample (stereo); 2 bytes per sample-channel (16-bit)
 static uint8_t Buffer[BUFFER_SAMPLES * 2 * 2];
 static u32 SamplesPerFrame, BytesPerSample;
+// What does not fit in Buffer is still mixed, into here, and thrown away:
+// mixing is what clocks the DSP, and it has to keep up with the emulated
+// time however far behind the output is.
+static uint8_t DropBuffer[48000 / 50 * 2 * 2];
 static u32 Muted; // S9xSetAudioMute(TRUE) gets undone after SNES Global Mute ends
 
 static void sdl_audio_callback (void *userdata, Uint8 *stream, int len)
@@ -96,9 +100,21 @@ void sal_AudioClose(void)
 	SDL_CloseAudio();
 }
 
+static void AudioDrop(u32 samples)
+{
+	u32 max = sizeof(DropBuffer) / BytesPerSample, count;
+	while (samples)
+	{
+		count = samples > max ? max : samples;
+		S9xMixSamples(DropBuffer, count * audiospec.channels);
+		samples -= count;
+	}
+}
+
 void sal_AudioGenerate(u32 samples)
 {
-	u32 SamplesAvailable,
+	u32 SamplesDropped = 0,
+	    SamplesAvailable,
 	    LocalReadPos = ReadPos /* isolate a bit against races with the audio thread */,
 	    LocalWritePos = WritePos /* keep a non-volatile copy at hand */;
 	if (LocalReadPos <= LocalWritePos)
@@ -107,6 +123,7 @@ void sal_AudioGenerate(u32 samples)
 		SamplesAvailable = LocalReadPos - LocalWritePos;
 	if (samples >= SamplesAvailable)
 	{
+		SamplesDropped = samples - (SamplesAvailable - 1);
 		samples = SamplesAvailable - 1;
 	}
 	if (samples > BUFFER_SAMPLES - LocalWritePos)
@@ -119,6 +136,8 @@ void sal_AudioGenerate(u32 samples)
 		S9xMixSamples(&Buffer[LocalWritePos * BytesPerSample], samples * audiospec.channels);
 		WritePos = (LocalWritePos + samples) % BUFFER_SAMPLES;
 	}
+	if (SamplesDropped)
+		AudioDrop(SamplesDropped);
 }
 
 u32 sal_AudioGetFramesBuffered()
@@ -0,0 +1,312 @@
+/* Background file writer.
+ *
+ * sal_FileSaveAsync copies the data into a small queue and returns at once;
+ * a worker thread does the writing, so a slow SD card never stalls the
+ * emulation. A file queued again before the worker got to it is simply
+ * replaced. Every file goes to a temporary name first, is synced, and is
+ * then renamed over the old one: an interrupted save leaves either the old
+ * file or the new one, never a truncated one.
+ *
+ * The outcome of the last write of each file is kept, so a caller can ask
+ * about its own file without seeing, or swallowing, another one's failure.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "sal.h"
+
+#define SAL_WRITER_SLOTS	4
+#define SAL_WRITER_RESULTS	8
+
+struct SAL_WRITE
+{
+	s8 filename[SAL_MAX_PATH];
+	u8 *data;
+	u32 size;
+	u32 capacity;
+	s32 queued;
+};
+
+struct SAL_WRITE_RESULT
+{
+	s8 filename[SAL_MAX_PATH];
+	s32 result;
+};
+
+static struct SAL_WRITE mWrites[SAL_WRITER_SLOTS];
+static struct SAL_WRITE_RESULT mResults[SAL_WRITER_RESULTS];
+static u32 mResultNext = 0;
+static s8 mWriterFile[SAL_MAX_PATH];
+static SDL_Thread *mWriterThread = NULL;
+static SDL_mutex *mWriterLock = NULL;
+static SDL_cond *mWriterWake = NULL;
+static SDL_cond *mWriterProgress = NULL;
+static s32 mWriterBusy = 0;
+static s32 mWriterQuit = 0;
+
+s32 sal_FileSaveAtomic(const char *filename, const u8 *buffer, u32 size)
+{
+	s8 temp[SAL_MAX_PATH + 8];
+	FILE *stream;
+	s32 ok;
+
+	snprintf(temp, sizeof(temp), "%s.tmp", filename);
+	stream = fopen(temp, "wb");
+	if (!stream)
+		return SAL_ERROR;
+
+	ok = fwrite(buffer, 1, size, stream) == size;
+	ok = fflush(stream) == 0 && ok;
+	ok = fsync(fileno(stream)) == 0 && ok;
+	ok = fclose(stream) == 0 && ok;
+
+	if (ok && rename(temp, filename) == 0)
+		return SAL_OK;
+
+	remove(temp);
+	return SAL_ERROR;
+}
+
+static s32 WriterQueued(void)
+{
+	s32 i;
+
+	for (i = 0; i < SAL_WRITER_SLOTS; i++)
+		if (mWrites[i].queued)
+			return i;
+	return -1;
+}
+
+// The last write of filename is queued or being written.
+static s32 WriterPending(const char *filename)
+{
+	s32 i;
+
+	if (mWriterBusy && strcmp(mWriterFile, filename) == 0)
+		return 1;
+	for (i = 0; i < SAL_WRITER_SLOTS; i++)
+		if (mWrites[i].queued && strcmp(mWrites[i].filename, filename) == 0)
+			return 1;
+	return 0;
+}
+
+// Keeps the outcome of a write; the file's old entry is reused, or else
+// the oldest one.
+static void WriterResult(const char *filename, s32 result)
+{
+	struct SAL_WRITE_RESULT *entry = NULL;
+	s32 i;
+
+	for (i = 0; i < SAL_WRITER_RESULTS && !entry; i++)
+		if (strcmp(mResults[i].filename, filename) == 0)
+			entry = &mResults[i];
+	if (!entry)
+	{
+		entry = &mResults[mResultNext];
+		mResultNext = (mResultNext + 1) % SAL_WRITER_RESULTS;
+		strcpy(entry->filename, filename);
+	}
+	entry->result = result;
+}
+
+static int WriterThread(void *unused)
+{
+	s8 filename[SAL_MAX_PATH];
+	u8 *data;
+	u32 size, capacity;
+	s32 i, result;
+
+	SDL_LockMutex(mWriterLock);
+	for (;;)
+	{
+		i = WriterQueued();
+		if (i < 0)
+		{
+			if (mWriterQuit)
+				break;
+			SDL_CondBroadcast(mWriterProgress);
+			SDL_CondWait(mWriterWake, mWriterLock);
+			continue;
+		}
+
+		// Take the buffer out of the slot, so the file can be queued
+		// again while this copy is being written.
+		strcpy(filename, mWrites[i].filename);
+		data = mWrites[i].data;
+		size = mWrites[i].size;
+		capacity = mWrites[i].capacity;
+		mWrites[i].data = NULL;
+		mWrites[i].capacity = 0;
+		mWrites[i].queued = 0;
+		strcpy(mWriterFile, filename);
+		mWriterBusy = 1;
+		SDL_CondBroadcast(mWriterProgress);
+		SDL_UnlockMutex(mWriterLock);
+
+		result = sal_FileSaveAtomic(filename, data, size);
+
+		SDL_LockMutex(mWriterLock);
+		WriterResult(filename, result);
+		if (!mWrites[i].data)
+		{
+			mWrites[i].data = data;
+			mWrites[i].capacity = capacity;
+		}
+		else
+			free(data);
+		mWriterBusy = 0;
+	}
+	SDL_UnlockMutex(mWriterLock);
+	return 0;
+}
+
+static s32 WriterStart(void)
+{
+	if (mWriterThread)
+		return SAL_OK;
+
+	mWriterLock = SDL_CreateMutex();
+	mWriterWake = SDL_CreateCond();
+	mWriterProgress = SDL_CreateCond();
+	mWriterQuit = 0;
+	if (mWriterLock && mWriterWake && mWriterProgress)
+		mWriterThread = SDL_CreateThread(WriterThread, NULL);
+	if (mWriterThread)
+		return SAL_OK;
+
+	if (mWriterProgress) SDL_DestroyCond(mWriterProgress);
+	if (mWriterWake) SDL_DestroyCond(mWriterWake);
+	if (mWriterLock) SDL_DestroyMutex(mWriterLock);
+	mWriterProgress = mWriterWake = NULL;
+	mWriterLock = NULL;
+	return SAL_ERROR;
+}
+
+s32 sal_FileSaveAsync(const char *filename, const u8 *buffer, u32 size)
+{
+	struct SAL_WRITE *slot = NULL;
+	s32 i;
+
+	// Without a worker the caller still gets a safe, if blocking, save.
+	if (WriterStart() != SAL_OK)
+	{
+		s32 result = sal_FileSaveAtomic(filename, buffer, size);
+		WriterResult(filename, result);
+		return result;
+	}
+
+	SDL_LockMutex(mWriterLock);
+	for (;;)
+	{
+		for (i = 0; i < SAL_WRITER_SLOTS && !slot; i++)
+			if (mWrites[i].queued && strcmp(mWrites[i].filename, filename) == 0)
+				slot = &mWrites[i];
+		for (i = 0; i < SAL_WRITER_SLOTS && !slot; i++)
+			if (!mWrites[i].queued)
+				slot = &mWrites[i];
+		if (slot)
+			break;
+		// Every slot holds a different file; wait for the worker to
+		// take one.
+		SDL_CondWait(mWriterProgress, mWriterLock);
+	}
+
+	if (slot->capacity < size)
+	{
+		u8 *data = (u8 *) realloc(slot->data, size);
+		if (!data)
+		{
+			SDL_UnlockMutex(mWriterLock);
+			return SAL_ERROR;
+		}
+		slot->data = data;
+		slot->capacity = size;
+	}
+	strncpy(slot->filename, filename, SAL_MAX_PATH - 1);
+	slot->filename[SAL_MAX_PATH - 1] = 0;
+	memcpy(slot->data, buffer, size);
+	slot->size = size;
+	slot->queued = 1;
+	SDL_CondSignal(mWriterWake);
+	SDL_UnlockMutex(mWriterLock);
+	return SAL_OK;
+}
+
+/* Whether a write of filename, or of any file if it is NULL, is still to
+ * reach the card. */
+u32 sal_FileSavePending(const char *filename)
+{
+	u32 pending;
+
+	if (!mWriterThread)
+		return 0;
+	SDL_LockMutex(mWriterLock);
+	if (filename)
+		pending = WriterPending(filename);
+	else
+		pending = WriterQueued() >= 0 || mWriterBusy;
+	SDL_UnlockMutex(mWriterLock);
+	return pending;
+}
+
+/* Waits for the last write of filename and returns how it went. A file
+ * this writer has no record of has nothing outstanding: SAL_OK. */
+s32 sal_FileSaveWait(const char *filename)
+{
+	s32 i, result = SAL_OK;
+
+	if (mWriterThread)
+	{
+		SDL_LockMutex(mWriterLock);
+		while (WriterPending(filename))
+			SDL_CondWait(mWriterProgress, mWriterLock);
+	}
+	for (i = 0; i < SAL_WRITER_RESULTS; i++)
+		if (strcmp(mResults[i].filename, filename) == 0)
+			result = mResults[i].result;
+	if (mWriterThread)
+		SDL_UnlockMutex(mWriterLock);
+	return result;
+}
+
+/* Waits for every queued write. */
+void sal_FileSaveFlush(void)
+{
+	if (!mWriterThread)
+		return;
+
+	SDL_LockMutex(mWriterLock);
+	while (WriterQueued() >= 0 || mWriterBusy)
+		SDL_CondWait(mWriterProgress, mWriterLock);
+	SDL_UnlockMutex(mWriterLock);
+}
+
+void sal_FileSaveClose(void)
+{
+	s32 i;
+
+	if (!mWriterThread)
+		return;
+
+	sal_FileSaveFlush();
+	SDL_LockMutex(mWriterLock);
+	mWriterQuit = 1;
+	SDL_CondSignal(mWriterWake);
+	SDL_UnlockMutex(mWriterLock);
+	SDL_WaitThread(mWriterThread, NULL);
+	mWriterThread = NULL;
+
+	SDL_DestroyCond(mWriterProgress);
+	SDL_DestroyCond(mWriterWake);
+	SDL_DestroyMutex(mWriterLock);
+	mWriterProgress = mWriterWake = NULL;
+	mWriterLock = NULL;
+
+	for (i = 0; i < SAL_WRITER_SLOTS; i++)
+	{
+		free(mWrites[i].data);
+		memset(&mWrites[i], 0, sizeof(mWrites[i]));
+	}
+	memset(mResults, 0, sizeof(mResults));
+	mResultNext = 0;
+}
@@ -0,0 +1,148 @@
+/* Archive readers.
+ *
+ * Each archive format the ROM browser knows is an entry in mFormats: how
+ * to describe the ROM an archive holds and how to read it. The description,
+ * its name, size and CRC32, comes from the archive's own directory, a zip's
+ * central directory or a gzip trailer, so listing archives never inflates
+ * them. A new format only needs its two functions and a line in the table.
+ */
+#include <zlib.h>
+#include <unzip.h>
+#include "sal.h"
+
+struct SAL_ARCHIVE_FORMAT
+{
+	const char *ext;
+	s32 (*info)(const char *filename, struct SAL_ARCHIVE_ENTRY *entry);
+	s32 (*read)(const char *filename, u8 *buffer, u32 size, u32 *got);
+};
+
+static s32 ZipInfo(const char *filename, struct SAL_ARCHIVE_ENTRY *entry)
+{
+	unz_file_info info;
+	unzFile fd;
+	s32 ret;
+
+	fd = unzOpen(filename);
+	if (!fd)
+		return SAL_ERROR;
+
+	ret = unzGoToFirstFile(fd) == UNZ_OK &&
+		unzGetCurrentFileInfo(fd, &info, entry->name, SAL_MAX_PATH, NULL, 0, NULL, 0) == UNZ_OK;
+	unzClose(fd);
+	if (!ret)
+		return SAL_ERROR;
+
+	entry->size = info.uncompressed_size;
+	entry->crc = info.crc;
+	return SAL_OK;
+}
+
+static s32 ZipRead(const char *filename, u8 *buffer, u32 size, u32 *got)
+{
+	unzFile fd;
+	s32 n = -1;
+
+	fd = unzOpen(filename);
+	if (!fd)
+		return SAL_ERROR;
+
+	if (unzGoToFirstFile(fd) == UNZ_OK && unzOpenCurrentFile(fd) == UNZ_OK)
+	{
+		n = unzReadCurrentFile(fd, buffer, size);
+		unzCloseCurrentFile(fd);
+	}
+	unzClose(fd);
+	if (n < 0)
+		return SAL_ERROR;
+
+	*got = n;
+	return SAL_OK;
+}
+
+// A gzip file ends with the CRC32 and size of what it holds, and the name
+// of that is the archive's without ".gz".
+static s32 GzipInfo(const char *filename, struct SAL_ARCHIVE_ENTRY *entry)
+{
+	s8 path[SAL_MAX_PATH], ext[SAL_MAX_PATH];
+	u8 trailer[8];
+	FILE *stream;
+
+	stream = fopen(filename, "rb");
+	if (!stream)
+		return SAL_ERROR;
+	if (fseek(stream, -8, SEEK_END) != 0 || fread(trailer, 1, 8, stream) != 8)
+	{
+		fclose(stream);
+		return SAL_ERROR;
+	}
+	fclose(stream);
+
+	entry->crc = trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | (trailer[3] << 24);
+	entry->size = trailer[4] | (trailer[5] << 8) | (trailer[6] << 16) | (trailer[7] << 24);
+	sal_DirectorySplitFilename(filename, path, entry->name, ext);
+	return SAL_OK;
+}
+
+static s32 GzipRead(const char *filename, u8 *buffer, u32 size, u32 *got)
+{
+	gzFile gz;
+	s32 n;
+
+	gz = gzopen(filename, "rb");
+	if (!gz)
+		return SAL_ERROR;
+	n = gzread(gz, buffer, size);
+	gzclose(gz);
+	if (n < 0)
+		return SAL_ERROR;
+
+	*got = n;
+	return SAL_OK;
+}
+
+static const struct SAL_ARCHIVE_FORMAT mFormats[] =
+{
+	{ "zip", ZipInfo, ZipRead },
+	{ "gz", GzipInfo, GzipRead },
+};
+
+static const struct SAL_ARCHIVE_FORMAT *FindFormat(const char *filename)
+{
+	s8 path[SAL_MAX_PATH], name[SAL_MAX_PATH], ext[SAL_MAX_PATH];
+	u32 i;
+
+	sal_DirectorySplitFilename(filename, path, name, ext);
+	for (i = 0; i < sizeof(mFormats) / sizeof(mFormats[0]); i++)
+		if (sal_StringCompare(ext, mFormats[i].ext) == 0)
+			return &mFormats[i];
+	return NULL;
+}
+
+/* SAL_TRUE if the file's extension is that of a known archive format. */
+s32 sal_ArchiveCheck(const char *filename)
+{
+	return FindFormat(filename) ? SAL_TRUE : SAL_FALSE;
+}
+
+/* Name, size and CRC32 of the ROM in an archive, without inflating it. */
+s32 sal_ArchiveInfo(const char *filename, struct SAL_ARCHIVE_ENTRY *entry)
+{
+	const struct SAL_ARCHIVE_FORMAT *format = FindFormat(filename);
+
+	if (!format)
+		return SAL_ERROR;
+	memset(entry, 0, sizeof(*entry));
+	return format->info(filename, entry);
+}
+
+/* Inflates no more than the first size bytes of the ROM in an archive. */
+s32 sal_ArchiveRead(const char *filename, u8 *buffer, u32 size, u32 *got)
+{
+	const struct SAL_ARCHIVE_FORMAT *format = FindFormat(filename);
+
+	*got = 0;
+	if (!format)
+		return SAL_ERROR;
+	return format->read(filename, buffer, size, got);
+}
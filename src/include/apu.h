@@ -147,6 +147,55 @@ STATIC inline void S9xAPUPackStatus()
 		      (IAPU._Zero & 0x80) | (IAPU._Overflow << 6);
 }
 
+// Called once per scanline. The SPC700 timers need updating at multiples
+// of 8KHz while a scanline is ~15.7KHz, so timer 2 (64KHz) steps by 4
+// every line and timers 0 and 1 (8KHz) step on every other line.
+STATIC inline void S9xAPUTimerTick (bool8 odd_line)
+{
+    if (APU.TimerEnabled [2])
+    {
+		APU.Timer [2] += 4;
+		while (APU.Timer [2] >= APU.TimerTarget [2])
+		{
+			IAPU.RAM [0xff] = (IAPU.RAM [0xff] + 1) & 0xf;
+			APU.Timer [2] -= APU.TimerTarget [2];
+#ifdef SPC700_SHUTDOWN
+			IAPU.WaitCounter++;
+			IAPU.APUExecuting = TRUE;
+#endif
+		}
+    }
+    if (odd_line)
+    {
+		if (APU.TimerEnabled [0])
+		{
+			APU.Timer [0]++;
+			if (APU.Timer [0] >= APU.TimerTarget [0])
+			{
+				IAPU.RAM [0xfd] = (IAPU.RAM [0xfd] + 1) & 0xf;
+				APU.Timer [0] = 0;
+#ifdef SPC700_SHUTDOWN
+				IAPU.WaitCounter++;
+				IAPU.APUExecuting = TRUE;
+#endif
+			}
+		}
+		if (APU.TimerEnabled [1])
+		{
+			APU.Timer [1]++;
+			if (APU.Timer [1] >= APU.TimerTarget [1])
+			{
+				IAPU.RAM [0xfe] = (IAPU.RAM [0xfe] + 1) & 0xf;
+				APU.Timer [1] = 0;
+#ifdef SPC700_SHUTDOWN
+				IAPU.WaitCounter++;
+				IAPU.APUExecuting = TRUE;
+#endif
+			}
+		}
+    }
+}
+
 START_EXTERN_C
 void S9xResetAPU (void);
 bool8 S9xInitAPU ();
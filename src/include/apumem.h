@@ -234,6 +234,7 @@ if (Address == 0x26c6)
     printf ("TRACING SWITCHED ON\n");
 }
 #endif
+	DIRTY_MARK (APURAM, Address);
 	if (Address < 0xffc0)
 	    IAPU.RAM [Address] = byte;
 	else
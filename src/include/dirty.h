@@ -0,0 +1,69 @@
+/*
+ * Dirty page tracking.
+ *
+ * Every write path into work RAM, VRAM, cartridge SRAM and APU RAM stores
+ * DIRTY_ALL into the flags byte of the page it touched. Each consumer owns
+ * one bit of those flags and clears only its own bit when it takes a
+ * checkpoint, so several of them can ask independently which pages changed
+ * since they last looked.
+ *
+ * APU page 0 holds the direct pages, the stack and the I/O ports, which
+ * the SPC700 cores write without going through a handler; it never reads
+ * as clean. The same goes for SRAM, and for work RAM with the SA-1, when
+ * a coprocessor that writes them behind the CPU's back is present.
+ */
+#ifndef _DIRTY_H_
+#define _DIRTY_H_
+
+#include "port.h"
+
+#define DIRTY_PAGE_SHIFT 10
+#define DIRTY_PAGE_SIZE (1 << DIRTY_PAGE_SHIFT)
+
+enum
+{
+    DIRTY_RAM,
+    DIRTY_VRAM,
+    DIRTY_SRAM,
+    DIRTY_APURAM,
+    DIRTY_REGIONS
+};
+
+#define DIRTY_RAM_BASE		0
+#define DIRTY_VRAM_BASE		(DIRTY_RAM_BASE + (0x20000 >> DIRTY_PAGE_SHIFT))
+#define DIRTY_SRAM_BASE		(DIRTY_VRAM_BASE + (0x10000 >> DIRTY_PAGE_SHIFT))
+#define DIRTY_APURAM_BASE	(DIRTY_SRAM_BASE + (0x20000 >> DIRTY_PAGE_SHIFT))
+#define DIRTY_PAGES		(DIRTY_APURAM_BASE + (0x10000 >> DIRTY_PAGE_SHIFT))
+
+// Consumer bits
+#define DIRTY_REWIND	0x01
+#define DIRTY_SRAM_SAVE	0x02
+#define DIRTY_ALL	0xff
+
+struct SDirty
+{
+    uint8 Pages [DIRTY_PAGES];
+    uint8 Untracked;		// (1 << region) for regions that never read clean
+};
+
+EXTERN_C struct SDirty Dirty;
+
+// offset must already be within the region.
+#ifdef DIRTY_TRACKING
+#define DIRTY_MARK(region, offset) \
+    (Dirty.Pages [DIRTY_##region##_BASE + ((offset) >> DIRTY_PAGE_SHIFT)] = DIRTY_ALL)
+#else
+#define DIRTY_MARK(region, offset) ((void) 0)
+#endif
+
+START_EXTERN_C
+void S9xDirtyReset ();
+void S9xDirtyMarkAll ();
+void S9xDirtyMarkRange (int region, uint32 offset, uint32 len);
+void S9xDirtyClear (uint8 client);
+bool8 S9xDirtyTest (int region, uint32 page, uint8 client);
+uint32 S9xDirtyCount (int region, uint8 client);
+uint32 S9xDirtyRegionPages (int region);
+END_EXTERN_C
+
+#endif
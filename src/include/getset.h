@@ -97,24 +97,46 @@
 #include "spc7110.h"
 #include "obc1.h"
 #include "seta.h"
+#include "dirty.h"
 
 extern "C"
 {
 	extern uint8 OpenBus;
 }
 
+// Marks the page behind a pointer taken from Memory.WriteMap; only work
+// RAM and SRAM are ever mapped for writing.
+static inline void S9xDirtyMarkPtr (const uint8 *p, int len)
+{
+#ifdef DIRTY_TRACKING
+    uint32 offset;
+
+    if ((offset = (uint32) ((intptr_t) p - (intptr_t) Memory.RAM)) < 0x20000)
+    {
+	DIRTY_MARK (RAM, offset);
+	DIRTY_MARK (RAM, offset + len - 1);
+    }
+    else
+    if ((offset = (uint32) ((intptr_t) p - (intptr_t) Memory.SRAM)) < 0x20000)
+    {
+	DIRTY_MARK (SRAM, offset);
+	DIRTY_MARK (SRAM, offset + len - 1);
+    }
+#endif
+}
+
 static uint8 S9xGetByte (uint32 Address)
 {
-    int block;
-    uint8 *GetAddress = Memory.Map [block = (Address >> MEMMAP_SHIFT) & MEMMAP_MASK];
+    SMapBlock *block = &Memory.HotMap [(Address >> MEMMAP_SHIFT) & MEMMAP_MASK];
+    uint8 *GetAddress = block->Map;
 
 	if(!CPU.InDMA)
-		CPU.Cycles += Memory.MemorySpeed [block];
+		CPU.Cycles += block->Speed;
 
     if (GetAddress >= (uint8 *) CMemory::MAP_LAST)
     {
 #ifdef CPU_SHUTDOWN
-		if (Memory.BlockIsRAM [block])
+		if (block->IsRAM)
 			CPU.WaitAddress = CPU.PCAtOpcodeStart;
 #endif
 		return (*(GetAddress + (Address & 0xffff)));
@@ -203,17 +225,17 @@ static uint16 S9xGetWord (uint32 Address)
 		OpenBus = S9xGetByte (Address);
 		return (OpenBus | (S9xGetByte (Address + 1) << 8));
     }
-    int block;
-    uint8 *GetAddress = Memory.Map [block = (Address >> MEMMAP_SHIFT) & MEMMAP_MASK];
+    SMapBlock *block = &Memory.HotMap [(Address >> MEMMAP_SHIFT) & MEMMAP_MASK];
+    uint8 *GetAddress = block->Map;
 
 	if(!CPU.InDMA)
-		CPU.Cycles += (Memory.MemorySpeed [block]<<1);
+		CPU.Cycles += (block->Speed<<1);
 
  
 	if (GetAddress >= (uint8 *) CMemory::MAP_LAST)
     {
 #ifdef CPU_SHUTDOWN
-		if (Memory.BlockIsRAM [block])
+		if (block->IsRAM)
 			CPU.WaitAddress = CPU.PCAtOpcodeStart;
 #endif
 #ifdef FAST_LSB_WORD_ACCESS
@@ -323,11 +345,11 @@ static void S9xSetByte (uint8 Byte, uint32 Address)
 #if defined(CPU_SHUTDOWN)
     CPU.WaitAddress = NULL;
 #endif
-    int block;
-    uint8 *SetAddress = Memory.WriteMap [block = ((Address >> MEMMAP_SHIFT) & MEMMAP_MASK)];
+    SMapBlock *block = &Memory.HotMap [(Address >> MEMMAP_SHIFT) & MEMMAP_MASK];
+    uint8 *SetAddress = block->WriteMap;
 
 	if (!CPU.InDMA)
-		CPU.Cycles += Memory.MemorySpeed [block];
+		CPU.Cycles += block->Speed;
 
 	
     if (SetAddress >= (uint8 *) CMemory::MAP_LAST)
@@ -342,8 +364,10 @@ static void S9xSetByte (uint8 Byte, uint32 Address)
 		}
 		*SetAddress = Byte;
 #else
-		*(SetAddress + (Address & 0xffff)) = Byte;
+		SetAddress += Address & 0xffff;
+		*SetAddress = Byte;
 #endif
+		S9xDirtyMarkPtr (SetAddress, 1);
 		return;
     }
 	
@@ -367,8 +391,10 @@ static void S9xSetByte (uint8 Byte, uint32 Address)
     case CMemory::MAP_LOROM_SRAM:
 		if (Memory.SRAMMask)
 		{
-			*(Memory.SRAM + ((((Address&0xFF0000)>>1)|(Address&0x7FFF))& Memory.SRAMMask))=Byte;
+			uint32 offset = (((Address&0xFF0000)>>1)|(Address&0x7FFF))& Memory.SRAMMask;
+			*(Memory.SRAM + offset)=Byte;
 //			*(Memory.SRAM + (Address & Memory.SRAMMask)) = Byte;
+			DIRTY_MARK (SRAM, offset);
 			CPU.SRAMModified = TRUE;
 		}
 		return;
@@ -376,14 +402,17 @@ static void S9xSetByte (uint8 Byte, uint32 Address)
     case CMemory::MAP_HIROM_SRAM:
 		if (Memory.SRAMMask)
 		{
-			*(Memory.SRAM + (((Address & 0x7fff) - 0x6000 +
-				((Address & 0xf0000) >> 3)) & Memory.SRAMMask)) = Byte;
+			uint32 offset = ((Address & 0x7fff) - 0x6000 +
+				((Address & 0xf0000) >> 3)) & Memory.SRAMMask;
+			*(Memory.SRAM + offset) = Byte;
+			DIRTY_MARK (SRAM, offset);
 			CPU.SRAMModified = TRUE;
 		}
 		return;
 		
     case CMemory::MAP_BWRAM:
 		*(Memory.BWRAM + ((Address & 0x7fff) - 0x6000)) = Byte;
+		S9xDirtyMarkPtr (Memory.BWRAM + ((Address & 0x7fff) - 0x6000), 1);
 		CPU.SRAMModified = TRUE;
 		return;
 		
@@ -394,6 +423,7 @@ static void S9xSetByte (uint8 Byte, uint32 Address)
 		
     case CMemory::MAP_SA1RAM:
 		*(Memory.SRAM + (Address & 0xffff)) = Byte;
+		DIRTY_MARK (SRAM, Address & 0xffff);
 		SA1.Executing = !SA1.Waiting;
 		break;
 		
@@ -446,11 +476,11 @@ static void S9xSetWord (uint16 Word, uint32 Address)
 #if defined(CPU_SHUTDOWN)
     CPU.WaitAddress = NULL;
 #endif
-    int block;
-    uint8 *SetAddress = Memory.WriteMap [block = ((Address >> MEMMAP_SHIFT) & MEMMAP_MASK)];
+    SMapBlock *block = &Memory.HotMap [(Address >> MEMMAP_SHIFT) & MEMMAP_MASK];
+    uint8 *SetAddress = block->WriteMap;
 
 	if (!CPU.InDMA)
-		CPU.Cycles += Memory.MemorySpeed [block] << 1;
+		CPU.Cycles += block->Speed << 1;
 
 
     if (SetAddress >= (uint8 *) CMemory::MAP_LAST)
@@ -469,6 +499,7 @@ static void S9xSetWord (uint16 Word, uint32 Address)
 		*SetAddress = (uint8) Word;
 		*(SetAddress + 1) = Word >> 8;
 #endif
+		S9xDirtyMarkPtr (SetAddress, 2);
 #else
 #ifdef FAST_LSB_WORD_ACCESS
 		*(uint16 *) (SetAddress + (Address & 0xffff)) = Word;
@@ -476,6 +507,7 @@ static void S9xSetWord (uint16 Word, uint32 Address)
 		*(SetAddress + (Address & 0xffff)) = (uint8) Word;
 		*(SetAddress + ((Address + 1) & 0xffff)) = Word >> 8;
 #endif
+		S9xDirtyMarkPtr (SetAddress + (Address & 0xffff), 2);
 #endif
 		return;
     }
@@ -505,11 +537,15 @@ static void S9xSetWord (uint16 Word, uint32 Address)
 		{
 			/* BJ: no FAST_LSB_WORD_ACCESS here, since if Memory.SRAMMask=0x7ff
 			 * then the high byte doesn't follow the low byte. */
-			*(Memory.SRAM + ((((Address&0xFF0000)>>1)|(Address&0x7FFF))& Memory.SRAMMask)) = (uint8) Word;
-			*(Memory.SRAM + (((((Address+1)&0xFF0000)>>1)|((Address+1)&0x7FFF))& Memory.SRAMMask)) = Word >> 8;
+			uint32 lo = (((Address&0xFF0000)>>1)|(Address&0x7FFF))& Memory.SRAMMask;
+			uint32 hi = ((((Address+1)&0xFF0000)>>1)|((Address+1)&0x7FFF))& Memory.SRAMMask;
+			*(Memory.SRAM + lo) = (uint8) Word;
+			*(Memory.SRAM + hi) = Word >> 8;
 
 //			*(Memory.SRAM + (Address & Memory.SRAMMask)) = (uint8) Word;
 //			*(Memory.SRAM + ((Address + 1) & Memory.SRAMMask)) = Word >> 8;
+			DIRTY_MARK (SRAM, lo);
+			DIRTY_MARK (SRAM, hi);
 			CPU.SRAMModified = TRUE;
 		}
 		return;
@@ -519,12 +555,14 @@ static void S9xSetWord (uint16 Word, uint32 Address)
 		{
 			/* BJ: no FAST_LSB_WORD_ACCESS here, since if Memory.SRAMMask=0x7ff
 			 * then the high byte doesn't follow the low byte. */
-			*(Memory.SRAM + 
-				(((Address & 0x7fff) - 0x6000 +
-				((Address & 0xf0000) >> 3) & Memory.SRAMMask))) = (uint8) Word;
-			*(Memory.SRAM + 
-				((((Address + 1) & 0x7fff) - 0x6000 +
-				(((Address + 1) & 0xf0000) >> 3) & Memory.SRAMMask))) = (uint8) (Word >> 8);
+			uint32 lo = ((Address & 0x7fff) - 0x6000 +
+				((Address & 0xf0000) >> 3) & Memory.SRAMMask);
+			uint32 hi = (((Address + 1) & 0x7fff) - 0x6000 +
+				(((Address + 1) & 0xf0000) >> 3) & Memory.SRAMMask);
+			*(Memory.SRAM + lo) = (uint8) Word;
+			*(Memory.SRAM + hi) = (uint8) (Word >> 8);
+			DIRTY_MARK (SRAM, lo);
+			DIRTY_MARK (SRAM, hi);
 			CPU.SRAMModified = TRUE;
 		}
 		return;
@@ -536,6 +574,7 @@ static void S9xSetWord (uint16 Word, uint32 Address)
 		*(Memory.BWRAM + ((Address & 0x7fff) - 0x6000)) = (uint8) Word;
 		*(Memory.BWRAM + (((Address + 1) & 0x7fff) - 0x6000)) = (uint8) (Word >> 8);
 #endif
+		S9xDirtyMarkPtr (Memory.BWRAM + ((Address & 0x7fff) - 0x6000), 2);
 		CPU.SRAMModified = TRUE;
 		return;
 		
@@ -554,6 +593,8 @@ static void S9xSetWord (uint16 Word, uint32 Address)
     case CMemory::MAP_SA1RAM:
 		*(Memory.SRAM + (Address & 0xffff)) = (uint8) Word;
 		*(Memory.SRAM + ((Address + 1) & 0xffff)) = (uint8) (Word >> 8);
+		DIRTY_MARK (SRAM, Address & 0xffff);
+		DIRTY_MARK (SRAM, (Address + 1) & 0xffff);
 		SA1.Executing = !SA1.Waiting;
 		break;
 		
@@ -594,7 +635,7 @@ static void S9xSetWord (uint16 Word, uint32 Address)
 
 static uint8 *GetBasePointer (uint32 Address)
 {
-    uint8 *GetAddress = Memory.Map [(Address >> MEMMAP_SHIFT) & MEMMAP_MASK];
+    uint8 *GetAddress = Memory.HotMap [(Address >> MEMMAP_SHIFT) & MEMMAP_MASK].Map;
     if (GetAddress >= (uint8 *) CMemory::MAP_LAST)
 		return (GetAddress);
 	if(Settings.SPC7110&&((Address&0x7FFFFF)==0x4800))
@@ -660,7 +701,7 @@ static uint8 *GetBasePointer (uint32 Address)
 
 static uint8 *S9xGetMemPointer (uint32 Address)
 {
-    uint8 *GetAddress = Memory.Map [(Address >> MEMMAP_SHIFT) & MEMMAP_MASK];
+    uint8 *GetAddress = Memory.HotMap [(Address >> MEMMAP_SHIFT) & MEMMAP_MASK].Map;
     if (GetAddress >= (uint8 *) CMemory::MAP_LAST)
 		return (GetAddress + (Address & 0xffff));
 	
@@ -714,10 +755,10 @@ static uint8 *S9xGetMemPointer (uint32 Address)
 
 static void S9xSetPCBase (uint32 Address)
 {
-    int block;
-    uint8 *GetAddress = Memory.Map [block = (Address >> MEMMAP_SHIFT) & MEMMAP_MASK];
+    SMapBlock *block = &Memory.HotMap [(Address >> MEMMAP_SHIFT) & MEMMAP_MASK];
+    uint8 *GetAddress = block->Map;
 
-	CPU.MemSpeed = Memory.MemorySpeed [block];
+	CPU.MemSpeed = block->Speed;
 	CPU.MemSpeedx2 = CPU.MemSpeed << 1;
  
    if (GetAddress >= (uint8 *) CMemory::MAP_LAST)
@@ -141,14 +141,32 @@
 #define ZIP			0
 #define RAR			1
 #define DEFAULT		2
+#define GZIP		3
+
+// What the CPU's reads and writes look up for a 4K block, packed so that
+// an access touches one cache line rather than one in each of Map,
+// WriteMap, MemorySpeed and BlockIsRAM. Those stay the tables the memory
+// maps are built in; SyncHotMap copies them here.
+struct SMapBlock {
+    uint8 *Map;
+    uint8 *WriteMap;
+    uint8 Speed;
+    uint8 IsRAM;
+    uint8 Pad [sizeof (uint8 *) * 2 - 2];	// a power of two in all
+};
 
 class CMemory {
 public:
     bool8 LoadROM (const char *);
     uint32 FileLoader (uint8* buffer, const char* filename, int32 maxsize);
+#ifdef MMAP_ROM
+    bool8 MapROM (const char *fname, int32 maxsize, int32 *size);
+    void  UnmapROM ();
+#endif
     void  InitROM (bool8);
     bool8 LoadSRAM (const char *);
     bool8 SaveSRAM (const char *);
+    int   SRAMSaveSize ();
     bool8 Init ();
     void  Deinit ();
     void  FreeSDD1Data ();
@@ -182,7 +200,7 @@ public:
     void SufamiTurboAltROMMap();
 #endif
     void ApplyROMFixes ();
-    void CheckForIPSPatch (const char *rom_filename, bool8 header,
+    void CheckForAnyPatch (const char *rom_filename, bool8 header,
 			   int32 &rom_size);
     
     const char *TVStandard ();
@@ -220,6 +238,7 @@ public:
     uint8 MemorySpeed [MEMMAP_NUM_BLOCKS];
     uint8 BlockIsRAM [MEMMAP_NUM_BLOCKS];
     uint8 BlockIsROM [MEMMAP_NUM_BLOCKS];
+    SMapBlock HotMap [MEMMAP_NUM_BLOCKS] CACHE_ALIGNED;
     char  ROMName [ROM_NAME_LEN];
     char  ROMId [5];
     char  CompanyId [3];
@@ -241,6 +260,9 @@ public:
     char ROMFilename [_MAX_PATH];
 	uint8 ROMRegion;
     uint32 ROMCRC32;
+#ifdef MMAP_ROM
+    uint32 ROMMapped;		// bytes of ROM mapped from the image file
+#endif
 	uint8 ExtendedFormat;
 #if 0
 	bool8 SufamiTurbo;
@@ -258,6 +280,7 @@ public:
 #endif
 	uint8 *BSRAM;
 	void ResetSpeedMap();
+	void SyncHotMap (int start, int count);
 #if 0
 	bool8 LoadMulti (const char *,const char *,const char *);
 #endif
@@ -0,0 +1,33 @@
+/*
+ * Memory plan.
+ *
+ * With MEMORY_ARENA the emulated machine's buffers, ROM, RAM, VRAM, SRAM,
+ * the BS-X pack and the tile caches, are carved out of one anonymous
+ * mapping, the arena, whose pages cost nothing until they are touched.
+ * Each ROM load gives back the pages the last game left behind, so a small
+ * game after a large one only keeps what it uses itself. Once the header
+ * is parsed the plan records what this cartridge needs, and the port can
+ * report it beside the process's peak resident size.
+ */
+#ifndef _MEMPLAN_H_
+#define _MEMPLAN_H_
+
+#include "port.h"
+
+typedef struct {
+    uint32 rom;			// the image, as the memory map sees it
+    uint32 sram;		// battery RAM, or the SuperFX/SA-1 work RAM
+    uint32 bsram;		// BS-X memory pack; 0 unless a BS cartridge
+    uint32 fixed;		// RAM, VRAM, registers and tile caches
+    uint32 total;
+} SMemoryPlan;
+
+extern SMemoryPlan MemoryPlan;
+
+bool8 S9xArenaInit ();
+void S9xArenaDeinit ();
+void S9xArenaRelease ();
+void S9xMemoryPlanUpdate ();
+uint32 S9xPeakRSS ();
+
+#endif
@@ -0,0 +1,32 @@
+/*
+ * Output resampler for the sound mixer.
+ *
+ * The S-DSP voices, echo and FIR filter are mixed at the console's native
+ * 32 kHz; this stage converts the mixed stream to the device rate with a
+ * polyphase windowed-sinc filter.
+ */
+#ifndef _RESAMPLER_H_
+#define _RESAMPLER_H_
+
+#include "port.h"
+
+#define RESAMPLER_NATIVE_RATE 32000
+
+typedef struct {
+    uint32 in_frames;   /* frames mixed at the native rate */
+    uint32 out_frames;  /* frames delivered at the device rate */
+    uint32 usec;        /* time spent filtering, in microseconds */
+    uint32 calls;
+} SResamplerStats;
+
+extern SResamplerStats ResamplerStats;
+
+bool8 S9xResamplerInit (int in_rate, int out_rate, int channels);
+void S9xResamplerReset ();
+int S9xResamplerRequired (int out_frames);
+int16 *S9xResamplerWritePtr ();
+void S9xResamplerPush (int in_frames);
+void S9xResamplerRun (int16 *out, int out_frames);
+void S9xResamplerResetStats ();
+
+#endif
@@ -0,0 +1,43 @@
+/*
+ * Rewind buffer.
+ *
+ * A state is captured every few frames. The newest one is kept in full;
+ * each older one is stored as the XOR of it and the state after it,
+ * run-length coded so that unchanged bytes cost nothing, in a ring of
+ * fixed size. Stepping back restores the newest state and rolls it back
+ * one delta.
+ */
+#ifndef _REWIND_H_
+#define _REWIND_H_
+
+#include "port.h"
+
+// Capture granularity. Pages identical to the previous state are skipped
+// without being looked at byte by byte; memory the dirty page map says was
+// not written is skipped without being looked at at all.
+#define REWIND_PAGE_SIZE 4096
+#define REWIND_MAX_STATES 2048
+
+typedef struct {
+    uint32 states;		// deltas in the ring
+    uint32 ring_used;		// bytes of the ring holding deltas
+    uint32 ring_size;
+    uint32 memory;		// ring plus the two full state buffers
+    uint32 last_size;		// bytes of the newest delta
+    uint32 last_usec;		// cost of the newest capture
+    uint32 peak_usec;
+    uint32 pages_skipped;	// of the newest capture
+    uint32 pages_total;
+    uint32 bytes_clean;		// ruled out by the dirty page map
+} SRewindStats;
+
+extern SRewindStats RewindStats;
+
+bool8 S9xRewindInit (uint32 ring_size, int interval);
+void S9xRewindDeinit ();
+void S9xRewindReset ();
+void S9xRewindCapture ();
+bool8 S9xRewindStep ();
+bool8 S9xRewindActive ();
+
+#endif
@@ -0,0 +1,29 @@
+/*
+ * Run-ahead.
+ *
+ * After each real frame the state is saved, the following frames are run
+ * with the same input and only the last of them is drawn, then the state
+ * is put back. The picture is that many frames ahead of the emulation,
+ * which hides input lag the game itself adds before it reacts.
+ */
+#ifndef _RUNAHEAD_H_
+#define _RUNAHEAD_H_
+
+#include "port.h"
+
+#define RUN_AHEAD_MAX_FRAMES 3
+
+typedef struct {
+    uint32 frames;		// hidden frames per real one
+    uint32 last_usec;		// cost of the newest run, save to restore
+    uint32 peak_usec;
+    uint32 save_usec;		// of which saving and restoring the state
+} SRunAheadStats;
+
+extern SRunAheadStats RunAheadStats;
+
+void S9xRunAheadDeinit ();
+bool8 S9xRunAheadFrame (int frames);
+bool8 S9xRunAheadHidden ();
+
+#endif
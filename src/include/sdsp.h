@@ -0,0 +1,50 @@
+/*
+ * Sample-accurate S-DSP core.
+ *
+ * An alternative to the high-level soundux.cpp mixer: runs the DSP one
+ * 32 kHz sample at a time straight from the APU.DSP register file, with the
+ * hardware envelope counter, BRR decoder, Gaussian interpolation, noise and
+ * echo (the echo buffer lives in APU RAM, as on the real chip).
+ */
+#ifndef _SDSP_H_
+#define _SDSP_H_
+
+#include "port.h"
+
+#define SDSP_VOICES 8
+#define SDSP_BRR_BUF_SIZE 12
+
+// Voice state is kept as one array per field so the per-sample loops walk
+// contiguous memory.
+typedef struct {
+    int32 buf [SDSP_VOICES][SDSP_BRR_BUF_SIZE * 2];
+    int32 buf_pos [SDSP_VOICES];
+    int32 interp_pos [SDSP_VOICES];
+    int32 brr_addr [SDSP_VOICES];
+    int32 brr_offset [SDSP_VOICES];
+    int32 kon_delay [SDSP_VOICES];
+    int32 env_mode [SDSP_VOICES];
+    int32 env [SDSP_VOICES];
+    int32 hidden_env [SDSP_VOICES];
+
+    int32 echo_hist [8][2];
+    int32 echo_hist_pos;
+    int32 echo_offset;
+    int32 echo_length;
+
+    int32 counter;
+    int32 noise;
+    int32 every_other_sample;
+    int32 kon;
+    int32 new_kon;
+    int32 koff;
+} SSDSP;
+
+extern SSDSP SDSP;
+
+void S9xSDSPInit ();
+void S9xSDSPReset ();
+void S9xSDSPWrite (uint8 reg, uint8 byte);
+void S9xSDSPMix (int16 *out, int frames, bool8 stereo);
+
+#endif
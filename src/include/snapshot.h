@@ -102,14 +102,55 @@
 #define WRONG_MOVIE_SNAPSHOT (-4)
 #define NOT_A_MOVIE_SNAPSHOT (-5)
 
+// Freeze files used to start with this many bytes, left zero, before the
+// snapshot; files written now hold an indexed container instead.
+#define SNAPSHOT_FILE_HEADER 4
+
+// The indexed container: this magic, its version, a section count and a
+// table of SNAPSHOT_INDEX_MAX entries (name, offset, size, CRC32), then
+// the sections. Each section is a block of the linear format without
+// its header, so any one of them can be read on its own.
+#define SNAPSHOT_INDEX_MAGIC "S9XI"
+#define SNAPSHOT_INDEX_VERSION 1
+#define SNAPSHOT_INDEX_MAX 32
+
+// A snapshot held in memory. data is allocated on first use and grows to
+// the largest state seen, so later saves into the same buffer do not
+// allocate. raw_size is the uncompressed length once compressed, else 0.
+typedef struct {
+    uint8  *data;
+    uint32 size;
+    uint32 used;
+    uint32 raw_size;
+} SSnapshotMem;
+
+// A section the port stores along with the state, such as a thumbnail;
+// name is three characters, as block names are.
+typedef struct {
+    const char  *name;
+    const uint8 *data;
+    uint32 size;
+} SSnapshotSection;
+
 START_EXTERN_C
 bool8 S9xFreezeGame (const char *filename);
 bool8 S9xUnfreezeGame (const char *filename);
 bool8 Snapshot (const char *filename);
 bool8 S9xLoadSnapshot (const char *filename);
 bool8 S9xSPCDump (const char *filename);
+bool8 S9xSPCLoad (const char *filename);
 void S9xFreezeToStream (STREAM);
 int S9xUnfreezeFromStream (STREAM);
+bool8 S9xFreezeToMemory (SSnapshotMem *mem);
+bool8 S9xFreezeGameToMemory (SSnapshotMem *mem, const SSnapshotSection *extra, int num_extra);
+int32 S9xSnapshotReadSection (const char *filename, const char *name, uint8 *buffer, uint32 size);
+int S9xUnfreezeFromMemory (const SSnapshotMem *mem);
+bool8 S9xCompressSnapshot (const SSnapshotMem *src, SSnapshotMem *dst);
+bool8 S9xUncompressSnapshot (const SSnapshotMem *src, SSnapshotMem *dst);
+void S9xFreeSnapshotMem (SSnapshotMem *mem);
+bool8 S9xFreezeRaw (SSnapshotMem *mem);
+bool8 S9xUnfreezeRaw (const SSnapshotMem *mem);
+int32 S9xSnapshotFindBlock (const SSnapshotMem *mem, const char *name, uint32 *len);
 END_EXTERN_C
 
 #endif
@@ -347,6 +347,9 @@ struct SSettings{
     bool8  NextAPUEnabled;
     uint8  AltSampleDecode;
     bool8  FixFrequency;
+    bool8  SoundResample;
+    bool8  SoundFrameBatch;
+    uint8  SoundCore;
     
     /* Graphics options */
 #ifndef FOREVER_16_BIT
@@ -99,6 +99,8 @@ enum { MODE_NONE = SOUND_SILENT, MODE_ADSR, MODE_RELEASE = SOUND_RELEASE,
        MODE_GAIN, MODE_INCREASE_LINEAR, MODE_INCREASE_BENT_LINE,
        MODE_DECREASE_LINEAR, MODE_DECREASE_EXPONENTIAL};
 
+enum { SOUND_CORE_HLE = 0, SOUND_CORE_SDSP };
+
 #define MAX_ENVELOPE_HEIGHT 127
 #define ENVELOPE_SHIFT 7
 #define MAX_VOLUME 127
@@ -121,6 +123,7 @@ typedef struct {
     int sound_fd;
     int sound_switch;
     int playback_rate;
+    int mix_rate;       // rate the voices are mixed at; != playback_rate when resampling
     int buffer_size;
     // int noise_gen;
     // Moved to soundux.cpp's noise_gen; this doesn't need volatility! [Neb]
@@ -257,6 +260,12 @@ void S9xStartSample (int channel);
 
 EXTERN_C void S9xMixSamples (uint8 *buffer, int sample_count);
 EXTERN_C void S9xMixSamplesO (uint8 *buffer, int sample_count, int byte_offset);
+void S9xCatchUpSound ();
+void S9xResetSoundBatch ();
+void S9xEndSoundFrame ();
+void S9xSaveMixerState ();
+void S9xRestoreMixerState ();
+bool8 S9xSDSPActive ();
 bool8 S9xOpenSoundDevice (int, bool8, int);
 void S9xSetPlaybackRate (uint32 rate);
 #endif
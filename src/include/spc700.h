@@ -190,6 +190,15 @@ EXTERN_C int32 ESPC (int32);
 }
 #endif
 
+#if defined(SPC700_FAST) && !defined(DEBUGGER)
+// Threaded core in spc700fast.cpp; APU_EXECUTE1 still single-steps the
+// table core for the callers that need one instruction at a time.
+void S9xAPUExecute ();
+
+#define APU_EXECUTE() \
+if (IAPU.APUExecuting) \
+    S9xAPUExecute ();
+#else
 #define APU_EXECUTE() \
 if (IAPU.APUExecuting) \
 {\
@@ -197,6 +206,7 @@ if (IAPU.APUExecuting) \
 	APU_EXECUTE1(); \
 }
 #endif
+#endif
 
 #endif
 
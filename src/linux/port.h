@@ -100,6 +100,11 @@ typedef short			int16_32;
 //Misc Items
 #define VAR_CYCLES
 #define SPC700_SHUTDOWN
+#define SPC700_FAST
+#define DIRTY_TRACKING
+#define MMAP_ROM
+#define MEMORY_ARENA
+#define ROM_CRC_CACHE
 #define USE_SA1
 #define SDD1_DECOMP
 #define LSB_FIRST
@@ -119,6 +124,8 @@ typedef short			int16_32;
 #define ZeroMemory(a,b) memset((a),0,(b))
 #define PACKING __attribute__ ((packed))
 #define ALIGN_BY_ONE  __attribute__ ((aligned (1), packed))
+// The XBurst L1 caches have 32-byte lines
+#define CACHE_ALIGNED __attribute__ ((aligned (32)))
 #define LSB_FIRST
 #undef  FAST_LSB_WORD_ACCESS
 #define FAST_ALIGNED_LSB_WORD_ACCESS
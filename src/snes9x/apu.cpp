@@ -97,6 +97,8 @@
 #include "apu.h"
 #include "soundux.h"
 #include "cpuexec.h"
+#include "sdsp.h"
+#include "dirty.h"
 
 /* For note-triggered SPC dump support */
 #include "snapshot.h"
@@ -124,6 +126,7 @@ bool8 S9xInitAPU ()
     }
 
 	memset(IAPU.RAM, 0, 0x10000);
+	S9xSDSPInit ();
 	
     return (TRUE);
 }
@@ -157,6 +160,7 @@ void S9xResetAPU ()
 	{
 		memmove(IAPU.RAM+(i<<8), IAPU.RAM, 0x100);
 	}
+	S9xDirtyMarkRange (DIRTY_APURAM, 0, 0x10000);
 	
     ZeroMemory (APU.OutPorts, 4);
     IAPU.DirectPage = IAPU.RAM;
@@ -206,6 +210,7 @@ void S9xResetAPU ()
 	
     S9xResetSound (TRUE);
     S9xSetEchoEnable (0);
+    S9xSDSPReset ();
 }
 
 void S9xSetAPUDSP (uint8 byte)
@@ -217,6 +222,17 @@ void S9xSetAPUDSP (uint8 byte)
 
 	spc_dump_dsp[reg] = byte;
 
+	// Bring the batched mixer up to this write before it changes anything.
+	if (Settings.SoundFrameBatch)
+		S9xCatchUpSound ();
+
+	// The sample-accurate core reads the register file directly.
+	if (S9xSDSPActive ())
+	{
+		S9xSDSPWrite (reg, byte);
+		return;
+	}
+
     switch (reg)
     {
     case APU_FLG:
@@ -759,7 +775,7 @@ void S9xFixEnvelope (int channel, uint8 gain, uint8 adsr1, uint8 adsr2)
 			
 			int attack = AttackRate [adsr1 & 0xf];
 			
-			if (attack == 1 && (!Settings.SoundSync
+			if (attack == 1 && (!(Settings.SoundSync || Settings.SoundFrameBatch)
 #ifdef __WIN32__
                 || Settings.SoundDriver != WIN_SNES9X_DIRECT_SOUND_DRIVER
 #endif
@@ -864,6 +880,7 @@ void S9xSetAPUControl (uint8 byte)
 			// memmove converted: Different mallocs [Neb]
 			// DS2 DMA notes: The APU ROM is not 32-byte aligned [Neb]
 			memmove (&IAPU.RAM [0xffc0], APUROM, sizeof (APUROM));
+			DIRTY_MARK (APURAM, 0xffc0);
 			APU.ShowROM = TRUE;
 		}
     }
@@ -875,6 +892,7 @@ void S9xSetAPUControl (uint8 byte)
 			// memmove converted: Different mallocs [Neb]
 			// DS2 DMA notes: The APU ROM is not 32-byte aligned [Neb]
 			memmove (&IAPU.RAM [0xffc0], APU.ExtraRAM, sizeof (APUROM));
+			DIRTY_MARK (APURAM, 0xffc0);
 		}
     }
     IAPU.RAM [0xf1] = byte;
@@ -907,6 +925,15 @@ void S9xSetAPUTimer (uint16 Address, uint8 byte)
 uint8 S9xGetAPUDSP ()
 {
     uint8 reg = IAPU.RAM [0xf2] & 0x7f;
+
+    if (S9xSDSPActive ())
+    {
+		// ENVX, OUTX and ENDX are kept current by the core itself.
+		if (Settings.SoundFrameBatch)
+			S9xCatchUpSound ();
+		return (APU.DSP [reg]);
+    }
+
     uint8 byte = APU.DSP [reg];
 	
     switch (reg)
@@ -169,7 +169,10 @@ void S9xRemoveCheat (uint32 which1)
 	uint8 *ptr = Memory.Map [block];
 	    
 	if (ptr >= (uint8 *) CMemory::MAP_LAST)
+	{
 	    *(ptr + (address & 0xffff)) = Cheat.c [which1].saved_byte;
+	    S9xDirtyMarkPtr (ptr + (address & 0xffff), 1);
+	}
 	else
 	    S9xSetByte (Cheat.c [which1].saved_byte, address);
 	// Unsave the address for the next call to S9xRemoveCheat.
@@ -188,7 +191,10 @@ void S9xApplyCheat (uint32 which1)
     uint8 *ptr = Memory.Map [block];
     
     if (ptr >= (uint8 *) CMemory::MAP_LAST)
+    {
 	*(ptr + (address & 0xffff)) = Cheat.c [which1].byte;
+	S9xDirtyMarkPtr (ptr + (address & 0xffff), 1);
+    }
     else
 	S9xSetByte (Cheat.c [which1].byte, address);
     Cheat.c [which1].saved = TRUE;
@@ -202,6 +202,7 @@ void S9xReset (void)
     S9xInitCheatData ();
 	if(Settings.OBC1)
 		ResetOBC1();
+    S9xDirtyReset ();
 
 //    Settings.Paused = FALSE;
 }
@@ -234,6 +235,7 @@ void S9xSoftReset (void)
     if (Settings.C4)
         S9xInitC4 ();
     S9xInitCheatData ();
+    S9xDirtyReset ();
 
 //    Settings.Paused = FALSE;
 }
@@ -474,7 +474,7 @@ void S9xDoHBlankProcessing_SFX ()
 		S9xSuperFXExec ();
 
 #ifndef STORM
-		if (Settings.SoundSync)
+		if (Settings.SoundSync || Settings.SoundFrameBatch)
 			S9xGenerateSound ();
 #endif
 
@@ -571,59 +571,7 @@ void S9xDoHBlankProcessing_SFX ()
 		{
 			RenderLine (CPU.V_Counter - FIRST_VISIBLE_LINE);
 		}
-	// Use TimerErrorCounter to skip update of SPC700 timers once
-	// every 128 updates. Needed because this section of code is called
-	// once every emulated 63.5 microseconds, which coresponds to
-	// 15.750KHz, but the SPC700 timers need to be updated at multiples
-	// of 8KHz, hence the error correction.
-//	IAPU.TimerErrorCounter++;
-//	if (IAPU.TimerErrorCounter >= )
-//	    IAPU.TimerErrorCounter = 0;
-//	else
-	{
-		if (APU.TimerEnabled [2])
-		{
-			APU.Timer [2] += 4;
-			while (APU.Timer [2] >= APU.TimerTarget [2])
-			{
-				IAPU.RAM [0xff] = (IAPU.RAM [0xff] + 1) & 0xf;
-				APU.Timer [2] -= APU.TimerTarget [2];
-#ifdef SPC700_SHUTDOWN		
-				IAPU.WaitCounter++;
-				IAPU.APUExecuting = TRUE;
-#endif
-			}
-		}
-		if (CPU.V_Counter & 1)
-		{
-			if (APU.TimerEnabled [0])
-			{
-				APU.Timer [0]++;
-				if (APU.Timer [0] >= APU.TimerTarget [0])
-				{
-					IAPU.RAM [0xfd] = (IAPU.RAM [0xfd] + 1) & 0xf;
-					APU.Timer [0] = 0;
-#ifdef SPC700_SHUTDOWN		
-					IAPU.WaitCounter++;
-					IAPU.APUExecuting = TRUE;
-#endif
-				}
-			}
-			if (APU.TimerEnabled [1])
-			{
-				APU.Timer [1]++;
-				if (APU.Timer [1] >= APU.TimerTarget [1])
-				{
-					IAPU.RAM [0xfe] = (IAPU.RAM [0xfe] + 1) & 0xf;
-					APU.Timer [1] = 0;
-#ifdef SPC700_SHUTDOWN		
-					IAPU.WaitCounter++;
-					IAPU.APUExecuting = TRUE;
-#endif		    
-				}
-			}
-	    }
-	}
+		S9xAPUTimerTick (CPU.V_Counter & 1);
 		break;
 
 	    case HTIMER_BEFORE_EVENT:
@@ -653,7 +601,7 @@ void S9xDoHBlankProcessing_NoSFX ()
 		case HBLANK_END_EVENT:
 
 #ifndef STORM
-		if (Settings.SoundSync)
+		if (Settings.SoundSync || Settings.SoundFrameBatch)
 			S9xGenerateSound ();
 #endif
 
@@ -750,59 +698,7 @@ void S9xDoHBlankProcessing_NoSFX ()
 		{
 			RenderLine (CPU.V_Counter - FIRST_VISIBLE_LINE);
 		}
-	// Use TimerErrorCounter to skip update of SPC700 timers once
-	// every 128 updates. Needed because this section of code is called
-	// once every emulated 63.5 microseconds, which coresponds to
-	// 15.750KHz, but the SPC700 timers need to be updated at multiples
-	// of 8KHz, hence the error correction.
-//	IAPU.TimerErrorCounter++;
-//	if (IAPU.TimerErrorCounter >= )
-//	    IAPU.TimerErrorCounter = 0;
-//	else
-	{
-		if (APU.TimerEnabled [2])
-		{
-			APU.Timer [2] += 4;
-			while (APU.Timer [2] >= APU.TimerTarget [2])
-			{
-				IAPU.RAM [0xff] = (IAPU.RAM [0xff] + 1) & 0xf;
-				APU.Timer [2] -= APU.TimerTarget [2];
-#ifdef SPC700_SHUTDOWN		
-				IAPU.WaitCounter++;
-				IAPU.APUExecuting = TRUE;
-#endif
-			}
-		}
-		if (CPU.V_Counter & 1)
-		{
-			if (APU.TimerEnabled [0])
-			{
-				APU.Timer [0]++;
-				if (APU.Timer [0] >= APU.TimerTarget [0])
-				{
-					IAPU.RAM [0xfd] = (IAPU.RAM [0xfd] + 1) & 0xf;
-					APU.Timer [0] = 0;
-#ifdef SPC700_SHUTDOWN		
-					IAPU.WaitCounter++;
-					IAPU.APUExecuting = TRUE;
-#endif
-				}
-			}
-			if (APU.TimerEnabled [1])
-			{
-				APU.Timer [1]++;
-				if (APU.Timer [1] >= APU.TimerTarget [1])
-				{
-					IAPU.RAM [0xfe] = (IAPU.RAM [0xfe] + 1) & 0xf;
-					APU.Timer [1] = 0;
-#ifdef SPC700_SHUTDOWN		
-					IAPU.WaitCounter++;
-					IAPU.APUExecuting = TRUE;
-#endif		    
-				}
-			}
-	    }
-	}
+		S9xAPUTimerTick (CPU.V_Counter & 1);
 		break;
 
 	    case HTIMER_BEFORE_EVENT:
@@ -0,0 +1,97 @@
+/*
+ * Dirty page tracking; see dirty.h.
+ */
+#include <string.h>
+
+#include "snes9x.h"
+#include "dirty.h"
+
+struct SDirty Dirty;
+
+static const uint32 RegionBase [DIRTY_REGIONS] = {
+    DIRTY_RAM_BASE, DIRTY_VRAM_BASE, DIRTY_SRAM_BASE, DIRTY_APURAM_BASE
+};
+
+static const uint32 RegionPages [DIRTY_REGIONS] = {
+    DIRTY_VRAM_BASE - DIRTY_RAM_BASE,
+    DIRTY_SRAM_BASE - DIRTY_VRAM_BASE,
+    DIRTY_APURAM_BASE - DIRTY_SRAM_BASE,
+    DIRTY_PAGES - DIRTY_APURAM_BASE
+};
+
+// Pages no write hook can vouch for are put back after every clear.
+static void MarkUntracked ()
+{
+#ifdef DIRTY_TRACKING
+    for (int r = 0; r < DIRTY_REGIONS; r++)
+		if (Dirty.Untracked & (1 << r))
+			memset (&Dirty.Pages [RegionBase [r]], DIRTY_ALL, RegionPages [r]);
+
+    Dirty.Pages [DIRTY_APURAM_BASE] = DIRTY_ALL;
+#else
+    memset (Dirty.Pages, DIRTY_ALL, sizeof (Dirty.Pages));
+#endif
+}
+
+// Called from S9xReset once the cartridge type is known.
+void S9xDirtyReset ()
+{
+    // The SA-1 shares the main CPU's write map but stores through its own
+    // handlers; the GSU and the ST010 write their RAM directly.
+    Dirty.Untracked = 0;
+    if (Settings.SA1)
+		Dirty.Untracked |= (1 << DIRTY_RAM) | (1 << DIRTY_SRAM);
+    if (Settings.SuperFX || Settings.SETA)
+		Dirty.Untracked |= 1 << DIRTY_SRAM;
+    S9xDirtyMarkAll ();
+}
+
+// For memory changed wholesale: resets, loaded states, SRAM loads.
+void S9xDirtyMarkAll ()
+{
+    memset (Dirty.Pages, DIRTY_ALL, sizeof (Dirty.Pages));
+}
+
+void S9xDirtyMarkRange (int region, uint32 offset, uint32 len)
+{
+    if (!len)
+		return;
+
+    uint32 first = offset >> DIRTY_PAGE_SHIFT;
+    uint32 last = (offset + len - 1) >> DIRTY_PAGE_SHIFT;
+
+    if (last >= RegionPages [region])
+		last = RegionPages [region] - 1;
+    if (first <= last)
+		memset (&Dirty.Pages [RegionBase [region] + first], DIRTY_ALL, last - first + 1);
+}
+
+// Takes a checkpoint for client: every page reads clean to it until it is
+// written again.
+void S9xDirtyClear (uint8 client)
+{
+    for (int i = 0; i < DIRTY_PAGES; i++)
+		Dirty.Pages [i] &= ~client;
+    MarkUntracked ();
+}
+
+bool8 S9xDirtyTest (int region, uint32 page, uint8 client)
+{
+    return ((Dirty.Pages [RegionBase [region] + page] & client) != 0);
+}
+
+uint32 S9xDirtyCount (int region, uint8 client)
+{
+    const uint8 *p = &Dirty.Pages [RegionBase [region]];
+    uint32 count = 0;
+
+    for (uint32 i = 0; i < RegionPages [region]; i++)
+		if (p [i] & client)
+			count++;
+    return (count);
+}
+
+uint32 S9xDirtyRegionPages (int region)
+{
+    return (RegionPages [region]);
+}
@@ -283,105 +283,152 @@ void DrawLargePixel16Sub1_2 (uint32 Tile, uint32 Offset,
 			     uint32 StartPixel, uint32 Pixels,
 			     uint32 StartLine, uint32 LineCount);
 
-bool8 S9xGraphicsInit ()
+// The colour maths tables take a while to fill on a slow CPU, so that is
+// left to the first screen update rather than done before the menu shows.
+static bool8 ColourTablesBuilt = FALSE;
+
+static void BuildColourTables ()
 {
-    register uint32 PixelOdd = 1;
-    register uint32 PixelEven = 2;
+    ColourTablesBuilt = TRUE;
+    if (!GFX.X2)
+	return;
 
-#ifdef GFX_MULTI_FORMAT
-    if (GFX.BuildPixel == NULL)
-	S9xSetRenderPixelFormat (RGB565);
-#endif
+    uint32 r, g, b;
 
-    for (uint8 bitshift = 0; bitshift < 4; bitshift++)
+    // Build a lookup table that multiplies a packed RGB value by 2 with
+    // saturation.
+    for (r = 0; r <= MAX_RED; r++)
     {
-	for (register int i = 0; i < 16; i++)
+	uint32 r2 = r << 1;
+	if (r2 > MAX_RED)
+	    r2 = MAX_RED;
+	for (g = 0; g <= MAX_GREEN; g++)
 	{
-	    register uint32 h = 0;
-	    register uint32 l = 0;
-
-#if defined(LSB_FIRST)
-	    if (i & 8)
-		h |= PixelOdd;
-	    if (i & 4)
-		h |= PixelOdd << 8;
-	    if (i & 2)
-		h |= PixelOdd << 16;
-	    if (i & 1)
-		h |= PixelOdd << 24;
-	    if (i & 8)
-		l |= PixelOdd;
-	    if (i & 4)
-		l |= PixelOdd << 8;
-	    if (i & 2)
-		l |= PixelOdd << 16;
-	    if (i & 1)
-		l |= PixelOdd << 24;
-#else
-	    if (i & 8)
-		h |= (PixelOdd << 24);
-	    if (i & 4)
-		h |= (PixelOdd << 16);
-	    if (i & 2)
-		h |= (PixelOdd << 8);
-	    if (i & 1)
-		h |= PixelOdd;
-	    if (i & 8)
-		l |= (PixelOdd << 24);
-	    if (i & 4)
-		l |= (PixelOdd << 16);
-	    if (i & 2)
-		l |= (PixelOdd << 8);
-	    if (i & 1)
-		l |= PixelOdd;
-#endif
+	    uint32 g2 = g << 1;
+	    if (g2 > MAX_GREEN)
+		g2 = MAX_GREEN;
+	    for (b = 0; b <= MAX_BLUE; b++)
+	    {
+		uint32 b2 = b << 1;
+		if (b2 > MAX_BLUE)
+		    b2 = MAX_BLUE;
+		GFX.X2 [BUILD_PIXEL2 (r, g, b)] = BUILD_PIXEL2 (r2, g2, b2);
+		GFX.X2 [BUILD_PIXEL2 (r, g, b) & ~ALPHA_BITS_MASK] = BUILD_PIXEL2 (r2, g2, b2);
+	    }
+	}
+    }
+    ZeroMemory (GFX.ZERO, 0x10000 * sizeof (uint16));
+    ZeroMemory (GFX.ZERO_OR_X2, 0x10000 * sizeof (uint16));
+    // Build a lookup table that if the top bit of the color value is zero
+    // then the value is zero, otherwise multiply the value by 2. Used by
+    // the color subtraction code.
 
-	    odd_high[bitshift][i] = h;
-	    odd_low[bitshift][i] = l;
-	    h = l = 0;
-
-#if defined(LSB_FIRST)
-	    if (i & 8)
-		h |= PixelEven;
-	    if (i & 4)
-		h |= PixelEven << 8;
-	    if (i & 2)
-		h |= PixelEven << 16;
-	    if (i & 1)
-		h |= PixelEven << 24;
-	    if (i & 8)
-		l |= PixelEven;
-	    if (i & 4)
-		l |= PixelEven << 8;
-	    if (i & 2)
-		l |= PixelEven << 16;
-	    if (i & 1)
-		l |= PixelEven << 24;
+#if defined(OLD_COLOUR_BLENDING)
+    for (r = 0; r <= MAX_RED; r++)
+    {
+	uint32 r2 = r;
+	if ((r2 & 0x10) == 0)
+	    r2 = 0;
+	else
+	    r2 = (r2 << 1) & MAX_RED;
+
+	for (g = 0; g <= MAX_GREEN; g++)
+	{
+	    uint32 g2 = g;
+	    if ((g2 & GREEN_HI_BIT) == 0)
+		g2 = 0;
+	    else
+		g2 = (g2 << 1) & MAX_GREEN;
+
+	    for (b = 0; b <= MAX_BLUE; b++)
+	    {
+		uint32 b2 = b;
+		if ((b2 & 0x10) == 0)
+		    b2 = 0;
+		else
+		    b2 = (b2 << 1) & MAX_BLUE;
+
+		GFX.ZERO_OR_X2 [BUILD_PIXEL2 (r, g, b)] = BUILD_PIXEL2 (r2, g2, b2);
+		GFX.ZERO_OR_X2 [BUILD_PIXEL2 (r, g, b) & ~ALPHA_BITS_MASK] = BUILD_PIXEL2 (r2, g2, b2);
+	    }
+	}
+    }
 #else
-	    if (i & 8)
-		h |= (PixelEven << 24);
-	    if (i & 4)
-		h |= (PixelEven << 16);
-	    if (i & 2)
-		h |= (PixelEven << 8);
-	    if (i & 1)
-		h |= PixelEven;
-	    if (i & 8)
-		l |= (PixelEven << 24);
-	    if (i & 4)
-		l |= (PixelEven << 16);
-	    if (i & 2)
-		l |= (PixelEven << 8);
-	    if (i & 1)
-		l |= PixelEven;
+    for (r = 0; r <= MAX_RED; r++)
+    {
+	uint32 r2 = r;
+	if ((r2 & 0x10) == 0)
+	    r2 = 0;
+	else
+	    r2 = (r2 << 1) & MAX_RED;
+
+	if (r2 == 0)
+	    r2 = 1;
+	for (g = 0; g <= MAX_GREEN; g++)
+	{
+	    uint32 g2 = g;
+	    if ((g2 & GREEN_HI_BIT) == 0)
+		g2 = 0;
+	    else
+		g2 = (g2 << 1) & MAX_GREEN;
+
+	    if (g2 == 0)
+		g2 = 1;
+	    for (b = 0; b <= MAX_BLUE; b++)
+	    {
+		uint32 b2 = b;
+		if ((b2 & 0x10) == 0)
+		    b2 = 0;
+		else
+		    b2 = (b2 << 1) & MAX_BLUE;
+
+		if (b2 == 0)
+		    b2 = 1;
+		GFX.ZERO_OR_X2 [BUILD_PIXEL2 (r, g, b)] = BUILD_PIXEL2 (r2, g2, b2);
+		GFX.ZERO_OR_X2 [BUILD_PIXEL2 (r, g, b) & ~ALPHA_BITS_MASK] = BUILD_PIXEL2 (r2, g2, b2);
+	    }
+	}
+    }
 #endif
 
-	    even_high[bitshift][i] = h;
-	    even_low[bitshift][i] = l;
+    // Build a lookup table that if the top bit of the color value is zero
+    // then the value is zero, otherwise its just the value.
+    for (r = 0; r <= MAX_RED; r++)
+    {
+	uint32 r2 = r;
+	if ((r2 & 0x10) == 0)
+	    r2 = 0;
+	else
+	    r2 &= ~0x10;
+
+	for (g = 0; g <= MAX_GREEN; g++)
+	{
+	    uint32 g2 = g;
+	    if ((g2 & GREEN_HI_BIT) == 0)
+		g2 = 0;
+	    else
+		g2 &= ~GREEN_HI_BIT;
+	    for (b = 0; b <= MAX_BLUE; b++)
+	    {
+		uint32 b2 = b;
+		if ((b2 & 0x10) == 0)
+		    b2 = 0;
+		else
+		    b2 &= ~0x10;
+
+		GFX.ZERO [BUILD_PIXEL2 (r, g, b)] = BUILD_PIXEL2 (r2, g2, b2);
+		GFX.ZERO [BUILD_PIXEL2 (r, g, b) & ~ALPHA_BITS_MASK] = BUILD_PIXEL2 (r2, g2, b2);
+	    }
 	}
-	PixelEven <<= 2;
-	PixelOdd <<= 2;
     }
+}
+
+bool8 S9xGraphicsInit ()
+{
+#ifdef GFX_MULTI_FORMAT
+    if (GFX.BuildPixel == NULL)
+	S9xSetRenderPixelFormat (RGB565);
+#endif
 
     GFX.RealPitch = GFX.Pitch2 = GFX.Pitch;
     GFX.ZPitch = GFX.Pitch;
@@ -467,134 +514,6 @@ bool8 S9xGraphicsInit ()
 	    }
 	    return (FALSE);
 	}
-	uint32 r, g, b;
-
-	// Build a lookup table that multiplies a packed RGB value by 2 with
-	// saturation.
-	for (r = 0; r <= MAX_RED; r++)
-	{
-	    uint32 r2 = r << 1;
-	    if (r2 > MAX_RED)
-		r2 = MAX_RED;
-	    for (g = 0; g <= MAX_GREEN; g++)
-	    {
-		uint32 g2 = g << 1;
-		if (g2 > MAX_GREEN)
-		    g2 = MAX_GREEN;
-		for (b = 0; b <= MAX_BLUE; b++)
-		{
-		    uint32 b2 = b << 1;
-		    if (b2 > MAX_BLUE)
-			b2 = MAX_BLUE;
-		    GFX.X2 [BUILD_PIXEL2 (r, g, b)] = BUILD_PIXEL2 (r2, g2, b2);
-		    GFX.X2 [BUILD_PIXEL2 (r, g, b) & ~ALPHA_BITS_MASK] = BUILD_PIXEL2 (r2, g2, b2);
-		}
-	    }
-	}
-	ZeroMemory (GFX.ZERO, 0x10000 * sizeof (uint16));
-	ZeroMemory (GFX.ZERO_OR_X2, 0x10000 * sizeof (uint16));
-	// Build a lookup table that if the top bit of the color value is zero
-	// then the value is zero, otherwise multiply the value by 2. Used by
-	// the color subtraction code.
-
-#if defined(OLD_COLOUR_BLENDING)
-	for (r = 0; r <= MAX_RED; r++)
-	{
-	    uint32 r2 = r;
-	    if ((r2 & 0x10) == 0)
-		r2 = 0;
-	    else
-		r2 = (r2 << 1) & MAX_RED;
-
-	    for (g = 0; g <= MAX_GREEN; g++)
-	    {
-		uint32 g2 = g;
-		if ((g2 & GREEN_HI_BIT) == 0)
-		    g2 = 0;
-		else
-		    g2 = (g2 << 1) & MAX_GREEN;
-
-		for (b = 0; b <= MAX_BLUE; b++)
-		{
-		    uint32 b2 = b;
-		    if ((b2 & 0x10) == 0)
-			b2 = 0;
-		    else
-			b2 = (b2 << 1) & MAX_BLUE;
-
-		    GFX.ZERO_OR_X2 [BUILD_PIXEL2 (r, g, b)] = BUILD_PIXEL2 (r2, g2, b2);
-		    GFX.ZERO_OR_X2 [BUILD_PIXEL2 (r, g, b) & ~ALPHA_BITS_MASK] = BUILD_PIXEL2 (r2, g2, b2);
-		}
-	    }
-	}
-#else
-        for (r = 0; r <= MAX_RED; r++)
-        {
-            uint32 r2 = r;
-            if ((r2 & 0x10) == 0)
-                r2 = 0;
-            else
-                r2 = (r2 << 1) & MAX_RED;
-
-            if (r2 == 0)
-                r2 = 1;
-            for (g = 0; g <= MAX_GREEN; g++)
-            {
-                uint32 g2 = g;
-                if ((g2 & GREEN_HI_BIT) == 0)
-                    g2 = 0;
-                else
-                    g2 = (g2 << 1) & MAX_GREEN;
-
-                if (g2 == 0)
-                    g2 = 1;
-                for (b = 0; b <= MAX_BLUE; b++)
-                {
-                    uint32 b2 = b;
-                    if ((b2 & 0x10) == 0)
-                        b2 = 0;
-                    else
-                        b2 = (b2 << 1) & MAX_BLUE;
-
-                    if (b2 == 0)
-                        b2 = 1;
-                    GFX.ZERO_OR_X2 [BUILD_PIXEL2 (r, g, b)] = BUILD_PIXEL2 (r2, g2, b2);
-                    GFX.ZERO_OR_X2 [BUILD_PIXEL2 (r, g, b) & ~ALPHA_BITS_MASK] = BUILD_PIXEL2 (r2, g2, b2);
-                }
-            }
-        }
-#endif
-
-	// Build a lookup table that if the top bit of the color value is zero
-	// then the value is zero, otherwise its just the value.
-	for (r = 0; r <= MAX_RED; r++)
-	{
-	    uint32 r2 = r;
-	    if ((r2 & 0x10) == 0)
-		r2 = 0;
-	    else
-		r2 &= ~0x10;
-
-	    for (g = 0; g <= MAX_GREEN; g++)
-	    {
-		uint32 g2 = g;
-		if ((g2 & GREEN_HI_BIT) == 0)
-		    g2 = 0;
-		else
-		    g2 &= ~GREEN_HI_BIT;
-		for (b = 0; b <= MAX_BLUE; b++)
-		{
-		    uint32 b2 = b;
-		    if ((b2 & 0x10) == 0)
-			b2 = 0;
-		    else
-			b2 &= ~0x10;
-
-		    GFX.ZERO [BUILD_PIXEL2 (r, g, b)] = BUILD_PIXEL2 (r2, g2, b2);
-		    GFX.ZERO [BUILD_PIXEL2 (r, g, b) & ~ALPHA_BITS_MASK] = BUILD_PIXEL2 (r2, g2, b2);
-		}
-	    }
-	}
 #ifndef FOREVER_16_BIT
     }
     else
@@ -604,6 +523,7 @@ bool8 S9xGraphicsInit ()
 	GFX.ZERO = NULL;
     }
 #endif
+    ColourTablesBuilt = FALSE;
 
     return (TRUE);
 }
@@ -626,6 +546,7 @@ void S9xGraphicsDeinit (void)
 	free ((char *) GFX.ZERO);
 	GFX.ZERO = NULL;
     }
+    ColourTablesBuilt = FALSE;
 }
 
 void S9xBuildDirectColourMaps ()
@@ -3638,6 +3559,9 @@ void S9xUpdateScreen ()
     GFX.r212d = Memory.FillRAM [0x212d];
     GFX.r2130 = Memory.FillRAM [0x2130];
 
+    if (!ColourTablesBuilt)
+		BuildColourTables ();
+
 #ifdef JP_FIX
 
     GFX.Pseudo = (Memory.FillRAM [0x2133] & 8) != 0 &&
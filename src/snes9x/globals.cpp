@@ -109,13 +109,15 @@ char String[513];
 
 struct Missing missing;
 
-struct SICPU ICPU;
+// The state the CPU, APU and PPU loops read on every step starts on a
+// cache line of its own.
+struct SICPU ICPU CACHE_ALIGNED;
 
-struct SCPUState CPU;
+struct SCPUState CPU CACHE_ALIGNED;
 
-struct SAPU APU;
+struct SAPU APU CACHE_ALIGNED;
 
-struct SIAPU IAPU;
+struct SIAPU IAPU CACHE_ALIGNED;
 
 struct SSettings Settings;
 
@@ -123,7 +125,7 @@ struct SDSP1 DSP1;
 
 struct SSA1 SA1;
 
-SSoundData SoundData;
+SSoundData SoundData CACHE_ALIGNED;
 
 SnesModel M1SNES={1,3,2};
 SnesModel M2SNES={2,4,3};
@@ -154,8 +156,8 @@ uint8 *SFXPlotTable = NULL;
 END_EXTERN_C
 #endif
 
-struct SPPU PPU;
-struct InternalPPU IPPU;
+struct SPPU PPU CACHE_ALIGNED;
+struct InternalPPU IPPU CACHE_ALIGNED;
 
 struct SDMA DMA[8];
 
@@ -164,7 +166,7 @@ uint8 *HDMABasePointers [8];
 
 struct SBG BG;
 
-struct SGFX GFX;
+struct SGFX GFX CACHE_ALIGNED;
 struct SLineData LineData[240];
 struct SLineMatrixData LineMatrixData [240];
 
@@ -175,10 +177,29 @@ NormalTileRenderer DrawHiResTilePtr = NULL;
 ClippedTileRenderer DrawHiResClippedTilePtr = NULL;
 LargePixelRenderer DrawLargePixelPtr = NULL;
 
-uint32 odd_high[4][16];
-uint32 odd_low[4][16];
-uint32 even_high[4][16];
-uint32 even_low[4][16];
+// Tile conversion tables: entry [shift][i] spreads the four bits of nibble
+// i over four pixel bytes, leftmost pixel first, as bit 2 * shift (odd
+// bitplanes) or bit 2 * shift + 1 (even bitplanes) of each byte.
+#if defined(LSB_FIRST)
+#define TILE_BITS(p,i) ((((i) & 8) ? (p) : 0) | (((i) & 4) ? (p) << 8 : 0) | \
+			(((i) & 2) ? (p) << 16 : 0) | (((i) & 1) ? (uint32) (p) << 24 : 0))
+#else
+#define TILE_BITS(p,i) ((((i) & 8) ? (uint32) (p) << 24 : 0) | (((i) & 4) ? (p) << 16 : 0) | \
+			(((i) & 2) ? (p) << 8 : 0) | (((i) & 1) ? (p) : 0))
+#endif
+#define TILE_ROW(p) \
+    { TILE_BITS(p,0),  TILE_BITS(p,1),  TILE_BITS(p,2),  TILE_BITS(p,3), \
+      TILE_BITS(p,4),  TILE_BITS(p,5),  TILE_BITS(p,6),  TILE_BITS(p,7), \
+      TILE_BITS(p,8),  TILE_BITS(p,9),  TILE_BITS(p,10), TILE_BITS(p,11), \
+      TILE_BITS(p,12), TILE_BITS(p,13), TILE_BITS(p,14), TILE_BITS(p,15) }
+
+uint32 odd_high[4][16] = { TILE_ROW(1), TILE_ROW(4), TILE_ROW(16), TILE_ROW(64) };
+uint32 odd_low[4][16] = { TILE_ROW(1), TILE_ROW(4), TILE_ROW(16), TILE_ROW(64) };
+uint32 even_high[4][16] = { TILE_ROW(2), TILE_ROW(8), TILE_ROW(32), TILE_ROW(128) };
+uint32 even_low[4][16] = { TILE_ROW(2), TILE_ROW(8), TILE_ROW(32), TILE_ROW(128) };
+
+#undef TILE_ROW
+#undef TILE_BITS
 
 #ifdef GFX_MULTI_FORMAT
 
@@ -192,8 +192,26 @@ bool8 LoadZip(const char* zipname,
 	int FileSize = info.uncompressed_size;
 	
 	int calc_size = FileSize & ~0x1FFF; // round to lower 0x2000
-	
-	int l = unzReadCurrentFile(file,ptr,FileSize);
+	int header = 0;
+
+	// A copier header is inflated into a scratch block and dropped, so
+	// the image lands where it belongs instead of being moved down over
+	// it afterwards.
+	if (((FileSize - calc_size == 512 && !Settings.ForceNoHeader) ||
+	     Settings.ForceHeader) && FileSize >= 512)
+	{
+	    uint8 skip [512];
+
+	    header = unzReadCurrentFile(file,skip,512);
+	    if (header == 512)
+	    {
+		(*headers)++;
+		FileSize -= 512;
+	    }
+	}
+
+	int l = (header && header != 512) ? UNZ_EOF :
+	    unzReadCurrentFile(file,ptr,FileSize);
 	if(unzCloseCurrentFile(file) == UNZ_CRCERROR)
 	{
 	    unzClose(file);
@@ -221,15 +239,6 @@ bool8 LoadZip(const char* zipname,
 	    return (FALSE);
 	}
 
-	if ((FileSize - calc_size == 512 && !Settings.ForceNoHeader) ||
-	    Settings.ForceHeader)
-	{
-	    // memmove required: Overlapping addresses [Neb]
-	    // DS2 DMA notes: Can be split into 512-byte DMA blocks [Neb]
-	    memmove (ptr, ptr + 512, calc_size);
-	    (*headers)++;
-	    FileSize -= 512;
-	}
 	ptr += FileSize;
 	(*TotalFileSize) += FileSize;
 
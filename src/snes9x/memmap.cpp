@@ -95,6 +95,9 @@
 
 #ifdef __linux
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #endif
 
 #include "snes9x.h"
@@ -110,6 +113,7 @@
 #include "sdd1.h"
 #include "spc7110.h"
 #include "seta.h"
+#include "memplan.h"
 
 #include "unzip/unzip.h"
 
@@ -415,35 +419,48 @@ char *CMemory::Safe (const char *s)
 /**********************************************************************************************/
 bool8 CMemory::Init ()
 {
+#ifdef MEMORY_ARENA
+    // All of them live in one mapping; see memplan.h
+    S9xArenaInit ();
+#ifdef MMAP_ROM
+    ROMMapped = 0;
+#endif
+#else
     // DS2 DMA notes: These would do well to be allocated with 32 extra bytes
     // so they can be 32-byte aligned. [Neb]
-    RAM	    = (uint8 *) malloc (0x20000);
-    SRAM    = (uint8 *) malloc (0x20000);
-    VRAM    = (uint8 *) malloc (0x10000);
+    // calloc, as fresh pages from the system are zero already and are not
+    // touched until the game uses them.
+    RAM	    = (uint8 *) calloc (0x20000, 1);
+    SRAM    = (uint8 *) calloc (0x20000, 1);
+    VRAM    = (uint8 *) calloc (0x10000, 1);
 #ifdef DS2_DMA
     ROM     = (uint8 *) AlignedMalloc (MAX_ROM_SIZE + 0x200 + 0x8000, 32, &PtrAdj.ROM);
+#elif defined(MMAP_ROM)
+    // Page aligned, so that a ROM image can be mapped over it
+    ROM     = (uint8 *) mmap (NULL, MAX_ROM_SIZE + 0x200 + 0x8000, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ROM == (uint8 *) MAP_FAILED)
+		ROM = NULL;
+    ROMMapped = 0;
 #else
     ROM     = (uint8 *) malloc (MAX_ROM_SIZE + 0x200 + 0x8000);
 #endif
-	memset (RAM, 0, 0x20000);
-	memset (SRAM, 0, 0x20000);
-	memset (VRAM, 0, 0x10000);
 	// This needs to be initialised with a ROM first anyway, so don't
 	// bother memsetting. [Neb]
 	// memset (ROM, 0, MAX_ROM_SIZE + 0x200 + 0x8000);
     
-	BSRAM	= (uint8 *) malloc (0x80000);
-	memset (BSRAM, 0, 0x80000);
-
-	FillRAM = NULL;
+	BSRAM	= (uint8 *) calloc (0x80000, 1);
 	
-    IPPU.TileCache [TILE_2BIT] = (uint8 *) malloc (MAX_2BIT_TILES * 128);
-    IPPU.TileCache [TILE_4BIT] = (uint8 *) malloc (MAX_4BIT_TILES * 128);
-    IPPU.TileCache [TILE_8BIT] = (uint8 *) malloc (MAX_8BIT_TILES * 128);
+    IPPU.TileCache [TILE_2BIT] = (uint8 *) calloc (MAX_2BIT_TILES * 128, 1);
+    IPPU.TileCache [TILE_4BIT] = (uint8 *) calloc (MAX_4BIT_TILES * 128, 1);
+    IPPU.TileCache [TILE_8BIT] = (uint8 *) calloc (MAX_8BIT_TILES * 128, 1);
     
-    IPPU.TileCached [TILE_2BIT] = (uint8 *) malloc (MAX_2BIT_TILES);
-    IPPU.TileCached [TILE_4BIT] = (uint8 *) malloc (MAX_4BIT_TILES);
-    IPPU.TileCached [TILE_8BIT] = (uint8 *) malloc (MAX_8BIT_TILES);
+    IPPU.TileCached [TILE_2BIT] = (uint8 *) calloc (MAX_2BIT_TILES, 1);
+    IPPU.TileCached [TILE_4BIT] = (uint8 *) calloc (MAX_4BIT_TILES, 1);
+    IPPU.TileCached [TILE_8BIT] = (uint8 *) calloc (MAX_8BIT_TILES, 1);
+#endif
+
+	FillRAM = NULL;
     
     if (!RAM || !SRAM || !VRAM || !ROM || !BSRAM ||
         !IPPU.TileCache [TILE_2BIT] || !IPPU.TileCache [TILE_4BIT] ||
@@ -477,14 +494,6 @@ bool8 CMemory::Init ()
     SuperFX.nRomBanks = (2 * 1024 * 1024) / (32 * 1024);
     SuperFX.pvRom = (uint8 *) ROM;
 #endif
-
-    ZeroMemory (IPPU.TileCache [TILE_2BIT], MAX_2BIT_TILES * 128);
-    ZeroMemory (IPPU.TileCache [TILE_4BIT], MAX_4BIT_TILES * 128);
-    ZeroMemory (IPPU.TileCache [TILE_8BIT], MAX_8BIT_TILES * 128);
-
-    ZeroMemory (IPPU.TileCached [TILE_2BIT], MAX_2BIT_TILES);
-    ZeroMemory (IPPU.TileCached [TILE_4BIT], MAX_4BIT_TILES);
-    ZeroMemory (IPPU.TileCached [TILE_8BIT], MAX_8BIT_TILES);
     
     SDD1Data = NULL;
     SDD1Index = NULL;
@@ -499,6 +508,12 @@ void CMemory::Deinit ()
 		MessageBox(GUI.hWnd, "CMemory::Deinit", "Heap Corrupt", MB_OK);
 #endif
 
+#ifdef MEMORY_ARENA
+    S9xArenaDeinit ();
+#ifdef MMAP_ROM
+    ROMMapped = 0;
+#endif
+#else
     if (RAM)
     {
 		free ((char *) RAM);
@@ -519,6 +534,9 @@ void CMemory::Deinit ()
 		ROM -= 0x8000;
 #ifdef DS2_RAM
 		AlignedFree ((char *) ROM, PtrAdj.ROM);
+#elif defined(MMAP_ROM)
+		munmap (ROM, MAX_ROM_SIZE + 0x200 + 0x8000);
+		ROMMapped = 0;
 #else
 		free ((char *) ROM);
 #endif
@@ -562,6 +580,7 @@ void CMemory::Deinit ()
 		free ((char *) IPPU.TileCached [TILE_8BIT]);
 		IPPU.TileCached [TILE_8BIT] = NULL;
     }
+#endif
     FreeSDD1Data ();
 	Safe(NULL);
 }
@@ -585,6 +604,164 @@ void CMemory::FreeSDD1Data ()
 /* This function loads a Snes-Backup image                                                    */
 /**********************************************************************************************/
 
+#ifdef ROM_CRC_CACHE
+// Checksum and CRC32 of recently loaded images, so loading a known ROM
+// again skips both passes over the whole image. An entry is keyed by the
+// file's path, size and modification time, plus the settings that change
+// how the loader transforms the image; patched images are never cached.
+// The cache is a text file of one entry per line, newest first.
+#define ROM_CACHE_FILE		"romcrc.cache"
+#define ROM_CACHE_ENTRIES	64
+
+struct SROMCacheKey
+{
+    char   path [_MAX_PATH + 1];
+    uint32 size;
+    uint32 mtime;
+    uint32 flags;
+};
+
+static SROMCacheKey ROMCacheKey;
+static bool8 ROMCacheKeyValid = FALSE;
+static bool8 ROMPatched = FALSE;
+
+static const char *ROMCacheFilename ()
+{
+    static char fname [_MAX_PATH + 1];
+
+    snprintf (fname, sizeof (fname), "%s" SLASH_STR "%s",
+			  S9xGetSnapshotDirectory (), ROM_CACHE_FILE);
+    return (fname);
+}
+
+// A Game Doctor "sf1234xa" name, whose parts follow as ...xb, ...xc.
+static bool8 IsGameDoctorSplit (const char *name)
+{
+    int len = strlen (name);
+
+    return ((len == 7 || len == 8) && strncasecmp (name, "sf", 2) == 0 &&
+			isdigit (name [2]) && isdigit (name [3]) && isdigit (name [4]) &&
+			isdigit (name [5]) && isalpha (name [len - 1]));
+}
+
+// The first part of a split image, name.1 or a Game Doctor set; name and
+// ext are as _splitpath gives them. The loader reads the parts one after
+// the other.
+static bool8 IsSplitImage (const char *name, const char *ext)
+{
+    return ((isdigit (ext [0]) && ext [1] == 0) || IsGameDoctorSplit (name));
+}
+
+// Called once the loader has the image in memory; the key is used by the
+// InitROM that follows, unless the image turns out to be patched.
+static void ROMCacheSetKey (const char *filename)
+{
+    struct stat st;
+    char drive [_MAX_DRIVE + 1], dir [_MAX_DIR + 1];
+    char name [_MAX_FNAME + 1], ext [_MAX_EXT + 1];
+
+    ROMCacheKeyValid = FALSE;
+    ROMPatched = FALSE;
+    if (strlen (filename) > _MAX_PATH)
+		return;
+    // A split image is more than the one file
+    _splitpath (filename, drive, dir, name, ext);
+    if (IsSplitImage (name, ext))
+		return;
+    if (stat (filename, &st) != 0 || strlen (filename) > _MAX_PATH)
+		return;
+
+    strcpy (ROMCacheKey.path, filename);
+    ROMCacheKey.size = st.st_size;
+    ROMCacheKey.mtime = st.st_mtime;
+    ROMCacheKey.flags = (Settings.ForceHeader << 0) |
+		(Settings.ForceNoHeader << 1) | (Settings.ForceInterleaved << 2) |
+		(Settings.ForceInterleaved2 << 3) | (Settings.ForceNotInterleaved << 4) |
+		(Settings.ForceInterleaveGD24 << 5) | (Settings.ForceLoROM << 6) |
+		(Settings.ForceHiROM << 7);
+    ROMCacheKeyValid = TRUE;
+}
+
+// Reads an entry line; FALSE if it is malformed.
+static bool8 ROMCacheParse (const char *line, SROMCacheKey *key,
+							uint32 *checksum, uint32 *crc32)
+{
+    int n = 0;
+
+    if (sscanf (line, "%x %x %x %x %x %n", crc32, checksum, &key->size,
+				&key->mtime, &key->flags, &n) != 5 || n == 0)
+		return (FALSE);
+
+    strncpy (key->path, line + n, _MAX_PATH);
+    key->path [_MAX_PATH] = 0;
+    key->path [strcspn (key->path, "\r\n")] = 0;
+    return (key->path [0] != 0);
+}
+
+static bool8 ROMCacheMatch (const SROMCacheKey *a, const SROMCacheKey *b)
+{
+    return (a->size == b->size && a->mtime == b->mtime &&
+			a->flags == b->flags && strcmp (a->path, b->path) == 0);
+}
+
+static bool8 ROMCacheFind (uint32 *checksum, uint32 *crc32)
+{
+    char line [_MAX_PATH + 64];
+    SROMCacheKey key;
+    bool8 found = FALSE;
+    FILE *fp;
+
+    if (!ROMCacheKeyValid || ROMPatched ||
+		!(fp = fopen (ROMCacheFilename (), "r")))
+		return (FALSE);
+
+    while (!found && fgets (line, sizeof (line), fp))
+		found = ROMCacheParse (line, &key, checksum, crc32) &&
+			ROMCacheMatch (&key, &ROMCacheKey);
+    fclose (fp);
+    return (found);
+}
+
+// Puts the current image's entry first and drops the oldest ones.
+static void ROMCacheStore (uint32 checksum, uint32 crc32)
+{
+    char line [_MAX_PATH + 64];
+    char temp [_MAX_PATH + 8];
+    SROMCacheKey key;
+    uint32 c1, c2;
+    FILE *in, *out;
+    int entries = 1;
+
+    if (!ROMCacheKeyValid || ROMPatched)
+		return;
+
+    const char *fname = ROMCacheFilename ();
+    snprintf (temp, sizeof (temp), "%s.tmp", fname);
+    if (!(out = fopen (temp, "w")))
+		return;
+
+    fprintf (out, "%08x %04x %x %x %x %s\n", crc32, checksum,
+			 ROMCacheKey.size, ROMCacheKey.mtime, ROMCacheKey.flags,
+			 ROMCacheKey.path);
+
+    if ((in = fopen (fname, "r")))
+    {
+		while (entries < ROM_CACHE_ENTRIES && fgets (line, sizeof (line), in))
+		{
+			if (!ROMCacheParse (line, &key, &c1, &c2) ||
+				strcmp (key.path, ROMCacheKey.path) == 0)
+				continue;
+			fputs (line, out);
+			entries++;
+		}
+		fclose (in);
+    }
+
+    if (fclose (out) != 0 || rename (temp, fname) != 0)
+		remove (temp);
+}
+#endif
+
 bool8 CMemory::LoadROM (const char *filename)
 {
     int32 TotalFileSize = 0;
@@ -608,6 +785,8 @@ bool8 CMemory::LoadROM (const char *filename)
     CalculatedSize = 0;
 	retry_count =0;
 
+	S9xArenaRelease ();
+
 again:
 	Settings.DisplayColor=0xffff;
 	SET_UI_COLOR(255,255,255);
@@ -616,8 +795,12 @@ again:
 
 	if (!TotalFileSize)
 		return FALSE;		// it ends here
-	else if(!Settings.NoPatch)
-		CheckForIPSPatch (filename, HeaderCount != 0, TotalFileSize);
+
+#ifdef ROM_CRC_CACHE
+	ROMCacheSetKey (ROMFilename);
+#endif
+	if(!Settings.NoPatch)
+		CheckForAnyPatch (filename, HeaderCount != 0, TotalFileSize);
 
 	//fix hacked games here.
 	if((strncmp("HONKAKUHA IGO GOSEI", (char*)&ROM[0x7FC0],19)==0)&&(ROM[0x7FD5]!=0x31))
@@ -888,13 +1071,99 @@ again:
     return (TRUE);
 }
 
+#ifdef MMAP_ROM
+// Maps a plain ROM image, one with no copier header, over the ROM buffer.
+// The mapping is private: only the pages the loader writes to, patching
+// or deinterleaving, get a copy of their own; the rest stay shared with
+// the page cache. A header would put the image at an offset mmap cannot
+// map to the buffer's page-aligned start.
+bool8 CMemory::MapROM (const char *fname, int32 maxsize, int32 *size)
+{
+    struct stat st;
+    bool8 mapped = FALSE;
+
+    int fd = open (fname, O_RDONLY);
+    if (fd < 0)
+		return (FALSE);
+
+    if (fstat (fd, &st) == 0 && st.st_size > 0 && st.st_size <= maxsize &&
+		!Settings.ForceHeader &&
+		((st.st_size & 0x1FFF) != 512 || Settings.ForceNoHeader))
+    {
+		uint32 page = getpagesize ();
+		uint32 len = (st.st_size + page - 1) & ~(page - 1);
+
+		if (mmap (ROM, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+				  fd, 0) != MAP_FAILED)
+		{
+			ROMMapped = len;
+			*size = st.st_size;
+			mapped = TRUE;
+		}
+    }
+    close (fd);
+    return (mapped);
+}
+
+// Puts anonymous memory back where the last image was mapped.
+void CMemory::UnmapROM ()
+{
+    if (ROMMapped)
+    {
+		mmap (ROM, ROMMapped, PROT_READ | PROT_WRITE,
+			  MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+		ROMMapped = 0;
+    }
+}
+#endif
+
+// A gzip-compressed image. The uncompressed size, taken from the gzip
+// trailer, says whether there is a copier header, and the header is
+// skipped while inflating instead of being moved out afterwards.
+static bool8 LoadGzip (const char *fname, int32 *TotalFileSize,
+					   int32 *headers, uint8 *buffer, int32 maxsize)
+{
+    FILE *fp;
+    uint8 trailer [4];
+    int32 size;
+
+    if ((fp = fopen (fname, "rb")) == NULL)
+		return (FALSE);
+    if (fseek (fp, -4, SEEK_END) != 0 || fread (trailer, 1, 4, fp) != 4)
+    {
+		fclose (fp);
+		return (FALSE);
+    }
+    fclose (fp);
+    size = trailer [0] | (trailer [1] << 8) | (trailer [2] << 16) | (trailer [3] << 24);
+
+    gzFile gz = gzopen (fname, "rb");
+    if (gz == NULL)
+		return (FALSE);
+
+    *headers = 0;
+    if (((size & 0x1FFF) == 512 && !Settings.ForceNoHeader) ||
+		Settings.ForceHeader)
+    {
+		if (gzseek (gz, 512, SEEK_SET) != 512)
+		{
+			gzclose (gz);
+			return (FALSE);
+		}
+		(*headers)++;
+    }
+
+    *TotalFileSize = gzread (gz, buffer, maxsize);
+    gzclose (gz);
+    return (*TotalFileSize > 0);
+}
+
 uint32 CMemory::FileLoader (uint8* buffer, const char* filename, int32 maxsize)
 {
 
  
 	FILE* ROMFile;
 	int32 TotalFileSize = 0;
-	int len = 0;
 	int nFormat=DEFAULT;
  
 	char dir [_MAX_DIR + 1];
@@ -911,6 +1180,12 @@ uint32 CMemory::FileLoader (uint8* buffer, const char* filename, int32 maxsize)
     
 	_splitpath (filename, drive, dir, name, ext);
     _makepath (fname, drive, dir, name, ext);
+
+#ifdef MMAP_ROM
+	// Whatever is loaded now goes to the buffer's own memory, unless it
+	// is mapped again.
+	UnmapROM ();
+#endif
 	
 #ifdef __WIN32__
 	// memmove required: Overlapping addresses [Neb]
@@ -921,6 +1196,8 @@ uint32 CMemory::FileLoader (uint8* buffer, const char* filename, int32 maxsize)
 		nFormat = ZIP;
 	else if (strcasecmp (ext, "rar") == 0)
 		nFormat = RAR;
+	else if (strcasecmp (ext, "gz") == 0)
+		nFormat = GZIP;
 	else
 		nFormat = DEFAULT;
 
@@ -956,6 +1233,13 @@ uint32 CMemory::FileLoader (uint8* buffer, const char* filename, int32 maxsize)
 #endif
 		break;
 
+	case GZIP:
+		if (!LoadGzip (fname, &TotalFileSize, &HeaderCount, ROM, maxsize))
+			return (0);
+
+		strcpy (ROMFilename, fname);
+		break;
+
 	case RAR:
 		// non existant rar loading
 		S9xMessage (S9X_ERROR, S9X_ROM_INFO, "Rar Archives are not currently supported.");
@@ -965,6 +1249,16 @@ uint32 CMemory::FileLoader (uint8* buffer, const char* filename, int32 maxsize)
 	case DEFAULT:
 	default:
 		// any other roms go here
+#ifdef MMAP_ROM
+		// Split images are read, so that the parts line up
+		if (!IsSplitImage (name, ext) &&
+			MapROM (fname, maxsize, &TotalFileSize))
+		{
+			strcpy (ROMFilename, fname);
+			HeaderCount = 0;
+			break;
+		}
+#endif
 		if ((ROMFile = fopen(fname, "rb")) == NULL)
 			return (0);
 		
@@ -1022,14 +1316,10 @@ uint32 CMemory::FileLoader (uint8* buffer, const char* filename, int32 maxsize)
 #endif
 				_makepath (fname, drive, dir, name, ext);
 			}
-			else if (ptr - ROM < maxsize + 0x200 &&
-					(((len = strlen (name)) == 7 || len == 8) &&
-					strncasecmp (name, "sf", 2) == 0 &&
-					isdigit (name [2]) && isdigit (name [3]) && isdigit (name [4]) &&
-					isdigit (name [5]) && isalpha (name [len - 1])))
+			else if (ptr - ROM < maxsize + 0x200 && IsGameDoctorSplit (name))
 			{
 				more = TRUE;
-				name [len - 1]++;
+				name [strlen (name) - 1]++;
 #ifdef __WIN32__
 				// memmove required: Overlapping addresses [Neb]
 				memmove (&ext [1], &ext [0], 4);
@@ -1086,6 +1376,8 @@ bool8 CMemory::LoadMulti (const char *basename, const char *slot1name, const cha
     memset (bytes0x2000, 0, 0x2000);
 	
     CalculatedSize = 0;
+
+	S9xArenaRelease ();
 	
 	Settings.DisplayColor=0xffff;
 	SET_UI_COLOR(255,255,255);
@@ -1094,7 +1386,7 @@ bool8 CMemory::LoadMulti (const char *basename, const char *slot1name, const cha
 	
 	if(0== TotalFileSize)
 		return FALSE;
-	else CheckForIPSPatch (basename, HeaderCount != 0, TotalFileSize);
+	else CheckForAnyPatch (basename, HeaderCount != 0, TotalFileSize);
 	
 	CalculatedSize=TotalFileSize;
 
@@ -1109,7 +1401,7 @@ bool8 CMemory::LoadMulti (const char *basename, const char *slot1name, const cha
 		
 		if(0== TotalFileSize)
 			return FALSE;
-		else CheckForIPSPatch (slot1name, HeaderCount != 0, TotalFileSize);
+		else CheckForAnyPatch (slot1name, HeaderCount != 0, TotalFileSize);
 		ROMOffset1=&ROM[offset];
 		Slot1Size=TotalFileSize;
 	}
@@ -1122,7 +1414,7 @@ bool8 CMemory::LoadMulti (const char *basename, const char *slot1name, const cha
 		
 		if(0== TotalFileSize)
 			return FALSE;
-		else CheckForIPSPatch (slot2name, HeaderCount != 0, TotalFileSize);
+		else CheckForAnyPatch (slot2name, HeaderCount != 0, TotalFileSize);
 		ROMOffset2=&ROM[offset];
 		Slot2Size=TotalFileSize;
 	}
@@ -1299,10 +1591,49 @@ void S9xDeinterleaveType2 (bool8 reset)
 	}
 }
 
+// Slicing-by-8: crc32Slice[k] advances a byte's CRC by k more zero bytes,
+// so eight bytes are folded in per step instead of one.
+static uint32 crc32Slice [8][256];
+static bool8 crc32SliceReady = FALSE;
+
+static void InitCRC32Slices ()
+{
+    for (int i = 0; i < 256; i++)
+    {
+		uint32 c = crc32Table [i];
+		crc32Slice [0][i] = c;
+		for (int k = 1; k < 8; k++)
+		{
+			c = crc32Table [c & 0xFF] ^ (c >> 8);
+			crc32Slice [k][i] = c;
+		}
+    }
+    crc32SliceReady = TRUE;
+}
+
 //CRC32 for char arrays
 uint32 caCRC32(uint8 *array, uint32 size, register uint32 crc32)
 {
-  for (register uint32 i = 0; i < size; i++)
+  register uint32 i = 0;
+
+  if (!crc32SliceReady)
+    InitCRC32Slices ();
+
+  // Bytes are assembled one by one: the buffer need not be aligned, and
+  // the result does not depend on the host's byte order.
+  for (; i + 8 <= size; i += 8)
+  {
+    uint32 lo = crc32 ^ (array[i] | (array[i + 1] << 8) |
+                         (array[i + 2] << 16) | (array[i + 3] << 24));
+    uint32 hi = array[i + 4] | (array[i + 5] << 8) |
+                (array[i + 6] << 16) | (array[i + 7] << 24);
+
+    crc32 = crc32Slice[7][lo & 0xFF] ^ crc32Slice[6][(lo >> 8) & 0xFF] ^
+            crc32Slice[5][(lo >> 16) & 0xFF] ^ crc32Slice[4][lo >> 24] ^
+            crc32Slice[3][hi & 0xFF] ^ crc32Slice[2][(hi >> 8) & 0xFF] ^
+            crc32Slice[1][(hi >> 16) & 0xFF] ^ crc32Slice[0][hi >> 24];
+  }
+  for (; i < size; i++)
   {
     crc32 = ((crc32 >> 8) & 0x00FFFFFF) ^ crc32Table[(crc32 ^ array[i]) & 0xFF];
   }
@@ -1529,6 +1860,13 @@ void CMemory::InitROM (bool8 Interleaved)
 
 	uint32 sum1 = 0;
 	uint32 sum2 = 0;
+#ifdef ROM_CRC_CACHE
+	uint32 cached_sum, cached_crc;
+	bool8 cached = ROMCacheFind (&cached_sum, &cached_crc);
+
+	if (cached && 0==CalculatedChecksum)
+		CalculatedChecksum = cached_sum;
+#endif
 	if(0==CalculatedChecksum)
 	{
 		int power2 = 0;
@@ -1576,7 +1914,19 @@ void CMemory::InitROM (bool8 Interleaved)
     Memory.CalculatedChecksum=sum1;
 	}
     //now take a CRC32
+#ifdef ROM_CRC_CACHE
+    if (cached)
+		ROMCRC32 = cached_crc;
+    else
+    {
+		ROMCRC32 = caCRC32(ROM, CalculatedSize);
+		ROMCacheStore (CalculatedChecksum, ROMCRC32);
+    }
+    // Only the load that set the key may use it.
+    ROMCacheKeyValid = FALSE;
+#else
     ROMCRC32 = caCRC32(ROM, CalculatedSize);
+#endif
 
 	if (Settings.ForceNTSC)
 		Settings.PAL = FALSE;
@@ -1670,6 +2020,9 @@ void CMemory::InitROM (bool8 Interleaved)
 	Settings.ForceHeader = Settings.ForceHiROM = Settings.ForceLoROM = 
 		Settings.ForceInterleaved = Settings.ForceNoHeader = Settings.ForceNotInterleaved = 
 		Settings.ForceInterleaved2=false;
+
+	SyncHotMap (0, MEMMAP_NUM_BLOCKS);
+	S9xMemoryPlanUpdate ();
 }
 
 bool8 CMemory::LoadSRAM (const char *filename)
@@ -1678,6 +2031,7 @@ bool8 CMemory::LoadSRAM (const char *filename)
 	       (1 << (Memory.SRAMSize + 3)) * 128 : 0;
 	
     memset (SRAM, SNESGameFixes.SRAMInitialValue, 0x20000);
+    S9xDirtyMarkRange (DIRTY_SRAM, 0, 0x20000);
 	
     if (size > 0x20000)
 		size = 0x20000;
@@ -1719,6 +2073,22 @@ bool8 CMemory::LoadSRAM (const char *filename)
     return (TRUE);
 }
 
+// Bytes of cartridge SRAM that go to the .srm file, without the S-RTC's
+// clock; 0 if the cartridge has none or it is not saved.
+int CMemory::SRAMSaveSize ()
+{
+	if(Settings.SuperFX && Memory.ROMType < 0x15)
+		return 0;
+	if(Settings.SA1 && Memory.ROMType == 0x34)
+		return 0;
+
+    int size = Memory.SRAMSize ?
+	       (1 << (Memory.SRAMSize + 3)) * 128 : 0;
+    if (size > 0x20000)
+		size = 0x20000;
+    return (size);
+}
+
 bool8 CMemory::SaveSRAM (const char *filename)
 {
 	if(Settings.SuperFX && Memory.ROMType < 0x15)
@@ -1726,8 +2096,7 @@ bool8 CMemory::SaveSRAM (const char *filename)
 	if(Settings.SA1 && Memory.ROMType == 0x34)
 		return TRUE;
 
-    int size = Memory.SRAMSize ?
-	       (1 << (Memory.SRAMSize + 3)) * 128 : 0;
+    int size = SRAMSaveSize ();
     if (Settings.SRTC)
     {
 		size += SRTC_SRAM_PAD;
@@ -1739,18 +2108,30 @@ bool8 CMemory::SaveSRAM (const char *filename)
 	
     if (size && *Memory.ROMFilename)
     {
+		// Written under another name and renamed over the old file, so
+		// an interrupted save cannot leave a truncated one behind.
+		char temp [_MAX_PATH + 8];
+		sprintf (temp, "%s.tmp", filename);
 
-		FILE *file= fopen(filename, "w");
+		FILE *file= fopen(temp, "wb");
 		if (file)
 		{
-			fwrite((unsigned char *) ::SRAM, size, 1, file);
-			fclose(file);
-			if(Settings.SPC7110RTC)
+			bool8 ok = fwrite((unsigned char *) ::SRAM, size, 1, file) == 1;
+			ok = fflush(file) == 0 && ok;
+#ifdef __linux
+			ok = fsync(fileno(file)) == 0 && ok;
+#endif
+			ok = fclose(file) == 0 && ok;
+			if (ok && rename(temp, filename) == 0)
 			{
-				S9xSaveSPC7110RTC (&rtc_f9);
-			}
+				if(Settings.SPC7110RTC)
+				{
+					S9xSaveSPC7110RTC (&rtc_f9);
+				}
 
-			return (TRUE);
+				return (TRUE);
+			}
+			remove(temp);
 		}
     }
     return (FALSE);
@@ -1769,6 +2150,19 @@ void CMemory::FixROMSpeed ()
 		if (c&0x8 || c&0x400)
 			MemorySpeed [c] = (uint8) CPU.FastROMSpeed;
     }
+	SyncHotMap (0x800, 0x800);
+}
+
+// To be called whenever Map, WriteMap, MemorySpeed or BlockIsRAM change.
+void CMemory::SyncHotMap (int start, int count)
+{
+    for (int c = start; c < start + count; c++)
+    {
+		HotMap [c].Map = Map [c];
+		HotMap [c].WriteMap = WriteMap [c];
+		HotMap [c].Speed = MemorySpeed [c];
+		HotMap [c].IsRAM = BlockIsRAM [c];
+    }
 }
 
 
@@ -3597,6 +3991,8 @@ void CMemory::SPC7110Sram(uint8 newstate)
 		Memory.Map[0x306]=(uint8 *)MAP_RONLY_SRAM;
 		Memory.Map[0x307]=(uint8 *)MAP_RONLY_SRAM;
 	}
+	SyncHotMap (6, 2);
+	SyncHotMap (0x306, 2);
 }
 const char *CMemory::TVStandard ()
 {
@@ -4273,120 +4669,298 @@ void CMemory::ApplyROMFixes ()
 	//BNE
 }
 
-// Read variable size MSB int from a file
-static long ReadInt (FILE *f, unsigned nbytes)
-{
-    long v = 0;
-    while (nbytes--)
-    {
-		int c = fgetc(f);
-		if (c == EOF) 
-			return -1;
-		v = (v << 8) | (c & 0xFF);
-    }
-    return (v);
-}
-
+// Soft patches. A patch file is read whole and applied from memory; IPS
+// records go straight into the ROM, UPS ones too, being XORs, and BPS
+// rebuilds the image from a copy of the original. UPS and BPS carry CRC32s
+// of the original, the result and the patch itself, and are only kept if
+// all three match.
 #define IPS_EOF 0x00454F46l
+#define PATCH_MAX_SIZE	(CMemory::MAX_ROM_SIZE + 0x10000)
 
-void CMemory::CheckForIPSPatch (const char *rom_filename, bool8 header,
-								int32 &rom_size)
+static uint8 *ReadPatch (const char *rom_filename, const char *ext, int32 *size)
 {
     char  dir [_MAX_DIR + 1];
     char  drive [_MAX_DRIVE + 1];
     char  name [_MAX_FNAME + 1];
-    char  ext [_MAX_EXT + 1];
+    char  oldext [_MAX_EXT + 1];
     char  fname [_MAX_PATH + 1];
-    FILE  *patch_file  = NULL;
-    long  offset = header ? 512 : 0;
-	
-    _splitpath (rom_filename, drive, dir, name, ext);
-    _makepath (fname, drive, dir, name, "ips");
-    
-    if (!(patch_file = fopen (fname, "rb")))
+    char  sext [_MAX_EXT + 2];
+    FILE  *patch_file;
+    uint8 *patch = NULL;
+    long  len;
+
+    _splitpath (rom_filename, drive, dir, name, oldext);
+    _makepath (fname, drive, dir, name, ext);
+    sprintf (sext, ".%s", ext);
+
+    if (!(patch_file = fopen (fname, "rb")) &&
+		!(patch_file = fopen (S9xGetFilename (sext), "rb")))
+		return (NULL);
+
+    if (fseek (patch_file, 0, SEEK_END) == 0 &&
+		(len = ftell (patch_file)) > 0 && len <= PATCH_MAX_SIZE &&
+		fseek (patch_file, 0, SEEK_SET) == 0 &&
+		(patch = (uint8 *) malloc (len)) != NULL &&
+		fread (patch, 1, len, patch_file) != (size_t) len)
     {
-		if (!(patch_file = fopen (S9xGetFilename (".ips"), "rb")))
-			return;
+		free (patch);
+		patch = NULL;
     }
-	
-    if (fread ((unsigned char*)fname, 1, 5, patch_file) != 5 ||
-		strncmp (fname, "PATCH", 5) != 0)
+    fclose (patch_file);
+    *size = patch ? len : 0;
+    return (patch);
+}
+
+static uint32 PatchGet32 (const uint8 *p)
+{
+    return (p [0] | (p [1] << 8) | (p [2] << 16) | ((uint32) p [3] << 24));
+}
+
+// The variable length numbers of UPS and BPS
+static bool8 PatchVarint (const uint8 *&p, const uint8 *end, uint32 &value)
+{
+    uint32 shift = 1;
+
+    value = 0;
+    while (p < end)
     {
-		fclose (patch_file);
-		return;
+		uint8 x = *p++;
+		value += (x & 0x7f) * shift;
+		if (x & 0x80)
+			return (TRUE);
+		shift <<= 7;
+		value += shift;
     }
-	
-    int32 ofs;
-	
+    return (FALSE);
+}
+
+static bool8 ApplyIPS (uint8 *rom, const uint8 *patch, int32 size,
+					   long offset, int32 &rom_size)
+{
+    const uint8 *p = patch + 5, *end = patch + size;
+
+    if (size < 5 || strncmp ((const char *) patch, "PATCH", 5) != 0)
+		return (FALSE);
+
     for (;;)
     {
-		long len;
-		long rlen;
-		int  rchar;
-		
-		ofs = ReadInt (patch_file, 3);
-		if (ofs == -1)
-			goto err_eof;
-		
-		if (ofs == IPS_EOF) 
+		if (end - p < 3)
+			return (TRUE);
+		int32 ofs = (p [0] << 16) | (p [1] << 8) | p [2];
+		p += 3;
+		if (ofs == IPS_EOF)
 			break;
-		
 		ofs -= offset;
-		
-        len = ReadInt (patch_file, 2);
-		if (len == -1)
-			goto err_eof;
-		
+
+		if (end - p < 2)
+			return (TRUE);
+		int32 len = (p [0] << 8) | p [1];
+		p += 2;
+
 		/* Apply patch block */
 		if (len)
 		{
-			if (ofs + len > MAX_ROM_SIZE)
-				goto err_eof;
-			
-			while (len--)
-			{
-				rchar = fgetc (patch_file);
-				if (rchar == EOF) 
-					goto err_eof;
-				ROM [ofs++] = (uint8) rchar;
-            }
-			if (ofs > rom_size)
-				rom_size = ofs;
+			if (ofs < 0 || ofs + len > CMemory::MAX_ROM_SIZE || end - p < len)
+				return (TRUE);
+			memcpy (rom + ofs, p, len);
+			p += len;
 		}
 		else
 		{
-			rlen = ReadInt (patch_file, 2);
-			if (rlen == -1) 
-				goto err_eof;
-			
-			rchar = fgetc (patch_file);
-			if (rchar == EOF) 
-				goto err_eof;
-			
-			if (ofs + rlen > MAX_ROM_SIZE)
-				goto err_eof;
-			
-			while (rlen--) 
-				ROM [ofs++] = (uint8) rchar;
-			
-			if (ofs > rom_size)
-				rom_size = ofs;
+			if (end - p < 3)
+				return (TRUE);
+			len = (p [0] << 8) | p [1];
+			if (ofs < 0 || ofs + len > CMemory::MAX_ROM_SIZE)
+				return (TRUE);
+			memset (rom + ofs, p [2], len);
+			p += 3;
 		}
+		if (ofs + len > rom_size)
+			rom_size = ofs + len;
     }
-	
+
     // Check if ROM image needs to be truncated
-    ofs = ReadInt (patch_file, 3);
-    if (ofs != -1 && ofs - offset < rom_size)
+    if (end - p >= 3)
     {
-		// Need to truncate ROM image
-		rom_size = ofs - offset;
+		int32 ofs = ((p [0] << 16) | (p [1] << 8) | p [2]) - offset;
+		if (ofs < rom_size)
+			rom_size = ofs;
     }
-    fclose (patch_file);
-    return;
-	
-err_eof:
-    if (patch_file) 
-		fclose (patch_file);
+    return (TRUE);
+}
+
+// Applies the XOR records to rom; doing it twice puts the image back.
+static bool8 XorUPS (uint8 *rom, const uint8 *p, const uint8 *end)
+{
+    uint32 ofs = 0, skip;
+
+    while (p < end)
+    {
+		if (!PatchVarint (p, end, skip))
+			return (FALSE);
+		ofs += skip;
+		while (p < end && *p)
+		{
+			if (ofs >= (uint32) CMemory::MAX_ROM_SIZE)
+				return (FALSE);
+			rom [ofs++] ^= *p++;
+		}
+		p++;
+		ofs++;
+    }
+    return (TRUE);
+}
+
+static bool8 ApplyUPS (uint8 *rom, const uint8 *patch, int32 size, int32 &rom_size)
+{
+    const uint8 *p = patch + 4, *end = patch + size - 12;
+    uint32 in_size, out_size;
+
+    if (size < 16 || strncmp ((const char *) patch, "UPS1", 4) != 0)
+		return (FALSE);
+    if (caCRC32 ((uint8 *) patch, size - 4) != PatchGet32 (end + 8) ||
+		!PatchVarint (p, end, in_size) || !PatchVarint (p, end, out_size) ||
+		out_size > (uint32) CMemory::MAX_ROM_SIZE)
+    {
+		S9xMessage (S9X_ERROR, S9X_ROM_INFO, "UPS patch is corrupt");
+		return (FALSE);
+    }
+
+    if (in_size != (uint32) rom_size || caCRC32 (rom, rom_size) != PatchGet32 (end))
+    {
+		S9xMessage (S9X_ERROR, S9X_ROM_INFO, "UPS patch is for a different ROM");
+		return (FALSE);
+    }
+
+    // Bytes past the original are patched from zero
+    if (out_size > in_size)
+		memset (rom + in_size, 0, out_size - in_size);
+
+    bool8 ok = XorUPS (rom, p, end);
+    if (!ok || caCRC32 (rom, out_size) != PatchGet32 (end + 4))
+    {
+		XorUPS (rom, p, end);
+		S9xMessage (S9X_ERROR, S9X_ROM_INFO, "UPS patch is corrupt");
+		return (FALSE);
+    }
+    rom_size = out_size;
+    return (TRUE);
+}
+
+static bool8 ApplyBPS (uint8 *rom, const uint8 *patch, int32 size, int32 &rom_size)
+{
+    const uint8 *p = patch + 4, *end = patch + size - 12;
+    uint32 in_size, out_size, meta_size;
+
+    if (size < 16 || strncmp ((const char *) patch, "BPS1", 4) != 0)
+		return (FALSE);
+    if (caCRC32 ((uint8 *) patch, size - 4) != PatchGet32 (end + 8) ||
+		!PatchVarint (p, end, in_size) || !PatchVarint (p, end, out_size) ||
+		!PatchVarint (p, end, meta_size) || meta_size > (uint32) (end - p) ||
+		out_size > (uint32) CMemory::MAX_ROM_SIZE)
+    {
+		S9xMessage (S9X_ERROR, S9X_ROM_INFO, "BPS patch is corrupt");
+		return (FALSE);
+    }
+    p += meta_size;
+
+    if (in_size != (uint32) rom_size || caCRC32 (rom, rom_size) != PatchGet32 (end))
+    {
+		S9xMessage (S9X_ERROR, S9X_ROM_INFO, "BPS patch is for a different ROM");
+		return (FALSE);
+    }
+
+    uint8 *source = (uint8 *) malloc (in_size);
+    if (!source)
+		return (FALSE);
+    memcpy (source, rom, in_size);
+
+    uint32 out = 0, source_rel = 0, target_rel = 0, data, len;
+    bool8 ok = TRUE;
+
+    while (ok && p < end && out < out_size)
+    {
+		if (!PatchVarint (p, end, data))
+			break;
+		len = (data >> 2) + 1;
+		if (len > out_size - out)
+			break;
+
+		switch (data & 3)
+		{
+		case 0:	// SourceRead
+			if (out > in_size || len > in_size - out)
+				ok = FALSE;
+			else
+				memcpy (rom + out, source + out, len);
+			out += len;
+			break;
+		case 1:	// TargetRead
+			if ((uint32) (end - p) < len)
+				ok = FALSE;
+			else
+				memcpy (rom + out, p, len);
+			p += len;
+			out += len;
+			break;
+		case 2:	// SourceCopy
+			if (!PatchVarint (p, end, data))
+				ok = FALSE;
+			// Relative, and may go backwards; one that wraps round is
+			// caught by the bound, which cannot overflow itself
+			source_rel += (data & 1) ? -(int32) (data >> 1) : (data >> 1);
+			if (!ok || source_rel > in_size || len > in_size - source_rel)
+				ok = FALSE;
+			else
+				memcpy (rom + out, source + source_rel, len);
+			source_rel += len;
+			out += len;
+			break;
+		case 3:	// TargetCopy, which may overlap what it writes
+			if (!PatchVarint (p, end, data))
+				ok = FALSE;
+			target_rel += (data & 1) ? -(int32) (data >> 1) : (data >> 1);
+			// The copy only ever reads bytes it has already written
+			if (!ok || target_rel >= out)
+				ok = FALSE;
+			else
+				while (len--)
+					rom [out++] = rom [target_rel++];
+			break;
+		}
+    }
+
+    if (!ok || out != out_size || caCRC32 (rom, out_size) != PatchGet32 (end + 4))
+    {
+		memcpy (rom, source, in_size);
+		free (source);
+		S9xMessage (S9X_ERROR, S9X_ROM_INFO, "BPS patch is corrupt");
+		return (FALSE);
+    }
+    free (source);
+    rom_size = out_size;
+    return (TRUE);
+}
+
+void CMemory::CheckForAnyPatch (const char *rom_filename, bool8 header,
+								int32 &rom_size)
+{
+    uint8 *patch;
+    int32 size;
+    bool8 patched = FALSE;
+
+    if ((patch = ReadPatch (rom_filename, "bps", &size)))
+		patched = ApplyBPS (ROM, patch, size, rom_size);
+    else if ((patch = ReadPatch (rom_filename, "ups", &size)))
+		patched = ApplyUPS (ROM, patch, size, rom_size);
+    else if ((patch = ReadPatch (rom_filename, "ips", &size)))
+		patched = ApplyIPS (ROM, patch, size, header ? 512 : 0, rom_size);
+    free (patch);
+
+#ifdef ROM_CRC_CACHE
+    if (patched)
+		ROMPatched = TRUE;
+#endif
 }
 
 int is_bsx(unsigned char *p)
@@ -0,0 +1,171 @@
+/*
+ * Memory plan and arena; see memplan.h.
+ */
+#include <string.h>
+#if defined(__unix) || defined(__linux)
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#endif
+
+#include "snes9x.h"
+#include "memmap.h"
+#include "ppu.h"
+#include "memplan.h"
+
+SMemoryPlan MemoryPlan;
+
+#define ROM_AREA_SIZE (CMemory::MAX_ROM_SIZE + 0x200 + 0x8000)
+
+#define TILE_CACHE_SIZE ((MAX_2BIT_TILES + MAX_4BIT_TILES + MAX_8BIT_TILES) * 129)
+
+#ifdef MEMORY_ARENA
+static uint8 *Arena = NULL;
+static uint32 ArenaSize = 0;
+
+// The ROM area comes first, so that the image after the 32K of registers
+// starts on a page and can be mapped there. Each block is page aligned,
+// so that it can be given back on its own.
+static struct {
+    uint8  **ptr;
+    uint32 size;
+} Blocks [] = {
+    { &Memory.ROM, ROM_AREA_SIZE },
+    { &Memory.RAM, 0x20000 },
+    { &Memory.SRAM, 0x20000 },
+    { &Memory.VRAM, 0x10000 },
+    { &Memory.BSRAM, 0x80000 },
+    { &IPPU.TileCache [TILE_2BIT], MAX_2BIT_TILES * 128 },
+    { &IPPU.TileCache [TILE_4BIT], MAX_4BIT_TILES * 128 },
+    { &IPPU.TileCache [TILE_8BIT], MAX_8BIT_TILES * 128 },
+    { &IPPU.TileCached [TILE_2BIT], MAX_2BIT_TILES },
+    { &IPPU.TileCached [TILE_4BIT], MAX_4BIT_TILES },
+    { &IPPU.TileCached [TILE_8BIT], MAX_8BIT_TILES }
+};
+
+#define NUM_BLOCKS (sizeof (Blocks) / sizeof (Blocks [0]))
+
+static uint32 PageAlign (uint32 size)
+{
+    uint32 page = getpagesize ();
+    return ((size + page - 1) & ~(page - 1));
+}
+
+// Drops the pages wholly inside a block; they read as zero afterwards.
+static void Release (uint8 *ptr, uint32 size)
+{
+    uint32 page = getpagesize ();
+    unsigned long start = ((unsigned long) ptr + page - 1) & ~(unsigned long) (page - 1);
+    unsigned long end = ((unsigned long) ptr + size) & ~(unsigned long) (page - 1);
+
+    if (end > start)
+		madvise ((void *) start, end - start, MADV_DONTNEED);
+}
+#endif
+
+// Sets up the arena and points every block at its place in it; they stay
+// NULL if the mapping fails.
+bool8 S9xArenaInit ()
+{
+#ifdef MEMORY_ARENA
+    uint32 i, offset = 0;
+
+    ArenaSize = 0;
+    for (i = 0; i < NUM_BLOCKS; i++)
+		ArenaSize += PageAlign (Blocks [i].size);
+
+    Arena = (uint8 *) mmap (NULL, ArenaSize, PROT_READ | PROT_WRITE,
+							MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (Arena == (uint8 *) MAP_FAILED)
+    {
+		Arena = NULL;
+		ArenaSize = 0;
+		return (FALSE);
+    }
+
+    for (i = 0; i < NUM_BLOCKS; i++)
+    {
+		*Blocks [i].ptr = Arena + offset;
+		offset += PageAlign (Blocks [i].size);
+    }
+
+#ifdef MADV_HUGEPAGE
+    // The image is read all over, a few bytes at a time, and a TLB of 4K
+    // pages covers little of it. Where the kernel has transparent huge
+    // pages it may back the image with them; the small blocks are left
+    // alone, as a huge page would make them cost 2M each.
+    madvise (Memory.ROM, PageAlign (ROM_AREA_SIZE), MADV_HUGEPAGE);
+#endif
+    return (TRUE);
+#else
+    return (FALSE);
+#endif
+}
+
+void S9xArenaDeinit ()
+{
+#ifdef MEMORY_ARENA
+    uint32 i;
+
+    if (Arena)
+		munmap (Arena, ArenaSize);
+    Arena = NULL;
+    ArenaSize = 0;
+    for (i = 0; i < NUM_BLOCKS; i++)
+		*Blocks [i].ptr = NULL;
+#endif
+}
+
+// Called before a ROM is loaded: whatever the last game left in the image,
+// the BS-X pack and the tile caches is of no use to the next one. The
+// registers at the start of the ROM area are left alone.
+void S9xArenaRelease ()
+{
+#ifdef MEMORY_ARENA
+    if (!Arena)
+		return;
+
+    Release (Memory.ROM, CMemory::MAX_ROM_SIZE + 0x200);
+    Release (Memory.BSRAM, 0x80000);
+    Release (IPPU.TileCache [TILE_2BIT], MAX_2BIT_TILES * 128);
+    Release (IPPU.TileCache [TILE_4BIT], MAX_4BIT_TILES * 128);
+    Release (IPPU.TileCache [TILE_8BIT], MAX_8BIT_TILES * 128);
+    Release (IPPU.TileCached [TILE_2BIT], MAX_2BIT_TILES);
+    Release (IPPU.TileCached [TILE_4BIT], MAX_4BIT_TILES);
+    Release (IPPU.TileCached [TILE_8BIT], MAX_8BIT_TILES);
+#endif
+}
+
+// Called once the header is parsed and the chips are known.
+void S9xMemoryPlanUpdate ()
+{
+    MemoryPlan.rom = Memory.CalculatedSize;
+
+    // The SuperFX and the SA-1 use the whole SRAM buffer as work RAM
+    if (Settings.SuperFX || Settings.SA1)
+		MemoryPlan.sram = 0x20000;
+    else if (Memory.SRAMSize)
+		MemoryPlan.sram = (1 << (Memory.SRAMSize + 3)) * 128;
+    else
+		MemoryPlan.sram = 0;
+    if (MemoryPlan.sram > 0x20000)
+		MemoryPlan.sram = 0x20000;
+
+    MemoryPlan.bsram = Settings.BS ? 0x80000 : 0;
+    MemoryPlan.fixed = 0x8000 + 0x20000 + 0x10000 + TILE_CACHE_SIZE +
+		(Settings.C4 ? 0x2000 : 0);
+    MemoryPlan.total = MemoryPlan.rom + MemoryPlan.sram + MemoryPlan.bsram +
+		MemoryPlan.fixed;
+}
+
+// Peak resident set size of the process in KB, or 0 where unknown.
+uint32 S9xPeakRSS ()
+{
+#if defined(__unix) || defined(__linux)
+    struct rusage usage;
+
+    if (getrusage (RUSAGE_SELF, &usage) == 0)
+		return ((uint32) usage.ru_maxrss);
+#endif
+    return (0);
+}
@@ -3233,6 +3233,7 @@ void REGISTER_2118 (uint8 Byte)
     IPPU.TileCached [TILE_2BIT][address >> 4] = FALSE;
     IPPU.TileCached [TILE_4BIT][address >> 5] = FALSE;
     IPPU.TileCached [TILE_8BIT][address >> 6] = FALSE;
+    DIRTY_MARK (VRAM, address);
     if (!PPU.VMA.High)
     {
 #ifdef DEBUGGER
@@ -3259,6 +3260,7 @@ void REGISTER_2118_tile (uint8 Byte)
     IPPU.TileCached [TILE_2BIT][address >> 4] = FALSE;
     IPPU.TileCached [TILE_4BIT][address >> 5] = FALSE;
     IPPU.TileCached [TILE_8BIT][address >> 6] = FALSE;
+    DIRTY_MARK (VRAM, address);
     if (!PPU.VMA.High)
     PPU.VMA.Address += PPU.VMA.Increment;
 //    Memory.FillRAM [0x2118] = Byte;
@@ -3271,6 +3273,7 @@ void REGISTER_2118_linear (uint8 Byte)
     IPPU.TileCached [TILE_2BIT][address >> 4] = FALSE;
     IPPU.TileCached [TILE_4BIT][address >> 5] = FALSE;
     IPPU.TileCached [TILE_8BIT][address >> 6] = FALSE;
+    DIRTY_MARK (VRAM, address);
     if (!PPU.VMA.High)
     PPU.VMA.Address += PPU.VMA.Increment;
 //    Memory.FillRAM [0x2118] = Byte;
@@ -3294,6 +3297,7 @@ void REGISTER_2119 (uint8 Byte)
     IPPU.TileCached [TILE_2BIT][address >> 4] = FALSE;
     IPPU.TileCached [TILE_4BIT][address >> 5] = FALSE;
     IPPU.TileCached [TILE_8BIT][address >> 6] = FALSE;
+    DIRTY_MARK (VRAM, address);
     if (PPU.VMA.High)
     {
 #ifdef DEBUGGER
@@ -3319,6 +3323,7 @@ void REGISTER_2119_tile (uint8 Byte)
     IPPU.TileCached [TILE_2BIT][address >> 4] = FALSE;
     IPPU.TileCached [TILE_4BIT][address >> 5] = FALSE;
     IPPU.TileCached [TILE_8BIT][address >> 6] = FALSE;
+    DIRTY_MARK (VRAM, address);
     if (PPU.VMA.High)
     PPU.VMA.Address += PPU.VMA.Increment;
 //    Memory.FillRAM [0x2119] = Byte;
@@ -3331,6 +3336,7 @@ void REGISTER_2119_linear (uint8 Byte)
     IPPU.TileCached [TILE_2BIT][address >> 4] = FALSE;
     IPPU.TileCached [TILE_4BIT][address >> 5] = FALSE;
     IPPU.TileCached [TILE_8BIT][address >> 6] = FALSE;
+    DIRTY_MARK (VRAM, address);
     if (PPU.VMA.High)
     PPU.VMA.Address += PPU.VMA.Increment;
 //    Memory.FillRAM [0x2119] = Byte;
@@ -3397,6 +3403,7 @@ void REGISTER_2122(uint8 Byte)
 
 void REGISTER_2180(uint8 Byte)
 {
+    DIRTY_MARK (RAM, PPU.WRAM);
     Memory.RAM[PPU.WRAM++] = Byte;
     PPU.WRAM &= 0x1FFFF;
     Memory.FillRAM [0x2180] = Byte;
@@ -0,0 +1,240 @@
+/*
+ * Output resampler for the sound mixer.
+ *
+ * Polyphase windowed-sinc filter, fixed point throughout so it stays cheap
+ * on FPU-less MIPS handhelds. The coefficient table is built once per rate
+ * change; the per-sample work is RESAMPLER_TAPS multiply-adds per channel.
+ */
+#include <string.h>
+#include <math.h>
+#if defined(__unix) || defined(__linux)
+#include <sys/time.h>
+#endif
+
+#include "snes9x.h"
+#include "soundux.h"
+#include "resampler.h"
+
+#define RESAMPLER_TAPS 8
+#define RESAMPLER_PHASE_BITS 8
+#define RESAMPLER_PHASES (1 << RESAMPLER_PHASE_BITS)
+#define RESAMPLER_COEF_SHIFT 14
+#define RESAMPLER_FRAC_SHIFT 16
+#define RESAMPLER_FRAC_ONE (1 << RESAMPLER_FRAC_SHIFT)
+
+// Passband edge as a fraction of the lower of the two Nyquist frequencies.
+#define RESAMPLER_CUTOFF 0.90
+
+// Room for one full mixer call plus the filter history.
+#define RESAMPLER_FIFO_SIZE (SOUND_BUFFER_SIZE + RESAMPLER_TAPS * 2)
+
+SResamplerStats ResamplerStats;
+
+static int16 Filter [RESAMPLER_PHASES][RESAMPLER_TAPS];
+static int16 Fifo [RESAMPLER_FIFO_SIZE];
+
+static int InRate;
+static int OutRate;
+static int Channels;
+
+// Fill is in frames. The read position is PosInt frames plus PosFrac/65536,
+// with PosErr carrying the remainder of the 16.16 step so the long-run rate
+// is exact.
+static int Fill;
+static uint32 PosInt;
+static uint32 PosFrac;
+static uint32 PosErr;
+static uint32 StepInt;
+static uint32 StepFrac;
+static uint32 StepErr;
+
+static double Sinc (double x)
+{
+    if (fabs (x) < 1e-9)
+		return (1.0);
+    return (sin (M_PI * x) / (M_PI * x));
+}
+
+static void BuildFilter (double cutoff)
+{
+    const double centre = RESAMPLER_TAPS / 2 - 1;
+
+    for (int p = 0; p < RESAMPLER_PHASES; p++)
+    {
+		double c [RESAMPLER_TAPS];
+		double sum = 0.0;
+		int k;
+
+		for (k = 0; k < RESAMPLER_TAPS; k++)
+		{
+			double x = k - centre - (double) p / RESAMPLER_PHASES;
+			// Blackman window over the filter span
+			double w = 0.42 + 0.5 * cos (2.0 * M_PI * x / RESAMPLER_TAPS) +
+				0.08 * cos (4.0 * M_PI * x / RESAMPLER_TAPS);
+			c [k] = cutoff * Sinc (cutoff * x) * w;
+			sum += c [k];
+		}
+
+		// Normalise each phase to unity gain so there is no DC ripple
+		// between phases, then push the rounding error into the centre tap.
+		int total = 0;
+		for (k = 0; k < RESAMPLER_TAPS; k++)
+		{
+			Filter [p][k] = (int16) floor (c [k] / sum * (1 << RESAMPLER_COEF_SHIFT) + 0.5);
+			total += Filter [p][k];
+		}
+		Filter [p][(int) centre] += (1 << RESAMPLER_COEF_SHIFT) - total;
+    }
+}
+
+bool8 S9xResamplerInit (int in_rate, int out_rate, int channels)
+{
+    if (in_rate <= 0 || out_rate <= 0 || channels < 1 || channels > 2)
+		return (FALSE);
+
+    if (in_rate != InRate || out_rate != OutRate)
+    {
+		double cutoff = RESAMPLER_CUTOFF;
+		if (out_rate < in_rate)
+			cutoff *= (double) out_rate / in_rate;
+		BuildFilter (cutoff);
+    }
+
+    InRate = in_rate;
+    OutRate = out_rate;
+    Channels = channels;
+
+    StepInt = in_rate / out_rate;
+    StepFrac = (uint32) (((int64) (in_rate % out_rate) << RESAMPLER_FRAC_SHIFT) / out_rate);
+    StepErr = (uint32) (((int64) (in_rate % out_rate) << RESAMPLER_FRAC_SHIFT) % out_rate);
+
+    S9xResamplerReset ();
+    S9xResamplerResetStats ();
+    return (TRUE);
+}
+
+void S9xResamplerReset ()
+{
+    memset (Fifo, 0, sizeof (Fifo));
+    Fill = 0;
+    PosInt = 0;
+    PosFrac = 0;
+    PosErr = 0;
+}
+
+void S9xResamplerResetStats ()
+{
+    memset (&ResamplerStats, 0, sizeof (ResamplerStats));
+}
+
+int S9xResamplerRequired (int out_frames)
+{
+    if (out_frames <= 0)
+		return (0);
+
+    // Position of the last output sample of this run, without the
+    // sub-fraction error term (it can only ever add one frac unit).
+    int64 last = ((int64) PosInt << RESAMPLER_FRAC_SHIFT) + PosFrac + 1 +
+		(int64) (out_frames - 1) * ((StepInt << RESAMPLER_FRAC_SHIFT) + StepFrac + 1);
+    int need = (int) (last >> RESAMPLER_FRAC_SHIFT) + RESAMPLER_TAPS - Fill;
+
+    if (need < 0)
+		need = 0;
+    if ((Fill + need) * Channels > RESAMPLER_FIFO_SIZE)
+		need = RESAMPLER_FIFO_SIZE / Channels - Fill;
+    return (need);
+}
+
+int16 *S9xResamplerWritePtr ()
+{
+    return (&Fifo [Fill * Channels]);
+}
+
+void S9xResamplerPush (int in_frames)
+{
+    Fill += in_frames;
+    ResamplerStats.in_frames += in_frames;
+}
+
+#define RESAMPLER_ADVANCE() \
+    PosInt += StepInt; \
+    PosFrac += StepFrac; \
+    if ((PosErr += StepErr) >= (uint32) OutRate) \
+    { \
+		PosErr -= OutRate; \
+		PosFrac++; \
+    } \
+    PosInt += PosFrac >> RESAMPLER_FRAC_SHIFT; \
+    PosFrac &= RESAMPLER_FRAC_ONE - 1;
+
+void S9xResamplerRun (int16 *out, int out_frames)
+{
+#if defined(__unix) || defined(__linux)
+    struct timeval start, end;
+    gettimeofday (&start, NULL);
+#endif
+    int i;
+
+    for (i = 0; i < out_frames; i++)
+    {
+		// Never read past what the mixer has produced; an underfed run
+		// repeats the last frame rather than reading stale history.
+		if ((int) PosInt + RESAMPLER_TAPS > Fill)
+			break;
+
+		const int16 *c = Filter [PosFrac >> (RESAMPLER_FRAC_SHIFT - RESAMPLER_PHASE_BITS)];
+		const int16 *s = &Fifo [PosInt * Channels];
+		int32 l, r;
+
+		if (Channels == 2)
+		{
+			l = s [ 0] * c [0] + s [ 2] * c [1] + s [ 4] * c [2] + s [ 6] * c [3] +
+			    s [ 8] * c [4] + s [10] * c [5] + s [12] * c [6] + s [14] * c [7];
+			r = s [ 1] * c [0] + s [ 3] * c [1] + s [ 5] * c [2] + s [ 7] * c [3] +
+			    s [ 9] * c [4] + s [11] * c [5] + s [13] * c [6] + s [15] * c [7];
+			l >>= RESAMPLER_COEF_SHIFT;
+			r >>= RESAMPLER_COEF_SHIFT;
+			if (l < -32768) l = -32768; else if (l > 32767) l = 32767;
+			if (r < -32768) r = -32768; else if (r > 32767) r = 32767;
+			out [i * 2 + 0] = (int16) l;
+			out [i * 2 + 1] = (int16) r;
+		}
+		else
+		{
+			l = s [0] * c [0] + s [1] * c [1] + s [2] * c [2] + s [3] * c [3] +
+			    s [4] * c [4] + s [5] * c [5] + s [6] * c [6] + s [7] * c [7];
+			l >>= RESAMPLER_COEF_SHIFT;
+			if (l < -32768) l = -32768; else if (l > 32767) l = 32767;
+			out [i] = (int16) l;
+		}
+
+		RESAMPLER_ADVANCE ()
+    }
+
+    for (; i < out_frames; i++)
+    {
+		if (i == 0)
+			memset (out, 0, Channels * sizeof (int16));
+		else
+			memcpy (&out [i * Channels], &out [(i - 1) * Channels], Channels * sizeof (int16));
+    }
+
+    // Drop the consumed input, keeping the history the next run needs.
+    int consumed = (int) PosInt;
+    if (consumed > Fill)
+		consumed = Fill;
+    if (consumed)
+    {
+		memmove (Fifo, &Fifo [consumed * Channels], (Fill - consumed) * Channels * sizeof (int16));
+		Fill -= consumed;
+		PosInt -= consumed;
+    }
+
+    ResamplerStats.out_frames += out_frames;
+    ResamplerStats.calls++;
+#if defined(__unix) || defined(__linux)
+    gettimeofday (&end, NULL);
+    ResamplerStats.usec += (end.tv_sec - start.tv_sec) * 1000000 +
+		(end.tv_usec - start.tv_usec);
+#endif
+}
@@ -0,0 +1,443 @@
+/*
+ * Rewind buffer: XOR deltas between consecutive snapshots in a fixed ring.
+ *
+ * A delta is a list of (skip, length, bytes) runs, the lengths as 7-bit
+ * varints and the bytes the XOR of the two states, so applying it to the
+ * newer state gives back the older one. Work RAM, VRAM, SRAM and APU RAM
+ * pages nothing wrote to since the last capture are skipped unread; other
+ * whole pages that did not change are skipped with one memcmp. Inside a
+ * changed page a run only ends after REWIND_MIN_GAP equal bytes, which
+ * keeps the run headers from costing more than they save.
+ */
+#include <string.h>
+#include <stdlib.h>
+#if defined(__unix) || defined(__linux)
+#include <sys/time.h>
+#endif
+
+#include "snes9x.h"
+#include "snapshot.h"
+#include "dirty.h"
+#include "rewind.h"
+
+#define REWIND_MIN_GAP 8
+
+typedef struct {
+    uint32 offset;
+    uint32 size;
+    uint32 prev_len;
+} SRewindEntry;
+
+typedef struct {
+    uint32 start;
+    uint32 end;
+} SRewindRange;
+
+SRewindStats RewindStats;
+
+static SSnapshotMem Latest;	// the newest state, in full
+static SSnapshotMem Capture;	// the state being captured
+
+static uint8 *Ring = NULL;
+static uint32 RingSize = 0;
+static uint32 RingWrite = 0;
+static SRewindEntry Entries [REWIND_MAX_STATES];
+static int EntryFirst = 0;	// oldest
+static int EntryCount = 0;
+
+static uint8 *Delta = NULL;	// encoder output before it goes in the ring
+static uint32 DeltaSize = 0;
+
+static int Interval = 1;
+static int Frames = 0;
+
+// Where each tracked region sits in a state, and the ranges of the state
+// being captured that the dirty map vouches for.
+static const char *RegionBlock [DIRTY_REGIONS] = { "RAM", "VRA", "SRA", "ARA" };
+static int32 LatestBlock [DIRTY_REGIONS];
+static SRewindRange Clean [DIRTY_PAGES];
+static int CleanCount = 0;
+
+static bool8 Reserve (uint8 **buf, uint32 *size, uint32 need)
+{
+    if (*size >= need)
+		return (TRUE);
+
+    uint8 *p = (uint8 *) realloc (*buf, need);
+    if (!p)
+		return (FALSE);
+    *buf = p;
+    *size = need;
+    return (TRUE);
+}
+
+// XOR needs both states the same length; the shorter one reads as zeros.
+static bool8 PadState (SSnapshotMem *mem, uint32 len)
+{
+    if (!Reserve (&mem->data, &mem->size, len))
+		return (FALSE);
+    if (len > mem->used)
+		memset (mem->data + mem->used, 0, len - mem->used);
+    return (TRUE);
+}
+
+static inline uint8 *PutVarint (uint8 *p, uint32 v)
+{
+    while (v >= 0x80)
+    {
+		*p++ = (uint8) (v | 0x80);
+		v >>= 7;
+    }
+    *p++ = (uint8) v;
+    return (p);
+}
+
+static inline const uint8 *GetVarint (const uint8 *p, uint32 *v)
+{
+    uint32 r = 0;
+    int shift = 0;
+
+    do
+    {
+		r |= (uint32) (*p & 0x7f) << shift;
+		shift += 7;
+    } while (*p++ & 0x80);
+    *v = r;
+    return (p);
+}
+
+// Both buffers must hold len bytes and be word aligned.
+static uint32 EncodeDelta (uint8 *out, const uint8 *cur, const uint8 *prev, uint32 len)
+{
+    uint8 *p = out;
+    uint32 pos = 0;
+    uint32 last = 0;
+
+    const SRewindRange *clean = Clean;
+    const SRewindRange *clean_end = Clean + CleanCount;
+
+    RewindStats.pages_skipped = 0;
+    RewindStats.pages_total = (len + REWIND_PAGE_SIZE - 1) / REWIND_PAGE_SIZE;
+    RewindStats.bytes_clean = 0;
+
+    while (pos < len)
+    {
+		if (clean < clean_end && pos >= clean->start)
+		{
+			if (pos < clean->end)
+			{
+				RewindStats.bytes_clean += clean->end - pos;
+				pos = clean->end;
+			}
+			clean++;
+			continue;
+		}
+		if (!(pos & (REWIND_PAGE_SIZE - 1)) && pos + REWIND_PAGE_SIZE <= len &&
+			!memcmp (cur + pos, prev + pos, REWIND_PAGE_SIZE))
+		{
+			pos += REWIND_PAGE_SIZE;
+			RewindStats.pages_skipped++;
+			continue;
+		}
+		if (!(pos & 3) && pos + 4 <= len &&
+			*(const uint32 *) (cur + pos) == *(const uint32 *) (prev + pos))
+		{
+			pos += 4;
+			continue;
+		}
+		if (cur [pos] == prev [pos])
+		{
+			pos++;
+			continue;
+		}
+
+		uint32 start = pos;
+		uint32 gap = 0;
+		while (pos < len && gap < REWIND_MIN_GAP)
+		{
+			if (cur [pos] == prev [pos])
+				gap++;
+			else
+				gap = 0;
+			pos++;
+		}
+		uint32 end = pos - gap;
+
+		p = PutVarint (p, start - last);
+		p = PutVarint (p, end - start);
+		for (uint32 i = start; i < end; i++)
+			*p++ = cur [i] ^ prev [i];
+		last = end;
+    }
+
+    return (p - out);
+}
+
+static void ApplyDelta (uint8 *state, const uint8 *delta, uint32 size)
+{
+    const uint8 *p = delta;
+    const uint8 *end = delta + size;
+    uint32 pos = 0;
+
+    while (p < end)
+    {
+		uint32 skip, len;
+
+		p = GetVarint (p, &skip);
+		p = GetVarint (p, &len);
+		pos += skip;
+		for (uint32 i = 0; i < len; i++)
+			state [pos + i] ^= p [i];
+		p += len;
+		pos += len;
+    }
+}
+
+// Lists, in state order, the parts of Capture that are memory pages
+// nobody wrote since Latest was captured. Only regions found at the same
+// place in both states count; offset returns where they are in Capture.
+static void FindCleanRanges (int32 *offset)
+{
+    int r;
+
+    CleanCount = 0;
+    for (r = 0; r < DIRTY_REGIONS; r++)
+    {
+		uint32 len;
+
+		offset [r] = S9xSnapshotFindBlock (&Capture, RegionBlock [r], &len);
+		if (len != S9xDirtyRegionPages (r) << DIRTY_PAGE_SHIFT)
+			offset [r] = -1;
+    }
+    if (!Latest.used)
+		return;
+
+    for (int32 last = -1;;)
+    {
+		int next = -1;
+
+		for (r = 0; r < DIRTY_REGIONS; r++)
+			if (offset [r] > last && offset [r] == LatestBlock [r] &&
+				(next < 0 || offset [r] < offset [next]))
+				next = r;
+		if (next < 0)
+			break;
+		last = offset [next];
+
+		for (uint32 page = 0; page < S9xDirtyRegionPages (next); page++)
+		{
+			if (S9xDirtyTest (next, page, DIRTY_REWIND))
+				continue;
+
+			uint32 start = offset [next] + (page << DIRTY_PAGE_SHIFT);
+			if (CleanCount && Clean [CleanCount - 1].end == start)
+				Clean [CleanCount - 1].end += DIRTY_PAGE_SIZE;
+			else
+			{
+				Clean [CleanCount].start = start;
+				Clean [CleanCount].end = start + DIRTY_PAGE_SIZE;
+				CleanCount++;
+			}
+		}
+    }
+}
+
+static void DropOldest ()
+{
+    RewindStats.ring_used -= Entries [EntryFirst].size;
+    EntryFirst = (EntryFirst + 1) % REWIND_MAX_STATES;
+    EntryCount--;
+}
+
+// Finds size contiguous bytes at the write position, dropping the oldest
+// deltas until they fit. The ring is a byte FIFO that never splits an
+// entry; the tail left unused when it wraps is simply skipped.
+static uint8 *RingAlloc (uint32 size)
+{
+    if (size > RingSize)
+		return (NULL);
+
+    if (EntryCount == REWIND_MAX_STATES)
+		DropOldest ();
+
+    for (;;)
+    {
+		if (EntryCount == 0)
+		{
+			RingWrite = 0;
+			break;
+		}
+
+		uint32 oldest = Entries [EntryFirst].offset;
+		if (oldest >= RingWrite)
+		{
+			if (RingWrite + size <= oldest)
+				break;
+			DropOldest ();
+		}
+		else
+		{
+			if (RingWrite + size <= RingSize)
+				break;
+			RingWrite = 0;
+		}
+    }
+
+    uint8 *p = Ring + RingWrite;
+    RingWrite += size;
+    return (p);
+}
+
+bool8 S9xRewindInit (uint32 ring_size, int interval)
+{
+    S9xRewindDeinit ();
+
+    if (!(Ring = (uint8 *) malloc (ring_size)))
+		return (FALSE);
+    RingSize = ring_size;
+    Interval = interval > 0 ? interval : 1;
+
+    S9xRewindReset ();
+    RewindStats.ring_size = RingSize;
+    return (TRUE);
+}
+
+void S9xRewindDeinit ()
+{
+    if (Ring)
+		free (Ring);
+    Ring = NULL;
+    RingSize = 0;
+
+    if (Delta)
+		free (Delta);
+    Delta = NULL;
+    DeltaSize = 0;
+
+    S9xFreeSnapshotMem (&Latest);
+    S9xFreeSnapshotMem (&Capture);
+    memset (&RewindStats, 0, sizeof (RewindStats));
+}
+
+// Forget every state, e.g. when another ROM is loaded. Buffers are kept.
+void S9xRewindReset ()
+{
+    EntryFirst = 0;
+    EntryCount = 0;
+    RingWrite = 0;
+    Frames = 0;
+    Latest.used = 0;
+    for (int r = 0; r < DIRTY_REGIONS; r++)
+		LatestBlock [r] = -1;
+
+    RewindStats.states = 0;
+    RewindStats.ring_used = 0;
+    RewindStats.last_size = 0;
+}
+
+bool8 S9xRewindActive ()
+{
+    return (Ring != NULL);
+}
+
+// Called once per frame; stores a state every Interval frames.
+void S9xRewindCapture ()
+{
+    if (!Ring || ++Frames < Interval)
+		return;
+    Frames = 0;
+
+#if defined(__unix) || defined(__linux)
+    struct timeval start, end;
+    gettimeofday (&start, NULL);
+#endif
+
+    if (!S9xFreezeToMemory (&Capture))
+		return;
+
+    int32 offset [DIRTY_REGIONS];
+    FindCleanRanges (offset);
+
+    if (Latest.used)
+    {
+		uint32 len = Capture.used > Latest.used ? Capture.used : Latest.used;
+
+		if (!PadState (&Capture, len) || !PadState (&Latest, len) ||
+			!Reserve (&Delta, &DeltaSize, len + len / 4 + 64))
+			return;
+
+		uint32 size = EncodeDelta (Delta, Capture.data, Latest.data, len);
+		uint8 *slot = RingAlloc (size);
+
+		if (slot)
+		{
+			int n = (EntryFirst + EntryCount) % REWIND_MAX_STATES;
+
+			memcpy (slot, Delta, size);
+			Entries [n].offset = slot - Ring;
+			Entries [n].size = size;
+			Entries [n].prev_len = Latest.used;
+			EntryCount++;
+			RewindStats.ring_used += size;
+		}
+		else
+		{
+			// A delta larger than the whole ring; history restarts here.
+			S9xRewindReset ();
+		}
+		RewindStats.last_size = size;
+    }
+
+    // The captured state becomes the newest; its buffer is reused for the
+    // next capture.
+    SSnapshotMem t = Latest;
+    Latest = Capture;
+    Capture = t;
+    memcpy (LatestBlock, offset, sizeof (LatestBlock));
+    S9xDirtyClear (DIRTY_REWIND);
+
+#if defined(__unix) || defined(__linux)
+    gettimeofday (&end, NULL);
+    RewindStats.last_usec = (end.tv_sec - start.tv_sec) * 1000000 +
+		(end.tv_usec - start.tv_usec);
+    if (RewindStats.last_usec > RewindStats.peak_usec)
+		RewindStats.peak_usec = RewindStats.last_usec;
+#endif
+    RewindStats.states = EntryCount;
+    RewindStats.memory = RingSize + Latest.size + Capture.size + DeltaSize;
+}
+
+// Restores the newest stored state and steps the history back one
+// capture. Returns FALSE if there is nothing to go back to.
+bool8 S9xRewindStep ()
+{
+    if (!Ring || !Latest.used)
+		return (FALSE);
+
+    if (S9xUnfreezeFromMemory (&Latest) != SUCCESS)
+    {
+		S9xRewindReset ();
+		return (FALSE);
+    }
+    Frames = 0;
+
+    if (EntryCount)
+    {
+		int n = (EntryFirst + EntryCount - 1) % REWIND_MAX_STATES;
+		uint32 len = Entries [n].prev_len > Latest.used ? Entries [n].prev_len : Latest.used;
+
+		if (!PadState (&Latest, len))
+		{
+			S9xRewindReset ();
+			return (TRUE);
+		}
+		ApplyDelta (Latest.data, Ring + Entries [n].offset, Entries [n].size);
+		Latest.used = Entries [n].prev_len;
+
+		RewindStats.ring_used -= Entries [n].size;
+		RingWrite = Entries [n].offset;
+		EntryCount--;
+		RewindStats.states = EntryCount;
+    }
+    return (TRUE);
+}
@@ -0,0 +1,101 @@
+/*
+ * Run-ahead; see runahead.h.
+ *
+ * The state is kept as a raw copy (S9xFreezeRaw), which comes back exactly
+ * and costs a few memcpys instead of a snapshot load's reset and fixups.
+ * The hidden frames skip rendering, throttling and sound output: only the
+ * real frame feeds the audio device, and the mixer's own state is put back
+ * along with the machine.
+ */
+#include <string.h>
+#if defined(__unix) || defined(__linux)
+#include <sys/time.h>
+#endif
+
+#include "snes9x.h"
+#include "memmap.h"
+#include "cpuexec.h"
+#include "ppu.h"
+#include "soundux.h"
+#include "snapshot.h"
+#include "runahead.h"
+
+SRunAheadStats RunAheadStats;
+
+static SSnapshotMem State;
+static bool8 Hidden = FALSE;
+
+static uint32 Usec ()
+{
+#if defined(__unix) || defined(__linux)
+    struct timeval tv;
+    gettimeofday (&tv, NULL);
+    return (tv.tv_sec * 1000000 + tv.tv_usec);
+#else
+    return (0);
+#endif
+}
+
+void S9xRunAheadDeinit ()
+{
+    S9xFreeSnapshotMem (&State);
+    memset (&RunAheadStats, 0, sizeof (RunAheadStats));
+}
+
+// TRUE while a hidden frame runs; the port replays the real frame's input
+// then, and neither outputs sound nor waits for the display.
+bool8 S9xRunAheadHidden ()
+{
+    return (Hidden);
+}
+
+// Called after each real frame. The last hidden frame is drawn if the
+// frame skipper decided to draw the next one.
+bool8 S9xRunAheadFrame (int frames)
+{
+    if (frames <= 0)
+		return (FALSE);
+    if (frames > RUN_AHEAD_MAX_FRAMES)
+		frames = RUN_AHEAD_MAX_FRAMES;
+
+    uint32 start = Usec ();
+    bool8 render = IPPU.RenderThisFrame;
+
+    if (!S9xFreezeRaw (&State))
+		return (FALSE);
+    S9xSaveMixerState ();
+
+    // The hidden frames must not reach an SRAM autosave; the countdown
+    // comes back with the state. Batched mixing would render sound on
+    // each DSP write, so it is off for them too.
+    bool8 batch = Settings.SoundFrameBatch;
+
+    CPU.AutoSaveTimer = 0;
+    CPU.SRAMModified = FALSE;
+    Settings.SoundFrameBatch = FALSE;
+
+    uint32 saved = Usec ();
+
+    Hidden = TRUE;
+    for (int i = 1; i <= frames; i++)
+    {
+		IPPU.RenderThisFrame = render && i == frames;
+		S9xMainLoop ();
+    }
+    Hidden = FALSE;
+
+    uint32 restore = Usec ();
+
+    Settings.SoundFrameBatch = batch;
+    bool8 ok = S9xUnfreezeRaw (&State);
+    S9xRestoreMixerState ();
+
+    uint32 end = Usec ();
+
+    RunAheadStats.frames = frames;
+    RunAheadStats.last_usec = end - start;
+    RunAheadStats.save_usec = (saved - start) + (end - restore);
+    if (RunAheadStats.last_usec > RunAheadStats.peak_usec)
+		RunAheadStats.peak_usec = RunAheadStats.last_usec;
+    return (ok);
+}
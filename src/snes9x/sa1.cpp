@@ -96,6 +96,7 @@
 static void S9xSA1CharConv2 ();
 static void S9xSA1DMA ();
 static void S9xSA1ReadVariableLengthData (bool8 inc, bool8 no_shift);
+void S9xSetSA1MemMap (uint32 which1, uint8 map);
 
 void S9xSA1Init ()
 {
@@ -190,6 +191,8 @@ void S9xFixSA1AfterSnapshotLoad ()
     SA1.VirtualBitmapFormat = (Memory.FillRAM [0x223f] & 0x80) ? 2 : 4;
     Memory.BWRAM = Memory.SRAM + (Memory.FillRAM [0x2224] & 7) * 0x2000;
     S9xSA1SetBWRAMMemMap (Memory.FillRAM [0x2225]);
+    for (int i = 0; i < 4; i++)
+	S9xSetSA1MemMap (i, Memory.FillRAM [0x2220 + i]);
 
     SA1.Waiting = (Memory.FillRAM [0x2200] & 0x60) != 0;
     SA1.Executing = !SA1.Waiting;
@@ -395,6 +398,8 @@ void S9xSetSA1MemMap (uint32 which1, uint8 map)
 	for (i = c + 8; i < c + 16; i++)
 	    Memory.Map [start2 + i] = SA1.Map [start2 + i] = block;
     }
+    Memory.SyncHotMap (start, 0x100);
+    Memory.SyncHotMap (start2, 0x200);
 }
 
 uint8 S9xGetSA1 (uint32 address)
@@ -112,6 +112,7 @@ void S9xSetSDD1MemoryMap (uint32 bank, uint32 value)
 	for (i = c; i < c + 16; i++)
 	    Memory.Map [i + bank] = block;
     }
+    Memory.SyncHotMap (bank, 0x100);
 }
 
 void S9xResetSDD1 ()
@@ -0,0 +1,517 @@
+/*
+ * Sample-accurate S-DSP core.
+ *
+ * Follows the documented per-sample behaviour of the S-DSP: KON/KOFF are
+ * polled every other sample, envelopes step on the shared rate counter,
+ * BRR blocks are decoded four samples at a time and voices are resampled
+ * with the 4-tap Gaussian kernel. Register state is APU.DSP itself, so the
+ * SPC700 sees ENVX, OUTX and ENDX exactly as the DSP leaves them.
+ */
+#include <string.h>
+
+#include "snes9x.h"
+#include "apu.h"
+#include "soundux.h"
+#include "sdsp.h"
+#include "dirty.h"
+
+SSDSP SDSP;
+
+enum { ENV_RELEASE, ENV_ATTACK, ENV_DECAY, ENV_SUSTAIN };
+
+#define SDSP_BRR_BLOCK_SIZE 9
+#define SDSP_COUNTER_RANGE (2048 * 5 * 3)
+
+#define VREG(v,r) APU.DSP [((v) << 4) + (r)]
+
+#define CLAMP16(io) \
+    if ((int16) (io) != (io)) (io) = ((io) >> 31) ^ 0x7FFF
+
+// Envelope and noise rates: a rate fires on the samples where
+// (counter + offset) is a multiple of the period.
+static const uint32 CounterRates [32] =
+{
+    SDSP_COUNTER_RANGE + 1, // never fires
+          2048, 1536,
+    1280, 1024,  768,
+     640,  512,  384,
+     320,  256,  192,
+     160,  128,   96,
+      80,   64,   48,
+      40,   32,   24,
+      20,   16,   12,
+      10,    8,    6,
+       5,    4,    3,
+             2,
+             1
+};
+
+static const uint32 CounterOffsets [32] =
+{
+      1, 0, 1040,
+    536, 0, 1040,
+    536, 0, 1040,
+    536, 0, 1040,
+    536, 0, 1040,
+    536, 0, 1040,
+    536, 0, 1040,
+    536, 0, 1040,
+    536, 0, 1040,
+    536, 0, 1040,
+         0,
+         0
+};
+
+// Interpolation kernel, the S-DSP's own 512-entry ROM table, indexed as on
+// the chip: entry x weights a sample (511 - x) / 256 positions from the
+// output point. It peaks at 1305, and the four taps of any phase sum to
+// 2047-2049, unity gain at 2048.
+static const int16 Gauss [512] =
+{
+       0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,
+       1,    1,    1,    1,    1,    1,    1,    1,    1,    1,    1,    2,    2,    2,    2,    2,
+       2,    2,    3,    3,    3,    3,    3,    4,    4,    4,    4,    4,    5,    5,    5,    5,
+       6,    6,    6,    6,    7,    7,    7,    8,    8,    8,    9,    9,    9,   10,   10,   10,
+      11,   11,   11,   12,   12,   13,   13,   14,   14,   15,   15,   15,   16,   16,   17,   17,
+      18,   19,   19,   20,   20,   21,   21,   22,   23,   23,   24,   24,   25,   26,   27,   27,
+      28,   29,   29,   30,   31,   32,   32,   33,   34,   35,   36,   36,   37,   38,   39,   40,
+      41,   42,   43,   44,   45,   46,   47,   48,   49,   50,   51,   52,   53,   54,   55,   56,
+      58,   59,   60,   61,   62,   64,   65,   66,   67,   69,   70,   71,   73,   74,   76,   77,
+      78,   80,   81,   83,   84,   86,   87,   89,   90,   92,   94,   95,   97,   99,  100,  102,
+     104,  106,  107,  109,  111,  113,  115,  117,  118,  120,  122,  124,  126,  128,  130,  132,
+     134,  137,  139,  141,  143,  145,  147,  150,  152,  154,  156,  159,  161,  163,  166,  168,
+     171,  173,  175,  178,  180,  183,  186,  188,  191,  193,  196,  199,  201,  204,  207,  210,
+     212,  215,  218,  221,  224,  227,  230,  233,  236,  239,  242,  245,  248,  251,  254,  257,
+     260,  263,  267,  270,  273,  276,  280,  283,  286,  290,  293,  297,  300,  304,  307,  311,
+     314,  318,  321,  325,  328,  332,  336,  339,  343,  347,  351,  354,  358,  362,  366,  370,
+     374,  378,  381,  385,  389,  393,  397,  401,  405,  410,  414,  418,  422,  426,  430,  434,
+     439,  443,  447,  451,  456,  460,  464,  469,  473,  477,  482,  486,  491,  495,  499,  504,
+     508,  513,  517,  522,  527,  531,  536,  540,  545,  550,  554,  559,  563,  568,  573,  577,
+     582,  587,  592,  596,  601,  606,  611,  615,  620,  625,  630,  635,  640,  644,  649,  654,
+     659,  664,  669,  674,  678,  683,  688,  693,  698,  703,  708,  713,  718,  723,  728,  732,
+     737,  742,  747,  752,  757,  762,  767,  772,  777,  782,  787,  792,  797,  802,  806,  811,
+     816,  821,  826,  831,  836,  841,  846,  851,  855,  860,  865,  870,  875,  880,  884,  889,
+     894,  899,  904,  908,  913,  918,  923,  927,  932,  937,  941,  946,  951,  955,  960,  965,
+     969,  974,  978,  983,  988,  992,  997, 1001, 1005, 1010, 1014, 1019, 1023, 1027, 1032, 1036,
+    1040, 1045, 1049, 1053, 1057, 1061, 1066, 1070, 1074, 1078, 1082, 1086, 1090, 1094, 1098, 1102,
+    1106, 1109, 1113, 1117, 1121, 1125, 1128, 1132, 1136, 1139, 1143, 1146, 1150, 1153, 1157, 1160,
+    1164, 1167, 1170, 1174, 1177, 1180, 1183, 1186, 1190, 1193, 1196, 1199, 1202, 1205, 1207, 1210,
+    1213, 1216, 1219, 1221, 1224, 1227, 1229, 1232, 1234, 1237, 1239, 1241, 1244, 1246, 1248, 1251,
+    1253, 1255, 1257, 1259, 1261, 1263, 1265, 1267, 1269, 1270, 1272, 1274, 1275, 1277, 1279, 1280,
+    1282, 1283, 1284, 1286, 1287, 1288, 1290, 1291, 1292, 1293, 1294, 1295, 1296, 1297, 1297, 1298,
+    1299, 1300, 1300, 1301, 1302, 1302, 1303, 1303, 1303, 1304, 1304, 1304, 1304, 1304, 1305, 1305
+};
+
+static inline bool8 ReadCounter (int rate)
+{
+    return (((uint32) SDSP.counter + CounterOffsets [rate]) % CounterRates [rate] != 0);
+}
+
+static inline uint8 RAMRead (uint32 addr)
+{
+    return (IAPU.RAM [addr & 0xffff]);
+}
+
+static inline void RAMWrite (uint32 addr, uint8 byte)
+{
+    addr &= 0xffff;
+    if (addr >= 0xffc0 && APU.ShowROM)
+		APU.ExtraRAM [addr - 0xffc0] = byte;
+    else
+		IAPU.RAM [addr] = byte;
+    DIRTY_MARK (APURAM, addr);
+}
+
+void S9xSDSPInit ()
+{
+    S9xSDSPReset ();
+}
+
+void S9xSDSPReset ()
+{
+    memset (&SDSP, 0, sizeof (SDSP));
+    SDSP.noise = 0x4000;
+    SDSP.every_other_sample = 1;
+    SDSP.counter = 0;
+    for (int v = 0; v < SDSP_VOICES; v++)
+    {
+		SDSP.brr_offset [v] = 1;
+		SDSP.env_mode [v] = ENV_RELEASE;
+    }
+}
+
+void S9xSDSPWrite (uint8 reg, uint8 byte)
+{
+    if (reg >= 0x80)
+		return;
+
+    switch (reg)
+    {
+    case APU_ENDX:
+		// Any write clears all end flags.
+		APU.DSP [APU_ENDX] = 0;
+		return;
+    case APU_KON:
+		SDSP.new_kon = byte;
+		break;
+    }
+    APU.DSP [reg] = byte;
+}
+
+static inline void DecodeBRR (int v, int header)
+{
+    int32 *pos = &SDSP.buf [v][SDSP.buf_pos [v]];
+    uint32 addr = SDSP.brr_addr [v] + SDSP.brr_offset [v];
+    int nybbles = (RAMRead (addr) << 8) | RAMRead (addr + 1);
+    const int shift = header >> 4;
+    const int filter = header & 0x0C;
+
+    for (int32 *end = pos + 4; pos < end; pos++, nybbles <<= 4)
+    {
+		int s = (int16) nybbles >> 12;
+
+		s = (s << shift) >> 1;
+		if (shift >= 0xD)
+			s = (s >> 25) << 11;
+
+		const int p1 = pos [SDSP_BRR_BUF_SIZE - 1];
+		const int p2 = pos [SDSP_BRR_BUF_SIZE - 2] >> 1;
+		if (filter >= 8)
+		{
+			s += p1;
+			s -= p2;
+			if (filter == 8)
+			{
+				s += p2 >> 4;
+				s += (p1 * -3) >> 6;
+			}
+			else
+			{
+				s += (p1 * -13) >> 7;
+				s += (p2 * 3) >> 4;
+			}
+		}
+		else if (filter)
+		{
+			s += p1 >> 1;
+			s += (-p1) >> 5;
+		}
+
+		CLAMP16 (s);
+		s = (int16) (s * 2);
+		pos [SDSP_BRR_BUF_SIZE] = pos [0] = s;
+    }
+
+    if ((SDSP.buf_pos [v] += 4) >= SDSP_BRR_BUF_SIZE)
+		SDSP.buf_pos [v] = 0;
+}
+
+static inline int Interpolate (int v)
+{
+    int offset = (SDSP.interp_pos [v] >> 4) & 0xFF;
+    const int16 *fwd = Gauss + 255 - offset;
+    const int16 *rev = Gauss + offset;
+    const int32 *in = &SDSP.buf [v][(SDSP.interp_pos [v] >> 12) + SDSP.buf_pos [v]];
+    int out;
+
+    out  = (fwd [  0] * in [0]) >> 11;
+    out += (fwd [256] * in [1]) >> 11;
+    out += (rev [256] * in [2]) >> 11;
+    out = (int16) out;
+    out += (rev [  0] * in [3]) >> 11;
+    CLAMP16 (out);
+    return (out & ~1);
+}
+
+static inline void RunEnvelope (int v)
+{
+    int env = SDSP.env [v];
+    int mode = SDSP.env_mode [v];
+
+    if (mode == ENV_RELEASE)
+    {
+		if ((env -= 0x8) < 0)
+			env = 0;
+		SDSP.env [v] = env;
+		return;
+    }
+
+    int rate;
+    int env_data = VREG (v, APU_ADSR2);
+    int adsr1 = VREG (v, APU_ADSR1);
+
+    if (adsr1 & 0x80)
+    {
+		if (mode >= ENV_DECAY)
+		{
+			env--;
+			env -= env >> 8;
+			rate = env_data & 0x1F;
+			if (mode == ENV_DECAY)
+				rate = ((adsr1 >> 3) & 0x0E) + 0x10;
+		}
+		else
+		{
+			rate = (adsr1 & 0x0F) * 2 + 1;
+			env += rate < 31 ? 0x20 : 0x400;
+		}
+    }
+    else
+    {
+		env_data = VREG (v, APU_GAIN);
+		int gmode = env_data >> 5;
+		if (gmode < 4)
+		{
+			// Direct
+			env = env_data * 0x10;
+			rate = 31;
+		}
+		else
+		{
+			rate = env_data & 0x1F;
+			if (gmode == 4)
+				env -= 0x20;
+			else if (gmode < 6)
+			{
+				env--;
+				env -= env >> 8;
+			}
+			else
+			{
+				env += 0x20;
+				if (gmode > 6 && (uint32) SDSP.hidden_env [v] >= 0x600)
+					env += 0x8 - 0x20;
+			}
+		}
+    }
+
+    // Sustain level
+    if ((env >> 8) == (env_data >> 5) && mode == ENV_DECAY)
+		SDSP.env_mode [v] = ENV_SUSTAIN;
+
+    SDSP.hidden_env [v] = env;
+
+    // Unsigned compare also catches a linear decrease going negative.
+    if ((uint32) env > 0x7FF)
+    {
+		env = (env < 0 ? 0 : 0x7FF);
+		if (SDSP.env_mode [v] == ENV_ATTACK)
+			SDSP.env_mode [v] = ENV_DECAY;
+    }
+
+    if (!ReadCounter (rate))
+		SDSP.env [v] = env;
+}
+
+static inline void RunSample (int32 *out_l, int32 *out_r)
+{
+    if (--SDSP.counter < 0)
+		SDSP.counter = SDSP_COUNTER_RANGE - 1;
+
+    // KON is latched every other sample; KON bits that have been seen
+    // clear themselves first.
+    SDSP.every_other_sample ^= 1;
+    if (SDSP.every_other_sample)
+    {
+		SDSP.new_kon &= ~SDSP.kon;
+		SDSP.kon = SDSP.new_kon;
+		SDSP.koff = APU.DSP [APU_KOFF];
+    }
+
+    const int flg = APU.DSP [APU_FLG];
+    if (!ReadCounter (flg & 0x1F))
+    {
+		int feedback = (SDSP.noise << 13) ^ (SDSP.noise << 14);
+		SDSP.noise = (feedback & 0x4000) ^ (SDSP.noise >> 1);
+    }
+
+    const int pmon = APU.DSP [APU_PMON] & ~1;
+    const int non = APU.DSP [APU_NON];
+    const int eon = APU.DSP [APU_EON];
+    const uint32 dir = APU.DSP [APU_DIR] << 8;
+    int endx = APU.DSP [APU_ENDX];
+    int32 main_l = 0, main_r = 0, echo_l = 0, echo_r = 0;
+    int prev_out = 0;
+
+    for (int v = 0; v < SDSP_VOICES; v++)
+    {
+		const int bit = 1 << v;
+		uint32 brr_addr = SDSP.brr_addr [v];
+		int pitch = VREG (v, APU_P_LOW) | ((VREG (v, APU_P_HIGH) & 0x3F) << 8);
+
+		if (pmon & bit)
+			pitch += ((prev_out >> 5) * pitch) >> 10;
+
+		int header = RAMRead (brr_addr);
+
+		if (SDSP.kon_delay [v])
+		{
+			if (SDSP.kon_delay [v] == 5)
+			{
+				uint32 entry = dir + VREG (v, APU_SRCN) * 4;
+				brr_addr = RAMRead (entry) | (RAMRead (entry + 1) << 8);
+				SDSP.brr_addr [v] = brr_addr;
+				SDSP.brr_offset [v] = 1;
+				SDSP.buf_pos [v] = 0;
+				header = 0; // ignored on this sample
+				endx &= ~bit;
+			}
+			SDSP.env [v] = 0;
+			SDSP.hidden_env [v] = 0;
+			SDSP.interp_pos [v] = 0;
+			if (--SDSP.kon_delay [v] & 3)
+				SDSP.interp_pos [v] = 0x4000;
+			pitch = 0;
+		}
+
+		// Gaussian (or noise) sample scaled by the envelope. A silent voice
+		// still runs its decoder below, so ENDX keeps moving as on hardware.
+		int output = 0;
+		if (SDSP.env [v])
+		{
+			output = (non & bit) ? (int16) (SDSP.noise * 2) : Interpolate (v);
+			output = ((output * SDSP.env [v]) >> 11) & ~1;
+		}
+		VREG (v, APU_OUTX) = (uint8) (output >> 8);
+		VREG (v, APU_ENVX) = (uint8) (SDSP.env [v] >> 4);
+
+		// Immediate silence on soft reset or a non-looping end block
+		if ((flg & 0x80) || (header & 3) == 1)
+		{
+			SDSP.env_mode [v] = ENV_RELEASE;
+			SDSP.env [v] = 0;
+		}
+		if (SDSP.every_other_sample)
+		{
+			if (SDSP.koff & bit)
+				SDSP.env_mode [v] = ENV_RELEASE;
+			if (SDSP.kon & bit)
+			{
+				SDSP.kon_delay [v] = 5;
+				SDSP.env_mode [v] = ENV_ATTACK;
+			}
+		}
+		if (!SDSP.kon_delay [v])
+			RunEnvelope (v);
+
+		// Decode the next four samples when the interpolator needs them.
+		if (SDSP.interp_pos [v] >= 0x4000)
+		{
+			DecodeBRR (v, header);
+			if ((SDSP.brr_offset [v] += 2) >= SDSP_BRR_BLOCK_SIZE)
+			{
+				brr_addr = (brr_addr + SDSP_BRR_BLOCK_SIZE) & 0xFFFF;
+				if (header & 1)
+				{
+					uint32 entry = dir + VREG (v, APU_SRCN) * 4 + 2;
+					brr_addr = RAMRead (entry) | (RAMRead (entry + 1) << 8);
+					endx |= bit;
+				}
+				SDSP.brr_addr [v] = brr_addr;
+				SDSP.brr_offset [v] = 1;
+			}
+		}
+
+		SDSP.interp_pos [v] = (SDSP.interp_pos [v] & 0x3FFF) + pitch;
+		if (SDSP.interp_pos [v] > 0x7FFF)
+			SDSP.interp_pos [v] = 0x7FFF;
+
+		prev_out = output;
+		if (output)
+		{
+			int amp_l = (output * (int8) VREG (v, APU_VOL_LEFT)) >> 7;
+			int amp_r = (output * (int8) VREG (v, APU_VOL_RIGHT)) >> 7;
+
+			main_l += amp_l; CLAMP16 (main_l);
+			main_r += amp_r; CLAMP16 (main_r);
+			if (eon & bit)
+			{
+				echo_l += amp_l; CLAMP16 (echo_l);
+				echo_r += amp_r; CLAMP16 (echo_r);
+			}
+		}
+    }
+    APU.DSP [APU_ENDX] = (uint8) endx;
+
+    // Echo: read the oldest entry from APU RAM into the FIR history.
+    uint32 echo_ptr = ((APU.DSP [APU_ESA] << 8) + SDSP.echo_offset) & 0xFFFF;
+    int p = SDSP.echo_hist_pos = (SDSP.echo_hist_pos + 1) & 7;
+
+    SDSP.echo_hist [p][0] = ((int16) (RAMRead (echo_ptr) | (RAMRead (echo_ptr + 1) << 8))) >> 1;
+    SDSP.echo_hist [p][1] = ((int16) (RAMRead (echo_ptr + 2) | (RAMRead (echo_ptr + 3) << 8))) >> 1;
+
+    int fir_l = 0, fir_r = 0;
+    for (int i = 0; i < 7; i++)
+    {
+		int c = (int8) APU.DSP [(i << 4) + APU_C0];
+		fir_l += (SDSP.echo_hist [(p + 1 + i) & 7][0] * c) >> 6;
+		fir_r += (SDSP.echo_hist [(p + 1 + i) & 7][1] * c) >> 6;
+    }
+    {
+		int c = (int8) APU.DSP [APU_C7];
+		fir_l = (int16) fir_l + (int16) ((SDSP.echo_hist [p][0] * c) >> 6);
+		fir_r = (int16) fir_r + (int16) ((SDSP.echo_hist [p][1] * c) >> 6);
+    }
+    CLAMP16 (fir_l);
+    CLAMP16 (fir_r);
+    fir_l &= ~1;
+    fir_r &= ~1;
+
+    // Main output
+    int l = (int16) ((main_l * (int8) APU.DSP [APU_MVOL_LEFT]) >> 7) +
+		(int16) ((fir_l * (int8) APU.DSP [APU_EVOL_LEFT]) >> 7);
+    int r = (int16) ((main_r * (int8) APU.DSP [APU_MVOL_RIGHT]) >> 7) +
+		(int16) ((fir_r * (int8) APU.DSP [APU_EVOL_RIGHT]) >> 7);
+    CLAMP16 (l);
+    CLAMP16 (r);
+    if (flg & APU_MUTE)
+		l = r = 0;
+    *out_l = l;
+    *out_r = r;
+
+    // Echo feedback back into APU RAM
+    int efb = (int8) APU.DSP [APU_EFB];
+    echo_l += (int16) ((fir_l * efb) >> 7);
+    echo_r += (int16) ((fir_r * efb) >> 7);
+    CLAMP16 (echo_l);
+    CLAMP16 (echo_r);
+    if (!(flg & APU_ECHO_DISABLED))
+    {
+		echo_l &= ~1;
+		echo_r &= ~1;
+		RAMWrite (echo_ptr + 0, (uint8) echo_l);
+		RAMWrite (echo_ptr + 1, (uint8) (echo_l >> 8));
+		RAMWrite (echo_ptr + 2, (uint8) echo_r);
+		RAMWrite (echo_ptr + 3, (uint8) (echo_r >> 8));
+    }
+
+    // The delay register only takes effect when the buffer wraps.
+    if (!SDSP.echo_offset)
+		SDSP.echo_length = (APU.DSP [APU_EDL] & 0x0F) * 0x800;
+    SDSP.echo_offset += 4;
+    if (SDSP.echo_offset >= SDSP.echo_length)
+		SDSP.echo_offset = 0;
+}
+
+void S9xSDSPMix (int16 *out, int frames, bool8 stereo)
+{
+    int32 l, r;
+
+    if (stereo)
+    {
+		for (int i = 0; i < frames; i++)
+		{
+			RunSample (&l, &r);
+			out [i * 2 + 0] = (int16) l;
+			out [i * 2 + 1] = (int16) r;
+		}
+    }
+    else
+    {
+		for (int i = 0; i < frames; i++)
+		{
+			RunSample (&l, &r);
+			out [i] = (int16) ((l + r) >> 1);
+		}
+    }
+}
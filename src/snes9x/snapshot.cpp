@@ -98,6 +98,9 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #endif
+#ifdef __linux
+#include <sys/mman.h>
+#endif
 
 #include "snapshot.h"
 #include "snaporig.h"
@@ -114,8 +117,14 @@
 #include "sdd1.h"
 #include "spc7110.h"
 #include "movie.h"
+#include "sdsp.h"
+#include "dsp1.h"
+#include "fxinst.h"
+
+#include <zlib.h>
 
 extern uint8 *SRAM;
+extern struct FxRegs_s GSU;
 
 #ifdef ZSNES_FX
 START_EXTERN_C
@@ -430,6 +439,31 @@ static FreezeData SnapSoundData [] = {
 #undef O
 };
 
+#undef OFFSET
+#define OFFSET(f) Offset(f,SSDSP *)
+
+static FreezeData SnapSDSP [] = {
+    {OFFSET (buf), SDSP_VOICES * SDSP_BRR_BUF_SIZE * 2, uint32_ARRAY_V},
+    {OFFSET (buf_pos), SDSP_VOICES, uint32_ARRAY_V},
+    {OFFSET (interp_pos), SDSP_VOICES, uint32_ARRAY_V},
+    {OFFSET (brr_addr), SDSP_VOICES, uint32_ARRAY_V},
+    {OFFSET (brr_offset), SDSP_VOICES, uint32_ARRAY_V},
+    {OFFSET (kon_delay), SDSP_VOICES, uint32_ARRAY_V},
+    {OFFSET (env_mode), SDSP_VOICES, uint32_ARRAY_V},
+    {OFFSET (env), SDSP_VOICES, uint32_ARRAY_V},
+    {OFFSET (hidden_env), SDSP_VOICES, uint32_ARRAY_V},
+    {OFFSET (echo_hist), 16, uint32_ARRAY_V},
+    {OFFSET (echo_hist_pos), 4, INT_V},
+    {OFFSET (echo_offset), 4, INT_V},
+    {OFFSET (echo_length), 4, INT_V},
+    {OFFSET (counter), 4, INT_V},
+    {OFFSET (noise), 4, INT_V},
+    {OFFSET (every_other_sample), 4, INT_V},
+    {OFFSET (kon), 4, INT_V},
+    {OFFSET (new_kon), 4, INT_V},
+    {OFFSET (koff), 4, INT_V}
+};
+
 #undef OFFSET
 #define OFFSET(f) Offset(f,struct SSA1Registers *)
 
@@ -532,19 +566,255 @@ static FreezeData SnapS7RTC [] = {
 //static char ROMFilename [_MAX_PATH];
 //static char SnapshotFilename [_MAX_PATH];
 
-void FreezeStruct (STREAM stream, const char *name, void *base, FreezeData *fields,
+// One entry of a container's section table.
+typedef struct {
+    char   name [4];
+    uint32 offset;
+    uint32 size;
+    uint32 crc;
+} SnapSection;
+
+#define SNAPSHOT_INDEX_ENTRY 16
+#define SNAPSHOT_INDEX_SIZE (12 + SNAPSHOT_INDEX_MAX * SNAPSHOT_INDEX_ENTRY)
+
+// Where a snapshot is written to or read from: a stdio stream, or an
+// SSnapshotMem buffer when mem is set. With sections set, the buffer
+// holds a container and blocks are found through its table instead of
+// one after the other.
+typedef struct {
+    STREAM file;
+    SSnapshotMem *mem;
+    uint32 pos;
+    bool8 failed;
+    SnapSection *sections;
+    int num_sections;
+} SnapStream;
+
+// Room for the fixed blocks (VRAM, RAM, SRAM, FillRAM, APU RAM) plus the
+// structs; coprocessor state or movie data grow the buffer once.
+#define SNAPSHOT_MEM_SIZE 0x70000
+
+// File snapshots go through memory too, so there is one write or read
+// per save or load instead of one per block.
+static SSnapshotMem SnapFileMem;
+
+// Packing space for structs written to a stdio stream.
+static uint8 *SnapScratch = NULL;
+static int SnapScratchSize = 0;
+
+static void FreezeToSnapStream (SnapStream *stream);
+static int UnfreezeFromSnapStream (SnapStream *stream);
+
+void FreezeStruct (SnapStream *stream, const char *name, void *base, FreezeData *fields,
 				   int num_fields);
-void FreezeBlock (STREAM stream, const char *name, uint8 *block, int size);
+void FreezeBlock (SnapStream *stream, const char *name, uint8 *block, int size);
 
-int UnfreezeStruct (STREAM stream, const char *name, void *base, FreezeData *fields,
+int UnfreezeStruct (SnapStream *stream, const char *name, void *base, FreezeData *fields,
 					int num_fields);
-int UnfreezeBlock (STREAM stream, const char *name, uint8 *block, int size);
+int UnfreezeBlock (SnapStream *stream, const char *name, uint8 *block, int size);
 
-int UnfreezeStructCopy (STREAM stream, const char *name, uint8** block, FreezeData *fields, int num_fields);
+int UnfreezeStructCopy (SnapStream *stream, const char *name, uint8** block, FreezeData *fields, int num_fields);
 
 void UnfreezeStructFromCopy (void *base, FreezeData *fields, int num_fields, uint8* block);
 
-int UnfreezeBlockCopy (STREAM stream, const char *name, uint8** block, int size);
+int UnfreezeBlockCopy (SnapStream *stream, const char *name, uint8** block, int size);
+
+void FreeBlockCopy (SnapStream *stream, uint8 *block);
+
+static bool8 SnapMemReserve (SSnapshotMem *mem, uint32 size)
+{
+    if (mem->size >= size)
+		return (TRUE);
+
+    uint8 *data = (uint8 *) realloc (mem->data, size);
+    if (!data)
+		return (FALSE);
+    mem->data = data;
+    mem->size = size;
+    return (TRUE);
+}
+
+static int SnapWrite (SnapStream *stream, const void *data, int len)
+{
+    if (!stream->mem)
+		return (WRITE_STREAM ((char *) data, len, stream->file));
+
+    if (stream->failed)
+		return (0);
+    if (stream->pos + len > stream->mem->size &&
+		!SnapMemReserve (stream->mem, stream->pos + len + (stream->pos + len) / 4))
+    {
+		stream->failed = TRUE;
+		return (0);
+    }
+    memcpy (stream->mem->data + stream->pos, data, len);
+    stream->pos += len;
+    return (len);
+}
+
+static void SnapPut32 (uint8 *p, uint32 v)
+{
+    p [0] = (uint8) (v >> 24);
+    p [1] = (uint8) (v >> 16);
+    p [2] = (uint8) (v >> 8);
+    p [3] = (uint8) v;
+}
+
+static uint32 SnapGet32 (const uint8 *p)
+{
+    return ((p [0] << 24) | (p [1] << 16) | (p [2] << 8) | p [3]);
+}
+
+// In a container a block is entered in the section table; in the linear
+// format it gets a "NAM:000000:" header of its own.
+static void SnapBlockHeader (SnapStream *stream, const char *name, int len)
+{
+    if (!stream->sections)
+    {
+		char buffer [16];
+		sprintf (buffer, "%s:%06d:", name, len);
+		SnapWrite (stream, buffer, strlen (buffer));
+		return;
+    }
+
+    if (stream->num_sections >= SNAPSHOT_INDEX_MAX)
+    {
+		stream->failed = TRUE;
+		return;
+    }
+    SnapSection *section = &stream->sections [stream->num_sections++];
+    strncpy (section->name, name, 3);
+    section->name [3] = 0;
+    section->offset = stream->pos;
+    section->size = len;
+    section->crc = 0;
+}
+
+// Fills in the container header at the start of mem, once the sections
+// are written.
+static void SnapWriteIndex (SSnapshotMem *mem, SnapSection *sections, int num)
+{
+    uint8 *p = mem->data;
+
+    memcpy (p, SNAPSHOT_INDEX_MAGIC, 4);
+    SnapPut32 (p + 4, SNAPSHOT_INDEX_VERSION);
+    SnapPut32 (p + 8, num);
+    memset (p + 12, 0, SNAPSHOT_INDEX_SIZE - 12);
+
+    for (int i = 0; i < num; i++)
+    {
+		uint8 *entry = p + 12 + i * SNAPSHOT_INDEX_ENTRY;
+
+		sections [i].crc = crc32 (0L, mem->data + sections [i].offset, sections [i].size);
+		memcpy (entry, sections [i].name, 4);
+		SnapPut32 (entry + 4, sections [i].offset);
+		SnapPut32 (entry + 8, sections [i].size);
+		SnapPut32 (entry + 12, sections [i].crc);
+    }
+}
+
+// Reads the section table of a container len bytes long. Returns the
+// number of sections, or WRONG_FORMAT or WRONG_VERSION.
+static int SnapReadIndex (const uint8 *header, uint32 len, SnapSection *sections)
+{
+    if (memcmp (header, SNAPSHOT_INDEX_MAGIC, 4) != 0)
+		return (WRONG_FORMAT);
+    if (SnapGet32 (header + 4) > SNAPSHOT_INDEX_VERSION)
+		return (WRONG_VERSION);
+
+    uint32 num = SnapGet32 (header + 8);
+    if (num > SNAPSHOT_INDEX_MAX)
+		return (WRONG_FORMAT);
+
+    for (uint32 i = 0; i < num; i++)
+    {
+		const uint8 *entry = header + 12 + i * SNAPSHOT_INDEX_ENTRY;
+
+		memcpy (sections [i].name, entry, 4);
+		sections [i].name [3] = 0;
+		sections [i].offset = SnapGet32 (entry + 4);
+		sections [i].size = SnapGet32 (entry + 8);
+		sections [i].crc = SnapGet32 (entry + 12);
+		if (sections [i].offset < SNAPSHOT_INDEX_SIZE || sections [i].offset > len ||
+			sections [i].size > len - sections [i].offset)
+			return (WRONG_FORMAT);
+    }
+    return ((int) num);
+}
+
+static const SnapSection *SnapFindSection (const SnapSection *sections, int num,
+										   const char *name)
+{
+    for (int i = 0; i < num; i++)
+		if (strncmp (sections [i].name, name, 3) == 0)
+			return (&sections [i]);
+    return (NULL);
+}
+
+static int SnapRead (SnapStream *stream, void *data, int len)
+{
+    if (!stream->mem)
+		return (READ_STREAM ((char *) data, len, stream->file));
+
+    if (stream->pos >= stream->mem->used)
+		len = 0;
+    else if (stream->pos + len > stream->mem->used)
+		len = stream->mem->used - stream->pos;
+    memcpy (data, stream->mem->data + stream->pos, len);
+    stream->pos += len;
+    return (len);
+}
+
+static int32 SnapTell (SnapStream *stream)
+{
+    if (!stream->mem)
+		return (FIND_STREAM (stream->file));
+    return (stream->pos);
+}
+
+static void SnapSeek (SnapStream *stream, int32 pos)
+{
+    if (!stream->mem)
+		REVERT_STREAM (stream->file, pos, 0);
+    else
+		stream->pos = pos;
+}
+
+// Returns space for a len byte block, after writing its header. In memory
+// the struct is packed straight into the buffer; SnapEndBlock writes it
+// out for stdio streams.
+static uint8 *SnapBeginBlock (SnapStream *stream, const char *name, int len)
+{
+    SnapBlockHeader (stream, name, len);
+
+    if (stream->mem)
+    {
+		if (stream->pos + len > stream->mem->size &&
+			!SnapMemReserve (stream->mem, stream->pos + len + (stream->pos + len) / 4))
+			stream->failed = TRUE;
+		if (stream->failed)
+			return (NULL);
+		uint8 *block = stream->mem->data + stream->pos;
+		stream->pos += len;
+		return (block);
+    }
+
+    if (len > SnapScratchSize)
+    {
+		uint8 *scratch = (uint8 *) realloc (SnapScratch, len);
+		if (!scratch)
+			return (NULL);
+		SnapScratch = scratch;
+		SnapScratchSize = len;
+    }
+    return (SnapScratch);
+}
+
+static void SnapEndBlock (SnapStream *stream, uint8 *block, int len)
+{
+    if (!stream->mem)
+		WRITE_STREAM ((char *) block, len, stream->file);
+}
 
 bool8 Snapshot (const char *filename)
 {
@@ -553,14 +823,30 @@ bool8 Snapshot (const char *filename)
 
 bool8 S9xFreezeGame (const char *filename)
 {
+	if (!S9xFreezeGameToMemory (&SnapFileMem, NULL, 0))
+		return (FALSE);
+
+	// Written under another name and renamed over the old file, so an
+	// interrupted save leaves the previous state intact.
+	char temp [_MAX_PATH + 8];
+	sprintf (temp, "%s.tmp", filename);
+
 	FILE* fp;
-	fp = fopen(filename, "w");
+	fp = fopen(temp, "wb");
 	if(NULL == fp)
 		return (FALSE);
 
-	fseek(fp, 4, SEEK_SET);	//Valid data offset 4 bytes
-	S9xFreezeToStream (fp);
-	fclose(fp);
+	bool8 ok = fwrite (SnapFileMem.data, 1, SnapFileMem.used, fp) == SnapFileMem.used;
+	ok = fflush(fp) == 0 && ok;
+#ifdef __linux
+	ok = fsync(fileno(fp)) == 0 && ok;
+#endif
+	ok = fclose(fp) == 0 && ok;
+	if (!ok || rename(temp, filename) != 0)
+	{
+		remove(temp);
+		return (FALSE);
+	}
 #if 0	//Not support moive now
 	if(S9xMovieActive())
 	{
@@ -576,6 +862,65 @@ bool8 S9xFreezeGame (const char *filename)
 	return (TRUE);
 }
 
+// A container is applied straight from a mapping of its file, the blocks
+// where they lie, without a copy of the whole state.
+static int UnfreezeFromFile (FILE *fp, long len)
+{
+#ifdef __linux
+    void *map = mmap (NULL, len, PROT_READ, MAP_PRIVATE, fileno (fp), 0);
+    if (map != MAP_FAILED)
+    {
+		SSnapshotMem mem;
+		mem.data = (uint8 *) map;
+		mem.size = mem.used = len;
+		mem.raw_size = 0;
+
+		int result = S9xUnfreezeFromMemory (&mem);
+		munmap (map, len);
+		return (result);
+    }
+#endif
+    fseek (fp, 0, SEEK_SET);
+    if (!SnapMemReserve (&SnapFileMem, len) ||
+		fread (SnapFileMem.data, 1, len, fp) != (size_t) len)
+		return (WRONG_FORMAT);
+    SnapFileMem.used = len;
+    SnapFileMem.raw_size = 0;
+    return (S9xUnfreezeFromMemory (&SnapFileMem));
+}
+
+// Reads one section of a container file into buffer and leaves the rest
+// of the file alone. Returns the section's length, or -1 if the file has
+// no such section, is in the linear format, or the section is damaged or
+// longer than size.
+int32 S9xSnapshotReadSection (const char *filename, const char *name, uint8 *buffer, uint32 size)
+{
+    uint8 header [SNAPSHOT_INDEX_SIZE];
+    SnapSection sections [SNAPSHOT_INDEX_MAX];
+    const SnapSection *section;
+    int32 result = -1;
+    int num;
+
+    FILE *fp = fopen (filename, "rb");
+    if (!fp)
+		return (-1);
+    fseek (fp, 0, SEEK_END);
+    long len = ftell (fp);
+    fseek (fp, 0, SEEK_SET);
+
+    if (fread (header, 1, SNAPSHOT_INDEX_SIZE, fp) == SNAPSHOT_INDEX_SIZE &&
+		(num = SnapReadIndex (header, len, sections)) >= 0 &&
+		(section = SnapFindSection (sections, num, name)) != NULL &&
+		section->size <= size &&
+		fseek (fp, section->offset, SEEK_SET) == 0 &&
+		fread (buffer, 1, section->size, fp) == section->size &&
+		crc32 (0L, buffer, section->size) == section->crc)
+		result = section->size;
+
+    fclose (fp);
+    return (result);
+}
+
 bool8 S9xLoadSnapshot (const char *filename)
 {
     return (S9xUnfreezeGame (filename));
@@ -590,14 +935,32 @@ bool8 S9xUnfreezeGame (const char *filename)
 		return (TRUE);
 
 	FILE* fp;
-	fp = fopen(filename, "r");
+	fp = fopen(filename, "rb");
 	if(NULL == fp)
 		return (FALSE);
 
-	fseek(fp, 4, SEEK_SET);	//Valid data offset 4 bytes
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
 
-	int result;
-	if ((result = S9xUnfreezeFromStream (fp)) != SUCCESS)
+	char magic [4];
+	int result = WRONG_FORMAT;
+	if (fread (magic, 1, 4, fp) == 4 && memcmp (magic, SNAPSHOT_INDEX_MAGIC, 4) == 0)
+		result = UnfreezeFromFile (fp, size);
+	else
+	{
+		// The linear format, after its zeroed header
+		long len = size - SNAPSHOT_FILE_HEADER;
+		fseek(fp, SNAPSHOT_FILE_HEADER, SEEK_SET);
+		if (len > 0 && SnapMemReserve (&SnapFileMem, len) &&
+			fread (SnapFileMem.data, 1, len, fp) == (size_t) len)
+		{
+			SnapFileMem.used = len;
+			SnapFileMem.raw_size = 0;
+			result = S9xUnfreezeFromMemory (&SnapFileMem);
+		}
+	}
+	if (result != SUCCESS)
 	{
 #if 0
 		switch (result)
@@ -638,12 +1001,298 @@ bool8 S9xUnfreezeGame (const char *filename)
 	return (TRUE);
 }
 
-void S9xFreezeToStream (STREAM stream)
+void S9xFreezeToStream (STREAM file)
+{
+    SnapStream stream;
+
+    stream.file = file;
+    stream.mem = NULL;
+    stream.pos = 0;
+    stream.failed = FALSE;
+    stream.sections = NULL;
+    FreezeToSnapStream (&stream);
+}
+
+int S9xUnfreezeFromStream (STREAM file)
+{
+    SnapStream stream;
+
+    stream.file = file;
+    stream.mem = NULL;
+    stream.pos = 0;
+    stream.failed = FALSE;
+    stream.sections = NULL;
+    return (UnfreezeFromSnapStream (&stream));
+}
+
+bool8 S9xFreezeToMemory (SSnapshotMem *mem)
+{
+    SnapStream stream;
+
+    if (!SnapMemReserve (mem, SNAPSHOT_MEM_SIZE))
+		return (FALSE);
+
+    stream.file = NULL;
+    stream.mem = mem;
+    stream.pos = 0;
+    stream.failed = FALSE;
+    stream.sections = NULL;
+    FreezeToSnapStream (&stream);
+
+    mem->used = stream.failed ? 0 : stream.pos;
+    mem->raw_size = 0;
+    return (!stream.failed);
+}
+
+// The state as S9xFreezeGame puts it in a file, for a port that writes
+// the file itself; extra sections of the port's own go in with it.
+bool8 S9xFreezeGameToMemory (SSnapshotMem *mem, const SSnapshotSection *extra, int num_extra)
+{
+    SnapStream stream;
+    SnapSection sections [SNAPSHOT_INDEX_MAX];
+
+    if (!SnapMemReserve (mem, SNAPSHOT_MEM_SIZE))
+		return (FALSE);
+
+    stream.file = NULL;
+    stream.mem = mem;
+    stream.pos = SNAPSHOT_INDEX_SIZE;
+    stream.failed = FALSE;
+    stream.sections = sections;
+    stream.num_sections = 0;
+    FreezeToSnapStream (&stream);
+    for (int i = 0; i < num_extra; i++)
+		FreezeBlock (&stream, extra [i].name, (uint8 *) extra [i].data, extra [i].size);
+    if (!stream.failed)
+		SnapWriteIndex (mem, sections, stream.num_sections);
+
+    mem->used = stream.failed ? 0 : stream.pos;
+    mem->raw_size = 0;
+    return (!stream.failed);
+}
+
+int S9xUnfreezeFromMemory (const SSnapshotMem *mem)
+{
+    SnapStream stream;
+    SnapSection sections [SNAPSHOT_INDEX_MAX];
+
+    if (!mem->data || !mem->used || mem->raw_size)
+		return (WRONG_FORMAT);
+
+    stream.file = NULL;
+    stream.mem = (SSnapshotMem *) mem;
+    stream.pos = 0;
+    stream.failed = FALSE;
+    stream.sections = NULL;
+
+    if (mem->used >= SNAPSHOT_INDEX_SIZE &&
+		memcmp (mem->data, SNAPSHOT_INDEX_MAGIC, 4) == 0)
+    {
+		int num = SnapReadIndex (mem->data, mem->used, sections);
+		if (num < 0)
+			return (num);
+		// All of it is about to be applied; check all of it first
+		for (int i = 0; i < num; i++)
+			if (crc32 (0L, mem->data + sections [i].offset, sections [i].size) != sections [i].crc)
+				return (WRONG_FORMAT);
+		stream.sections = sections;
+		stream.num_sections = num;
+    }
+    return (UnfreezeFromSnapStream (&stream));
+}
+
+bool8 S9xCompressSnapshot (const SSnapshotMem *src, SSnapshotMem *dst)
+{
+    if (!src->used || src->raw_size)
+		return (FALSE);
+
+    uLongf len = compressBound (src->used);
+    if (!SnapMemReserve (dst, len))
+		return (FALSE);
+    // Fastest level: this runs on the emulation thread.
+    if (compress2 (dst->data, &len, src->data, src->used, Z_BEST_SPEED) != Z_OK)
+		return (FALSE);
+    dst->used = len;
+    dst->raw_size = src->used;
+    return (TRUE);
+}
+
+bool8 S9xUncompressSnapshot (const SSnapshotMem *src, SSnapshotMem *dst)
+{
+    if (!src->used || !src->raw_size)
+		return (FALSE);
+
+    uLongf len = src->raw_size;
+    if (!SnapMemReserve (dst, len))
+		return (FALSE);
+    if (uncompress (dst->data, &len, src->data, src->used) != Z_OK ||
+		len != src->raw_size)
+		return (FALSE);
+    dst->used = len;
+    dst->raw_size = 0;
+    return (TRUE);
+}
+
+void S9xFreeSnapshotMem (SSnapshotMem *mem)
+{
+    if (mem->data)
+		free (mem->data);
+    mem->data = NULL;
+    mem->size = mem->used = mem->raw_size = 0;
+}
+
+// Raw states: the machine copied as it sits in memory, with no block
+// format, no reset and no rebuilding of what the loader would derive
+// again, so loading one gives back exactly the state that was saved. They
+// hold host pointers and struct layouts: only good within this session
+// for the loaded ROM, and only between frames. Coprocessors the snapshot
+// format does not cover are covered here as far as their state lives in
+// one struct.
+typedef struct {
+    void   *ptr;
+    uint32 size;
+} SRawBlock;
+
+#define RAW_MAX_BLOCKS 24
+
+static int RawBlocks (SRawBlock *b)
+{
+    int n = 0;
+
+#define RAW(p, s) (b [n].ptr = (void *) (p), b [n].size = (s), n++)
+    RAW (&CPU, sizeof (CPU));
+    RAW (&ICPU, sizeof (ICPU));
+    RAW (&PPU, sizeof (PPU));
+    RAW (&IPPU, sizeof (IPPU));
+    RAW (DMA, sizeof (DMA));
+    RAW (&OpenBus, sizeof (OpenBus));
+    RAW (Memory.RAM, 0x20000);
+    RAW (Memory.VRAM, 0x10000);
+    RAW (::SRAM, 0x20000);
+    RAW (Memory.FillRAM, 0x8000);
+    RAW (&Memory.BWRAM, sizeof (Memory.BWRAM));
+    RAW (&APU, sizeof (APU));
+    RAW (&IAPU, sizeof (IAPU));
+    RAW (IAPU.RAM, 0x10000);
+    RAW (&SoundData, sizeof (SoundData));
+    RAW (&SDSP, sizeof (SDSP));
+    if (Settings.SA1)
+		RAW (&SA1, sizeof (SA1));
+    if (Settings.SuperFX)
+		RAW (&GSU, sizeof (GSU));
+    if (Settings.DSP1Master)
+		RAW (&DSP1, sizeof (DSP1));
+    if (Settings.SPC7110)
+		RAW (&s7r, sizeof (s7r));
+    if (Settings.SPC7110RTC)
+		RAW (&rtc_f9, sizeof (rtc_f9));
+    if (Settings.C4)
+		RAW (Memory.C4RAM, 0x2000);
+#undef RAW
+
+    return (n);
+}
+
+bool8 S9xFreezeRaw (SSnapshotMem *mem)
+{
+    SRawBlock b [RAW_MAX_BLOCKS];
+    int n = RawBlocks (b);
+    uint32 size = 0;
+
+    for (int i = 0; i < n; i++)
+		size += b [i].size;
+    if (!SnapMemReserve (mem, size))
+		return (FALSE);
+
+    uint8 *p = mem->data;
+    for (int i = 0; i < n; i++)
+    {
+		memcpy (p, b [i].ptr, b [i].size);
+		p += b [i].size;
+    }
+    mem->used = size;
+    mem->raw_size = 0;
+    return (TRUE);
+}
+
+// Pages written since the save are already marked dirty and are the only
+// ones the copy changes, so the dirty map needs nothing here.
+bool8 S9xUnfreezeRaw (const SSnapshotMem *mem)
+{
+    SRawBlock b [RAW_MAX_BLOCKS];
+    int n = RawBlocks (b);
+    uint32 size = 0;
+
+    for (int i = 0; i < n; i++)
+		size += b [i].size;
+    if (!mem->data || mem->used != size)
+		return (FALSE);
+
+    const uint8 *p = mem->data;
+    for (int i = 0; i < n; i++)
+    {
+		memcpy (b [i].ptr, p, b [i].size);
+		p += b [i].size;
+    }
+
+    // The SA-1 and S-DD1 bank registers switch ROM into Memory.Map, which
+    // is not copied; the maps are rebuilt from the registers as a loaded
+    // state's are. The SA-1 keeps the run state it was saved in, which
+    // includes its idle-loop shutdown.
+    if (Settings.SA1)
+    {
+		bool8 executing = SA1.Executing;
+		S9xFixSA1AfterSnapshotLoad ();
+		SA1.Executing = executing;
+    }
+    if (Settings.SDD1)
+		S9xSDD1PostLoadState ();
+
+    // Caches kept outside the copied structs
+    Memory.FixROMSpeed ();
+    Memory.SyncHotMap (0, MEMMAP_NUM_BLOCKS);
+    ZeroMemory (IPPU.TileCached [TILE_2BIT], MAX_2BIT_TILES);
+    ZeroMemory (IPPU.TileCached [TILE_4BIT], MAX_4BIT_TILES);
+    ZeroMemory (IPPU.TileCached [TILE_8BIT], MAX_8BIT_TILES);
+    IPPU.ColorsChanged = TRUE;
+    IPPU.OBJChanged = TRUE;
+    IPPU.DirectColourMapsNeedRebuild = TRUE;
+    return (TRUE);
+}
+
+// Returns where the payload of block name starts in an uncompressed state,
+// with its length in len, or -1 if the state has no such block.
+int32 S9xSnapshotFindBlock (const SSnapshotMem *mem, const char *name, uint32 *len)
+{
+    uint32 pos = strlen (SNAPSHOT_MAGIC) + 1 + 4 + 1;
+
+    while (pos + 11 <= mem->used)
+    {
+		const char *header = (const char *) mem->data + pos;
+		uint32 l = 0;
+
+		if (header [3] != ':' || header [10] != ':')
+			break;
+		for (int i = 4; i < 10; i++)
+			l = l * 10 + header [i] - '0';
+		pos += 11;
+		if (strncmp (header, name, 3) == 0)
+		{
+			*len = l;
+			return (pos + l <= mem->used ? (int32) pos : -1);
+		}
+		pos += l;
+    }
+    return (-1);
+}
+
+static void FreezeToSnapStream (SnapStream *stream)
 {
     char buffer [1024];
     int i;
 	
-    S9xSetSoundMute (TRUE);
+    // Put back whatever mute state the game had set through FLG.
+    bool8 mute = S9xSetSoundMute (TRUE);
 #ifdef ZSNES_FX
     if (Settings.SuperFX)
 		S9xSuperFXPreSaveState ();
@@ -657,11 +1306,14 @@ void S9xFreezeToStream (STREAM stream)
 		SoundData.channels [i].previous16 [0] = (int16) SoundData.channels [i].previous [0];
 		SoundData.channels [i].previous16 [1] = (int16) SoundData.channels [i].previous [1];
     }
-    sprintf (buffer, "%s:%04d\n", SNAPSHOT_MAGIC, SNAPSHOT_VERSION);
-    WRITE_STREAM (buffer, strlen (buffer), stream);
-    sprintf (buffer, "NAM:%06d:%s%c", (int)(strlen (Memory.ROMFilename) + 1),
-		Memory.ROMFilename, 0);
-    WRITE_STREAM (buffer, strlen (buffer) + 1, stream);
+    // A container keeps its version in its header
+    if (!stream->sections)
+    {
+		sprintf (buffer, "%s:%04d\n", SNAPSHOT_MAGIC, SNAPSHOT_VERSION);
+		SnapWrite (stream, buffer, strlen (buffer));
+    }
+    FreezeBlock (stream, "NAM", (uint8 *) Memory.ROMFilename,
+		strlen (Memory.ROMFilename) + 1);
     FreezeStruct (stream, "CPU", &CPU, SnapCPU, COUNT (SnapCPU));
     FreezeStruct (stream, "REG", &ICPU.Registers, SnapRegisters, COUNT (SnapRegisters));
     FreezeStruct (stream, "PPU", &PPU, SnapPPU, COUNT (SnapPPU));
@@ -681,6 +1333,8 @@ void S9xFreezeToStream (STREAM stream)
 		FreezeBlock (stream, "ARA", IAPU.RAM, 0x10000);
 		FreezeStruct (stream, "SOU", &SoundData, SnapSoundData,
 			COUNT (SnapSoundData));
+		if (Settings.SoundCore == SOUND_CORE_SDSP)
+			FreezeStruct (stream, "SDS", &SDSP, SnapSDSP, COUNT (SnapSDSP));
     }
     if (Settings.SA1)
     {
@@ -716,14 +1370,14 @@ void S9xFreezeToStream (STREAM stream)
 		}
 	}
 
-	S9xSetSoundMute (FALSE);
+	S9xSetSoundMute (mute);
 #ifdef ZSNES_FX
 	if (Settings.SuperFX)
 		S9xSuperFXPostSaveState ();
 #endif
 }
 
-int S9xUnfreezeFromStream (STREAM stream)
+static int UnfreezeFromSnapStream (SnapStream *stream)
 {
     char buffer [_MAX_PATH + 1];
     char rom_filename [_MAX_PATH + 1];
@@ -731,12 +1385,15 @@ int S9xUnfreezeFromStream (STREAM stream)
 	
     int version;
     unsigned int len = strlen (SNAPSHOT_MAGIC) + 1 + 4 + 1;
-    if (READ_STREAM (buffer, len, stream) != len)
-		return (WRONG_FORMAT);
-    if (strncmp (buffer, SNAPSHOT_MAGIC, strlen (SNAPSHOT_MAGIC)) != 0)
-		return (WRONG_FORMAT);
-    if ((version = atoi (&buffer [strlen (SNAPSHOT_MAGIC) + 1])) > SNAPSHOT_VERSION)
-		return (WRONG_VERSION);
+    if (!stream->sections)
+    {
+		if (SnapRead (stream, buffer, len) != len)
+			return (WRONG_FORMAT);
+		if (strncmp (buffer, SNAPSHOT_MAGIC, strlen (SNAPSHOT_MAGIC)) != 0)
+			return (WRONG_FORMAT);
+		if ((version = atoi (&buffer [strlen (SNAPSHOT_MAGIC) + 1])) > SNAPSHOT_VERSION)
+			return (WRONG_VERSION);
+    }
 	
     if ((result = UnfreezeBlock (stream, "NAM", (uint8 *) rom_filename, _MAX_PATH)) != SUCCESS)
 		return (result);
@@ -761,6 +1418,7 @@ int S9xUnfreezeFromStream (STREAM stream)
 	uint8* local_apu_registers = NULL;
 	uint8* local_apu_ram = NULL;
 	uint8* local_apu_sounddata = NULL;
+	uint8* local_sdsp = NULL;
 	uint8* local_sa1 = NULL;
 	uint8* local_sa1_registers = NULL;
 	uint8* local_spc = NULL;
@@ -793,6 +1451,8 @@ int S9xUnfreezeFromStream (STREAM stream)
 				break;
 			if ((result = UnfreezeStructCopy (stream, "SOU", &local_apu_sounddata, SnapSoundData, COUNT (SnapSoundData))) != SUCCESS)
 				break;
+			// Only present when the sample-accurate DSP core was running
+			UnfreezeStructCopy (stream, "SDS", &local_sdsp, SnapSDSP, COUNT (SnapSDSP));
 		}
 		if ((result = UnfreezeStructCopy (stream, "SA1", &local_sa1, SnapSA1, COUNT(SnapSA1))) == SUCCESS)
 		{
@@ -859,6 +1519,8 @@ int S9xUnfreezeFromStream (STREAM stream)
 			UnfreezeStructFromCopy (&IAPU.Registers, SnapAPURegisters, COUNT (SnapAPURegisters), local_apu_registers);
 			memmove (IAPU.RAM, local_apu_ram, 0x10000);
 			UnfreezeStructFromCopy (&SoundData, SnapSoundData, COUNT (SnapSoundData), local_apu_sounddata);
+			if (local_sdsp)
+				UnfreezeStructFromCopy (&SDSP, SnapSDSP, COUNT (SnapSDSP), local_sdsp);
 		}
 		if(local_sa1)
 		{
@@ -943,23 +1605,24 @@ int S9xUnfreezeFromStream (STREAM stream)
 			S9xSDD1PostLoadState ();
 	}
 
-	if (local_cpu)           delete [] local_cpu;
-	if (local_registers)     delete [] local_registers;
-	if (local_ppu)           delete [] local_ppu;
-	if (local_dma)           delete [] local_dma;
-	if (local_vram)          delete [] local_vram;
-	if (local_ram)           delete [] local_ram;
-	if (local_sram)          delete [] local_sram;
-	if (local_fillram)       delete [] local_fillram;
-	if (local_apu)           delete [] local_apu;
-	if (local_apu_registers) delete [] local_apu_registers;
-	if (local_apu_ram)       delete [] local_apu_ram;
-	if (local_apu_sounddata) delete [] local_apu_sounddata;
-	if (local_sa1)           delete [] local_sa1;
-	if (local_sa1_registers) delete [] local_sa1_registers;
-	if (local_spc)           delete [] local_spc;
-	if (local_spc_rtc)       delete [] local_spc_rtc;
-	if (local_movie_data)    delete [] local_movie_data;
+	FreeBlockCopy (stream, local_cpu);
+	FreeBlockCopy (stream, local_registers);
+	FreeBlockCopy (stream, local_ppu);
+	FreeBlockCopy (stream, local_dma);
+	FreeBlockCopy (stream, local_vram);
+	FreeBlockCopy (stream, local_ram);
+	FreeBlockCopy (stream, local_sram);
+	FreeBlockCopy (stream, local_fillram);
+	FreeBlockCopy (stream, local_apu);
+	FreeBlockCopy (stream, local_apu_registers);
+	FreeBlockCopy (stream, local_apu_ram);
+	FreeBlockCopy (stream, local_apu_sounddata);
+	FreeBlockCopy (stream, local_sdsp);
+	FreeBlockCopy (stream, local_sa1);
+	FreeBlockCopy (stream, local_sa1_registers);
+	FreeBlockCopy (stream, local_spc);
+	FreeBlockCopy (stream, local_spc_rtc);
+	FreeBlockCopy (stream, local_movie_data);
 
 	return (result);
 }
@@ -977,7 +1640,7 @@ int FreezeSize (int size, int type)
     }
 }
 
-void FreezeStruct (STREAM stream, const char *name, void *base, FreezeData *fields,
+void FreezeStruct (SnapStream *stream, const char *name, void *base, FreezeData *fields,
 				   int num_fields)
 {
     // Work out the size of the required block
@@ -993,11 +1656,14 @@ void FreezeStruct (STREAM stream, const char *name, void *base, FreezeData *fiel
 			fields [i].type);
     }
 	
-    uint8 *block = new uint8 [len];
+    uint8 *block = SnapBeginBlock (stream, name, len);
     uint8 *ptr = block;
     uint16 word;
     uint32 dword;
     int64  qword;
+
+    if (!block)
+		return;
 	
     // Build the block ready to be streamed out
     for (i = 0; i < num_fields; i++)
@@ -1061,149 +1727,102 @@ void FreezeStruct (STREAM stream, const char *name, void *base, FreezeData *fiel
 		}
     }
 	
-    FreezeBlock (stream, name, block, len);
-    delete[] block;
+    // Struct padding is not packed; clear it so equal states give equal
+    // bytes.
+    memset (ptr, 0, len - (ptr - block));
+    SnapEndBlock (stream, block, len);
 }
 
-void FreezeBlock (STREAM stream, const char *name, uint8 *block, int size)
+void FreezeBlock (SnapStream *stream, const char *name, uint8 *block, int size)
 {
-    char buffer [512];
-    sprintf (buffer, "%s:%06d:", name, size);
-    WRITE_STREAM (buffer, strlen (buffer), stream);
-    WRITE_STREAM ((char*)block, size, stream);
-    
+    SnapBlockHeader (stream, name, size);
+    SnapWrite (stream, block, size);
 }
 
-int UnfreezeStruct (STREAM stream, const char *name, void *base, FreezeData *fields,
+int UnfreezeStruct (SnapStream *stream, const char *name, void *base, FreezeData *fields,
 					int num_fields)
 {
-    // Work out the size of the required block
+    uint8 *block;
+    int result;
+
+    if ((result = UnfreezeStructCopy (stream, name, &block, fields, num_fields)) != SUCCESS)
+		return (result);
+
+    UnfreezeStructFromCopy (base, fields, num_fields, block);
+    FreeBlockCopy (stream, block);
+    return (result);
+}
+
+// Reads a block header and returns its length, or 0 with the stream
+// put back where it was if the next block is not name.
+static int UnfreezeBlockHeader (SnapStream *stream, const char *name)
+{
+    char buffer [20];
     int len = 0;
-    int i;
-    int j;
-	
-    for (i = 0; i < num_fields; i++)
+    int got;
+
+    // In a container the blocks can come in any order
+    if (stream->sections)
     {
-		if (fields [i].offset + FreezeSize (fields [i].size, 
-			fields [i].type) > len)
-			len = fields [i].offset + FreezeSize (fields [i].size, 
-			fields [i].type);
+		const SnapSection *section = SnapFindSection (stream->sections,
+			stream->num_sections, name);
+		if (!section || section->size == 0)
+			return (0);
+		stream->pos = section->offset;
+		return (section->size);
     }
-	
-    uint8 *block = new uint8 [len];
-    uint8 *ptr = block;
-    uint16 word;
-    uint32 dword;
-    int64  qword;
-    int result;
-	
-    if ((result = UnfreezeBlock (stream, name, block, len)) != SUCCESS)
+    if ((got = SnapRead (stream, buffer, 11)) != 11 ||
+		strncmp (buffer, name, 3) != 0 || buffer [3] != ':' ||
+		(len = atoi (&buffer [4])) <= 0)
     {
-		delete block;
-		return (result);
+		SnapSeek (stream, SnapTell (stream) - got);
+		return (0);
     }
-	
-    // Unpack the block of data into a C structure
-    for (i = 0; i < num_fields; i++)
-    {
-		switch (fields [i].type)
-		{
-		case INT_V:
-			switch (fields [i].size)
-			{
-			case 1:
-				*((uint8 *) base + fields [i].offset) = *ptr++;
-				break;
-			case 2:
-				word  = *ptr++ << 8;
-				word |= *ptr++;
-				*((uint16 *) ((uint8 *) base + fields [i].offset)) = word;
-				break;
-			case 4:
-				dword  = *ptr++ << 24;
-				dword |= *ptr++ << 16;
-				dword |= *ptr++ << 8;
-				dword |= *ptr++;
-				*((uint32 *) ((uint8 *) base + fields [i].offset)) = dword;
-				break;
-			case 8:
-				qword  = (int64) *ptr++ << 56;
-				qword |= (int64) *ptr++ << 48;
-				qword |= (int64) *ptr++ << 40;
-				qword |= (int64) *ptr++ << 32;
-				qword |= (int64) *ptr++ << 24;
-				qword |= (int64) *ptr++ << 16;
-				qword |= (int64) *ptr++ << 8;
-				qword |= (int64) *ptr++;
-				*((int64 *) ((uint8 *) base + fields [i].offset)) = qword;
-				break;
-			}
-			break;
-			case uint8_ARRAY_V:
-				// memmove converted: Different mallocs [Neb]
-				memmove ((uint8 *) base + fields [i].offset, ptr, fields [i].size);
-				ptr += fields [i].size;
-				break;
-			case uint16_ARRAY_V:
-				for (j = 0; j < fields [i].size; j++)
-				{
-					word  = *ptr++ << 8;
-					word |= *ptr++;
-					*((uint16 *) ((uint8 *) base + fields [i].offset + j * 2)) = word;
-				}
-				break;
-			case uint32_ARRAY_V:
-				for (j = 0; j < fields [i].size; j++)
-				{
-					dword  = *ptr++ << 24;
-					dword |= *ptr++ << 16;
-					dword |= *ptr++ << 8;
-					dword |= *ptr++;
-					*((uint32 *) ((uint8 *) base + fields [i].offset + j * 4)) = dword;
-				}
-				break;
-		}
-    }
-	
-    delete [] block;
-    return (result);
+    return (len);
 }
 
-int UnfreezeBlock (STREAM stream, const char *name, uint8 *block, int size)
+int UnfreezeBlock (SnapStream *stream, const char *name, uint8 *block, int size)
 {
-    char buffer [20];
     int len = 0;
     int rem = 0;
     int rew_len;
-    if (READ_STREAM (buffer, 11, stream) != 11 ||
-		strncmp (buffer, name, 3) != 0 || buffer [3] != ':' ||
-		(len = atoi (&buffer [4])) == 0)
-    {
-		REVERT_STREAM(stream, FIND_STREAM(stream)-11, 0);
+    if ((len = UnfreezeBlockHeader (stream, name)) == 0)
 		return (WRONG_FORMAT);
-    }
 
     if (len > size)
     {
 		rem = len - size;
 		len = size;
     }
-    if ((rew_len=READ_STREAM ((char*)block, len, stream)) != len)
+    if ((rew_len=SnapRead (stream, block, len)) != len)
 	{
-		REVERT_STREAM(stream, FIND_STREAM(stream)-11-rew_len, 0);
+		SnapSeek (stream, SnapTell (stream) - 11 - rew_len);
 		return (WRONG_FORMAT);
 	}
+    // The rest of a block longer than expected is skipped; one that claims
+    // more than the state holds is broken
     if (rem)
     {
-		char *junk = new char [rem];
-		READ_STREAM (junk, rem, stream);
-		delete [] junk;
+		if (stream->mem)
+		{
+			if (rem > (int) (stream->mem->used - stream->pos))
+				return (WRONG_FORMAT);
+			SnapSeek (stream, SnapTell (stream) + rem);
+		}
+		else
+		{
+			char *junk = new char [rem];
+			rew_len = SnapRead (stream, junk, rem);
+			delete [] junk;
+			if (rew_len != rem)
+				return (WRONG_FORMAT);
+		}
     }
 	
     return (SUCCESS);
 }
 
-int UnfreezeStructCopy (STREAM stream, const char *name, uint8** block, FreezeData *fields, int num_fields)
+int UnfreezeStructCopy (SnapStream *stream, const char *name, uint8** block, FreezeData *fields, int num_fields)
 {
     // Work out the size of the required block
     int len = 0;
@@ -1292,10 +1911,32 @@ void UnfreezeStructFromCopy (void *base, FreezeData *fields, int num_fields, uin
     }
 }
 
-int UnfreezeBlockCopy (STREAM stream, const char *name, uint8** block, int size)
+int UnfreezeBlockCopy (SnapStream *stream, const char *name, uint8** block, int size)
 {
-    *block = new uint8 [size];
     int result;
+
+    // A block of exactly the expected size in a memory snapshot is used
+    // where it lies; the caller only reads it.
+    if (stream->mem)
+    {
+		int32 start = SnapTell (stream);
+		int len = UnfreezeBlockHeader (stream, name);
+
+		if (len == 0)
+		{
+			*block = NULL;
+			return (WRONG_FORMAT);
+		}
+		if (len == size && stream->pos + len <= stream->mem->used)
+		{
+			*block = stream->mem->data + stream->pos;
+			stream->pos += len;
+			return (SUCCESS);
+		}
+		SnapSeek (stream, start);
+    }
+
+    *block = new uint8 [size];
 	
     if ((result = UnfreezeBlock (stream, name, *block, size)) != SUCCESS)
     {
@@ -1307,6 +1948,16 @@ int UnfreezeBlockCopy (STREAM stream, const char *name, uint8** block, int size)
     return (result);
 }
 
+void FreeBlockCopy (SnapStream *stream, uint8 *block)
+{
+    if (!block)
+		return;
+    if (stream->mem && block >= stream->mem->data &&
+		block < stream->mem->data + stream->mem->size)
+		return;
+    delete [] block;
+}
+
 extern uint8 spc_dump_dsp[0x100];
 
 bool8 S9xSPCDump (const char *filename)
@@ -1376,6 +2027,85 @@ bool8 S9xSPCDump (const char *filename)
 #endif
 }
 
+// Loads a .spc into the APU alone, in the layout S9xSPCDump above writes.
+// The 65c816 side is left untouched; the caller drives the APU itself.
+bool8 S9xSPCLoad (const char *filename)
+{
+    static const char header [] = "SNES-SPC700 Sound File Data";
+    uint8 *spc;
+    FILE *fs;
+    int len;
+    int i;
+
+    if (!(fs = fopen (filename, "rb")))
+		return (FALSE);
+
+    spc = new uint8 [0x10200];
+    memset (spc, 0, 0x10200);
+    len = fread (spc, 1, 0x10200, fs);
+    fclose (fs);
+
+    // The 64 bytes of RAM hidden under the IPL ROM are optional.
+    if (len < 0x10180 || memcmp (spc, header, sizeof (header) - 1) != 0)
+    {
+		delete [] spc;
+		return (FALSE);
+    }
+
+    S9xResetAPU ();
+
+    memmove (IAPU.RAM, &spc [0x100], 0x10000);
+    if (len >= 0x10200)
+		memmove (APU.ExtraRAM, &spc [0x101c0], sizeof (APU.ExtraRAM));
+    else
+		memmove (APU.ExtraRAM, &spc [0x100 + 0xffc0], sizeof (APU.ExtraRAM));
+
+    // Restart the timers and the IPL ROM mapping from the control
+    // register, then put back the counters it just cleared. The port
+    // clear bits only make sense as a write, so they are dropped.
+    uint8 control = IAPU.RAM [0xf1];
+    uint8 counters [3];
+    memmove (counters, &IAPU.RAM [0xfd], 3);
+    APU.ShowROM = FALSE;
+    S9xSetAPUControl (control & 0x87);
+    for (i = 0; i < 3; i++)
+		IAPU.RAM [0xfd + i] = counters [i] & 0xf;
+
+    // Registers go through the normal write path so the mixer picks
+    // them up; KON last so every voice sees its final settings.
+    uint8 dsp_addr = IAPU.RAM [0xf2];
+    for (i = 0; i < 0x80; i++)
+    {
+		if (i == APU_KON || i == APU_KOFF || i == APU_ENDX)
+			continue;
+		IAPU.RAM [0xf2] = i;
+		S9xSetAPUDSP (spc [0x10100 + i]);
+    }
+    APU.DSP [APU_ENDX] = spc [0x10100 + APU_ENDX];
+    IAPU.RAM [0xf2] = APU_KON;
+    S9xSetAPUDSP (spc [0x10100 + APU_KON]);
+    IAPU.RAM [0xf2] = dsp_addr;
+
+    IAPU.Registers.PC = spc [0x25] | (spc [0x26] << 8);
+    IAPU.Registers.YA.B.A = spc [0x27];
+    IAPU.Registers.X = spc [0x28];
+    IAPU.Registers.YA.B.Y = spc [0x29];
+    IAPU.Registers.P = spc [0x2a];
+    IAPU.Registers.S = spc [0x2b];
+    S9xAPUUnpackStatus ();
+    if (APUCheckDirectPage ())
+		IAPU.DirectPage = IAPU.RAM + 0x100;
+    else
+		IAPU.DirectPage = IAPU.RAM;
+    IAPU.PC = IAPU.RAM + IAPU.Registers.PC;
+
+    APU.Cycles = 0;
+    IAPU.APUExecuting = TRUE;
+
+    delete [] spc;
+    return (TRUE);
+}
+
 bool8 S9xUnfreezeZSNES (const char *filename)
 {
     FILE *fs;
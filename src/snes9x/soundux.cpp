@@ -130,6 +130,8 @@
 #include "apu.h"
 #include "memmap.h"
 #include "cpuexec.h"
+#include "resampler.h"
+#include "sdsp.h"
 
 extern int32 Echo [24000];
 extern int32 DummyEchoBuffer [SOUND_BUFFER_SIZE];
@@ -235,12 +237,12 @@ void S9xSetEnvRate (Channel *ch, unsigned long rate, int direction, int target)
 	(int64) FIXED_POINT * 1000 * 619
     };
 	
-    if (rate == 0 || so.playback_rate == 0)
+    if (rate == 0 || so.mix_rate == 0)
 		ch->erate = 0;
     else
     {
 		ch->erate = (unsigned long)
-			(steps [ch->state] / (rate * so.playback_rate));
+			(steps [ch->state] / (rate * so.mix_rate));
     }
 }
 
@@ -346,7 +348,7 @@ void S9xSetEchoFeedback (int feedback)
 
 void S9xSetEchoDelay (int delay)
 {
-    SoundData.echo_buffer_size = (512 * delay * so.playback_rate) / 32000;
+    SoundData.echo_buffer_size = (512 * delay * so.mix_rate) / 32000;
 #ifndef FOREVER_STEREO
     if (so.stereo)
 #endif
@@ -515,13 +517,14 @@ void S9xSetSoundSample (int channel, uint16 sample_number)
 
 void S9xSetSoundFrequency (int channel, int hertz)
 {
-    if (so.playback_rate)
+    if (so.mix_rate)
     {
 		if (SoundData.channels[channel].type == SOUND_NOISE)
 			hertz = NoiseFreq [APU.DSP [APU_FLG] & 0x1f];
 		SoundData.channels[channel].frequency = (int)
-			(((int64) hertz * FIXED_POINT) / so.playback_rate);
-		if (Settings.FixFrequency)
+			(((int64) hertz * FIXED_POINT) / so.mix_rate);
+		// Mixing at the native rate needs no fudge factor.
+		if (Settings.FixFrequency && so.mix_rate == so.playback_rate)
 		{
 			SoundData.channels[channel].frequency = 
 				(unsigned long) (SoundData.channels[channel].frequency * 49 / 50);
@@ -1108,7 +1111,8 @@ static inline void MixStereo (int sample_count)
 		unsigned long freq0 = ch->frequency;
 
 		//		freq0 = (unsigned long) ((double) freq0 * 0.985);//uncommented by jonathan gevaryahu, as it is necessary for most cards in linux
-		freq0 = freq0 * 985/1000;
+		if (so.mix_rate == so.playback_rate)
+			freq0 = freq0 * 985/1000;
 
 		bool8 mod = pitch_mod & (1 << J);
 
@@ -1694,11 +1698,36 @@ void S9xMixSamplesO (uint8 *buffer, int sample_count, int byte_offset)
 END_OF_FUNCTION(S9xMixSamplesO);
 #endif
 
-void S9xMixSamples (uint8 *buffer, int sample_count)
+bool8 S9xSDSPActive ()
+{
+    return (Settings.SoundCore == SOUND_CORE_SDSP &&
+		so.mix_rate == RESAMPLER_NATIVE_RATE
+#ifndef FOREVER_16_BIT_SOUND
+		&& so.sixteen_bit
+#endif
+		);
+}
+
+static void S9xMixSamplesDirect (uint8 *buffer, int sample_count)
 {
     int J;
     int I;
 	
+    if (S9xSDSPActive ())
+    {
+#ifndef FOREVER_STEREO
+		int channels = so.stereo ? 2 : 1;
+#else
+		int channels = 2;
+#endif
+		// The DSP runs on while muted, so that the envelopes, ENDX and the
+		// echo ring a game may read are what they would be with sound
+		S9xSDSPMix ((int16 *) buffer, sample_count / channels, channels == 2);
+		if (so.mute_sound)
+			memset (buffer, 0, sample_count * sizeof (int16));
+		return;
+    }
+
     if (!so.mute_sound)
     {
 		if (SoundData.echo_enable)
@@ -2014,6 +2043,192 @@ void S9xMixSamples (uint8 *buffer, int sample_count)
 #endif
 }
 
+
+// Largest device-rate request handed to the resampler at once, so the
+// native-rate mix it pulls in always fits MixBuffer.
+#define RESAMPLE_CHUNK 2048
+
+static void S9xMixSamplesOutput (uint8 *buffer, int sample_count)
+{
+    if (so.mix_rate == so.playback_rate)
+    {
+		S9xMixSamplesDirect (buffer, sample_count);
+		return;
+    }
+
+#ifndef FOREVER_STEREO
+    int channels = so.stereo ? 2 : 1;
+#else
+    int channels = 2;
+#endif
+    int16 *out = (int16 *) buffer;
+    int frames = sample_count / channels;
+
+    while (frames > 0)
+    {
+		int chunk = frames > RESAMPLE_CHUNK ? RESAMPLE_CHUNK : frames;
+		int needed = S9xResamplerRequired (chunk);
+
+		if (needed)
+		{
+			S9xMixSamplesDirect ((uint8 *) S9xResamplerWritePtr (), needed * channels);
+			S9xResamplerPush (needed);
+		}
+		S9xResamplerRun (out, chunk);
+		out += chunk * channels;
+		frames -= chunk;
+    }
+}
+
+// Frame-batched mixing. Instead of the port pulling small slices through
+// S9xGenerateSound on every scanline, the frame is rendered into BatchBuffer
+// lazily: each DSP register write first mixes up to its own timestamp, so it
+// takes effect at the right sample, and the port collects the whole frame
+// with a single S9xMixSamples call at frame end. BatchFrame is where the
+// current frame starts in the buffer, after what the output has not taken
+// of the last one.
+static int16 BatchBuffer [SOUND_BUFFER_SIZE];
+static int BatchRendered;
+static int BatchRead;
+static int BatchFrame;
+
+// Samples kept for the output from one frame to the next; when it falls
+// further behind than this, the oldest are dropped.
+#define BATCH_MAX_LEFTOVER (SOUND_BUFFER_SIZE / 4)
+
+static inline bool8 S9xSoundBatching ()
+{
+#ifndef FOREVER_16_BIT_SOUND
+    return (Settings.SoundFrameBatch && so.sixteen_bit);
+#else
+    return (Settings.SoundFrameBatch);
+#endif
+}
+
+static void S9xBatchRender (int samples)
+{
+    if (samples > SOUND_BUFFER_SIZE)
+		samples = SOUND_BUFFER_SIZE;
+    if (samples > BatchRendered)
+    {
+		S9xMixSamplesOutput ((uint8 *) &BatchBuffer [BatchRendered],
+			samples - BatchRendered);
+		BatchRendered = samples;
+    }
+}
+
+void S9xResetSoundBatch ()
+{
+    BatchRendered = 0;
+    BatchRead = 0;
+    BatchFrame = 0;
+}
+
+void S9xCatchUpSound ()
+{
+    if (!S9xSoundBatching () || !so.playback_rate)
+		return;
+
+    // so.err_counter holds the frame position at the start of this scanline
+    // (16.16 samples); the APU's progress through the line supplies the rest.
+    int32 cycles = APU.Cycles;
+    if (cycles < 0)
+		cycles = 0;
+    else if (cycles > Settings.H_Max)
+		cycles = Settings.H_Max;
+    uint32 pos = so.err_counter +
+		(uint32) (((int64) cycles * so.err_rate) / Settings.H_Max);
+
+#ifndef FOREVER_STEREO
+    int channels = so.stereo ? 2 : 1;
+#else
+    int channels = 2;
+#endif
+    S9xBatchRender (BatchFrame + (int) (pos >> FIXED_POINT_SHIFT) * channels);
+}
+
+// Called by the port once it has collected the frame, before it resets
+// so.err_counter. The DSP is clocked to the end of the frame whether or
+// not the output had room for all of it.
+void S9xEndSoundFrame ()
+{
+    if (!S9xSoundBatching ())
+		return;
+
+#ifndef FOREVER_STEREO
+    int channels = so.stereo ? 2 : 1;
+#else
+    int channels = 2;
+#endif
+    BatchFrame += (int) (so.err_counter >> FIXED_POINT_SHIFT) * channels;
+    S9xBatchRender (BatchFrame);
+
+    if (BatchRendered - BatchRead > BATCH_MAX_LEFTOVER)
+		BatchRead = BatchRendered - BATCH_MAX_LEFTOVER;
+    if (BatchRead)
+    {
+		memmove (BatchBuffer, &BatchBuffer [BatchRead],
+			(BatchRendered - BatchRead) * sizeof (int16));
+		BatchRendered -= BatchRead;
+		BatchFrame -= BatchRead;
+		BatchRead = 0;
+    }
+    if (BatchFrame < 0)
+		BatchFrame = 0;
+}
+
+void S9xMixSamples (uint8 *buffer, int sample_count)
+{
+    if (!S9xSoundBatching ())
+    {
+		S9xMixSamplesOutput (buffer, sample_count);
+		return;
+    }
+
+    // Whatever has not been rendered by a register write yet is mixed in
+    // one go; the output may still split the copy at its ring wraparound.
+    S9xBatchRender (BatchRead + sample_count);
+
+    int avail = BatchRendered - BatchRead;
+    if (avail > sample_count)
+		avail = sample_count;
+    memcpy (buffer, &BatchBuffer [BatchRead], avail * sizeof (int16));
+    if (avail < sample_count)
+		memset (buffer + avail * sizeof (int16), 0, (sample_count - avail) * sizeof (int16));
+    BatchRead += avail;
+}
+
+// The mixer's own state, outside SoundData: the echo history and FIR taps
+// that DSP writes reset, the noise generator and the frame position.
+static struct {
+    SoundStatus so;
+    int32 echo [24000];
+    int32 loop [16];
+    int32 filter_taps [8];
+    uint8 filter_tap_bits;
+    int32 noise_gen;
+} SavedMixer;
+
+void S9xSaveMixerState ()
+{
+    memcpy (&SavedMixer.so, (const void *) &so, sizeof (so));
+    memcpy (SavedMixer.echo, Echo, sizeof (SavedMixer.echo));
+    memcpy (SavedMixer.loop, Loop, sizeof (SavedMixer.loop));
+    memcpy (SavedMixer.filter_taps, FilterTaps, sizeof (SavedMixer.filter_taps));
+    SavedMixer.filter_tap_bits = FilterTapDefinitionBitfield;
+    SavedMixer.noise_gen = noise_gen;
+}
+
+void S9xRestoreMixerState ()
+{
+    memcpy ((void *) &so, &SavedMixer.so, sizeof (so));
+    memcpy (Echo, SavedMixer.echo, sizeof (SavedMixer.echo));
+    memcpy (Loop, SavedMixer.loop, sizeof (SavedMixer.loop));
+    memcpy (FilterTaps, SavedMixer.filter_taps, sizeof (SavedMixer.filter_taps));
+    FilterTapDefinitionBitfield = SavedMixer.filter_tap_bits;
+    noise_gen = SavedMixer.noise_gen;
+}
+
 #ifdef __DJGPP
 END_OF_FUNCTION(S9xMixSamples);
 #endif
@@ -2099,6 +2314,27 @@ void S9xResetSound (bool8 full)
 void S9xSetPlaybackRate (uint32 playback_rate)
 {
     so.playback_rate = playback_rate;
+    so.mix_rate = playback_rate;
+    S9xResetSoundBatch ();
+
+    // Mix at the DSP's own 32 kHz and let the resampler convert to the
+    // device rate. 8-bit output keeps the old direct path. The sample-
+    // accurate core can only run at 32 kHz, so it always takes this path.
+#ifndef FOREVER_16_BIT_SOUND
+    if (so.sixteen_bit)
+#endif
+    if ((Settings.SoundResample || Settings.SoundCore == SOUND_CORE_SDSP) &&
+		playback_rate != RESAMPLER_NATIVE_RATE)
+    {
+#ifndef FOREVER_STEREO
+		int channels = so.stereo ? 2 : 1;
+#else
+		int channels = 2;
+#endif
+		if (S9xResamplerInit (RESAMPLER_NATIVE_RATE, playback_rate, channels))
+			so.mix_rate = RESAMPLER_NATIVE_RATE;
+    }
+
     so.err_rate = (uint32) (SNES_SCANLINE_TIME * FIXED_POINT / (1.0 / (double) so.playback_rate));
     S9xSetEchoDelay (APU.DSP [APU_EDL] & 0xf);
     for (int i = 0; i < 8; i++)
@@ -2111,6 +2347,7 @@ bool8 S9xInitSound (int mode, bool8 stereo, int buffer_size)
     so.sound_switch = 255;
 	
     so.playback_rate = 0;
+    so.mix_rate = 0;
     so.buffer_size = 0;
 #ifndef FOREVER_STEREO
     so.stereo = stereo;
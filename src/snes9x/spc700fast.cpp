@@ -0,0 +1,1058 @@
+/*
+ * Threaded SPC700 interpreter.
+ *
+ * Same instruction semantics and cycle counts as the table-driven core in
+ * spc700.cpp, but the whole run lives in one function: registers, flags
+ * and the cycle counter are locals, and each handler dispatches straight to
+ * the next through a computed goto until the cycle budget is spent. State is
+ * written back to IAPU/APU only at the end of the run and before an I/O
+ * register access that can observe it.
+ *
+ * Build with SPC700_VERIFY to run every instruction through both cores and
+ * report the first one that leaves a different machine state.
+ */
+#include <string.h>
+
+#include "snes9x.h"
+#include "spc700.h"
+#include "memmap.h"
+#include "display.h"
+#include "cpuexec.h"
+#include "apu.h"
+#ifdef SPC700_VERIFY
+#include "soundux.h"
+#endif
+
+#ifdef SPC700_FAST
+
+// I/O slow paths; defined from apumem.h in spc700.cpp.
+uint8 S9xAPUGetByteZ (uint8 Address);
+uint8 S9xAPUGetByte (uint32 Address);
+void S9xAPUSetByteZ (uint8 byte, uint8 Address);
+void S9xAPUSetByte (uint8 byte, uint32 Address);
+
+#define OP1 (pc [1])
+#define OP2 (pc [2])
+
+// Everything an I/O handler may look at: PC for the shutdown wait
+// addresses, the registers for the SPC dump, the cycle count for the
+// sound catch-up.
+#define SAVE_STATE() \
+    IAPU.PC = pc; \
+    IAPU.Registers.YA.B.A = a; \
+    IAPU.Registers.YA.B.Y = y; \
+    IAPU.Registers.X = x; \
+    IAPU.Registers.S = sp; \
+    IAPU.Registers.P = psw; \
+    IAPU._Carry = carry; \
+    IAPU._Zero = zero; \
+    IAPU._Overflow = overflow; \
+    IAPU.DirectPage = dp; \
+    APU.Cycles = cycles;
+
+#define GETZ(d, addr) \
+{ \
+    uint8 z_ = (uint8) (addr); \
+    if (z_ >= 0xf0 && dp == ram) \
+    { \
+	SAVE_STATE () \
+	(d) = S9xAPUGetByteZ (z_); \
+    } \
+    else \
+	(d) = dp [z_]; \
+}
+
+#define SETZ(b, addr) \
+{ \
+    uint8 z_ = (uint8) (addr); \
+    if (z_ >= 0xf0 && dp == ram) \
+    { \
+	SAVE_STATE () \
+	S9xAPUSetByteZ ((b), z_); \
+    } \
+    else \
+	dp [z_] = (b); \
+}
+
+#define GET(d, addr) \
+{ \
+    uint32 a_ = (addr) & 0xffff; \
+    if (a_ - 0xf0 < 0x10) \
+    { \
+	SAVE_STATE () \
+	(d) = S9xAPUGetByte (a_); \
+    } \
+    else \
+	(d) = ram [a_]; \
+}
+
+#define SET(b, addr) \
+{ \
+    uint32 a_ = (addr) & 0xffff; \
+    if (a_ - 0xf0 < 0x10 || a_ >= 0xffc0) \
+    { \
+	SAVE_STATE () \
+	S9xAPUSetByte ((b), a_); \
+    } \
+    else \
+    { \
+	ram [a_] = (b); \
+	DIRTY_MARK (APURAM, a_); \
+    } \
+}
+
+#define SETZN8(b) zero = (b);
+#define SETZN16(w) zero = ((w) != 0) | ((w) >> 8);
+
+#define PACK_STATUS() \
+    psw &= ~(Zero | Negative | Carry | Overflow); \
+    psw |= carry | ((zero == 0) << 1) | (zero & 0x80) | (overflow << 6);
+
+#define UNPACK_STATUS() \
+    zero = ((psw & Zero) == 0) | (psw & Negative); \
+    carry = (psw & Carry); \
+    overflow = (psw & Overflow) >> 6;
+
+#define PUSH(b) \
+    ram [0x100 + sp] = (b); \
+    sp--;
+
+#define POP(b) \
+    sp++; \
+    (b) = ram [0x100 + sp];
+
+#ifdef FAST_LSB_WORD_ACCESS
+#define PUSHW(w) \
+    *(uint16 *) (ram + 0xff + sp) = (w); \
+    sp -= 2;
+#define POPW(w) \
+    sp += 2; \
+    (w) = *(uint16 *) (ram + 0xff + sp);
+#define ABSOLUTE() addr = *(uint16 *) (pc + 1);
+#define INDEXED_X_INDIRECT() addr = *(uint16 *) (dp + ((OP1 + x) & 0xff));
+#define INDIRECT_INDEXED_Y() addr = *(uint16 *) (dp + OP1) + y;
+#else
+#define PUSHW(w) \
+    { \
+	int w_ = (w); \
+	ram [0xff + sp] = w_; \
+	ram [0x100 + sp] = (w_ >> 8); \
+	sp -= 2; \
+    }
+#define POPW(w) \
+    sp += 2; \
+    (w) = ram [0xff + sp] + (ram [0x100 + sp] << 8);
+#define ABSOLUTE() addr = OP1 + (OP2 << 8);
+#define INDEXED_X_INDIRECT() \
+    addr = dp [(OP1 + x) & 0xff] + (dp [(OP1 + x + 1) & 0xff] << 8);
+#define INDIRECT_INDEXED_Y() \
+    addr = dp [OP1] + (dp [OP1 + 1] << 8) + y;
+#endif
+
+#define MEMBIT() \
+    ABSOLUTE () \
+    bit = (uint8) (addr >> 13); \
+    addr &= 0x1fff;
+
+#define RELATIVE(len, off) \
+    int16 target16 = (int) (pc + (len) - ram) + (int8) (off);
+
+#define SHUTDOWN() \
+    if (Settings.Shutdown && (pc == IAPU.WaitAddress1 || pc == IAPU.WaitAddress2)) \
+    { \
+	if (IAPU.WaitCounter == 0) \
+	{ \
+	    if (!ICPU.CPUExecuting) \
+		target = cycles = CPU.Cycles = CPU.NextEvent; \
+	    else \
+		IAPU.APUExecuting = FALSE; \
+	} \
+	else \
+	if (IAPU.WaitCounter >= 2) \
+	    IAPU.WaitCounter = 1; \
+	else \
+	    IAPU.WaitCounter--; \
+    }
+
+#define BRANCH(cond, len, off, shutdown) \
+{ \
+    RELATIVE (len, off) \
+    if (cond) \
+    { \
+	pc = ram + (uint16) target16; \
+	cycles += two_cycles; \
+	shutdown \
+    } \
+    else \
+	pc += (len); \
+}
+
+#define ADC(r, b) \
+{ \
+    uint16 w16 = (r) + (b) + carry; \
+    carry = w16 >= 0x100; \
+    overflow = (~((r) ^ (b)) & ((b) ^ (uint8) w16) & 0x80) != 0; \
+    psw &= ~HalfCarry; \
+    if (((r) ^ (b) ^ (uint8) w16) & 0x10) \
+	psw |= HalfCarry; \
+    (r) = (uint8) w16; \
+    SETZN8 ((uint8) w16) \
+}
+
+#define SBC(r, b) \
+{ \
+    int16 i16 = (short) (r) - (short) (b) + (short) carry - 1; \
+    carry = i16 >= 0; \
+    overflow = ((((r) ^ (b)) & 0x80) && (((r) ^ (uint8) i16) & 0x80)); \
+    psw |= HalfCarry; \
+    if (((r) ^ (b) ^ (uint8) i16) & 0x10) \
+	psw &= ~HalfCarry; \
+    (r) = (uint8) i16; \
+    SETZN8 ((uint8) i16) \
+}
+
+#define CMP(r, b) \
+{ \
+    int16 i16 = (short) (r) - (short) (b); \
+    carry = i16 >= 0; \
+    SETZN8 ((uint8) i16) \
+}
+
+#define ASL(b) carry = ((b) & 0x80) != 0; (b) <<= 1; SETZN8 (b)
+#define LSR(b) carry = (b) & 1; (b) >>= 1; SETZN8 (b)
+#define ROL(b) \
+{ \
+    uint16 w16 = ((b) << 1) | carry; \
+    carry = w16 >= 0x100; \
+    (b) = (uint8) w16; \
+    SETZN8 (b) \
+}
+#define ROR(b) \
+{ \
+    uint16 w16 = (b) | ((uint16) carry << 8); \
+    carry = (uint8) w16 & 1; \
+    w16 >>= 1; \
+    (b) = (uint8) w16; \
+    SETZN8 (b) \
+}
+
+#define OR_(r, b)  (r) |= (b); SETZN8 (r)
+#define AND_(r, b) (r) &= (b); SETZN8 (r)
+#define EOR_(r, b) (r) ^= (b); SETZN8 (r)
+#define MOV_(r, b) (r) = (b); SETZN8 (r)
+
+#ifdef __GNUC__
+#define OPC(n) op_##n:
+#define NEXT() \
+    do { \
+	FETCH (); \
+	goto *Labels [opcode]; \
+    } while (0)
+#else
+#define OPC(n) case 0x##n:
+#define NEXT() goto next
+#endif
+
+#ifdef SPC700_VERIFY
+#define FETCH() \
+    if (cycles > target || (single && executed++)) \
+	goto done; \
+    opcode = *pc; \
+    cycles += S9xAPUCycles [opcode];
+#else
+#define FETCH() \
+    if (cycles > target) \
+	goto done; \
+    opcode = *pc; \
+    cycles += S9xAPUCycles [opcode];
+#endif
+
+#define TCALL(n) \
+    PUSHW (pc - ram + 1) \
+    pc = ram + (APU.ExtraRAM [((15 - (n)) << 1)] + \
+		(APU.ExtraRAM [((15 - (n)) << 1) + 1] << 8));
+
+// Runs instructions while the APU is not ahead of the 65c816, exactly like
+// looping APU_EXECUTE1 on CPU.Cycles.
+static void S9xAPUExecuteRun (bool8 single)
+{
+    uint8 *const ram = IAPU.RAM;
+    uint8 *pc = IAPU.PC;
+    uint8 *dp = IAPU.DirectPage;
+    uint8 a = IAPU.Registers.YA.B.A;
+    uint8 y = IAPU.Registers.YA.B.Y;
+    uint8 x = IAPU.Registers.X;
+    uint8 sp = IAPU.Registers.S;
+    uint8 psw = IAPU.Registers.P;
+    uint8 carry = IAPU._Carry;
+    uint8 zero = IAPU._Zero;
+    uint8 overflow = IAPU._Overflow;
+    int32 cycles = APU.Cycles;
+    int32 target = CPU.Cycles;
+    const int32 two_cycles = IAPU.TwoCycles;
+    uint32 addr;
+    uint8 bit;
+    uint8 opcode;
+#ifdef SPC700_VERIFY
+    int executed = 0;
+#endif
+
+#ifdef __GNUC__
+    static const void *const Labels [256] = {
+	&&op_00, &&op_01, &&op_02, &&op_03, &&op_04, &&op_05, &&op_06, &&op_07,
+	&&op_08, &&op_09, &&op_0A, &&op_0B, &&op_0C, &&op_0D, &&op_0E, &&op_0F,
+	&&op_10, &&op_11, &&op_12, &&op_13, &&op_14, &&op_15, &&op_16, &&op_17,
+	&&op_18, &&op_19, &&op_1A, &&op_1B, &&op_1C, &&op_1D, &&op_1E, &&op_1F,
+	&&op_20, &&op_21, &&op_22, &&op_23, &&op_24, &&op_25, &&op_26, &&op_27,
+	&&op_28, &&op_29, &&op_2A, &&op_2B, &&op_2C, &&op_2D, &&op_2E, &&op_2F,
+	&&op_30, &&op_31, &&op_32, &&op_33, &&op_34, &&op_35, &&op_36, &&op_37,
+	&&op_38, &&op_39, &&op_3A, &&op_3B, &&op_3C, &&op_3D, &&op_3E, &&op_3F,
+	&&op_40, &&op_41, &&op_42, &&op_43, &&op_44, &&op_45, &&op_46, &&op_47,
+	&&op_48, &&op_49, &&op_4A, &&op_4B, &&op_4C, &&op_4D, &&op_4E, &&op_4F,
+	&&op_50, &&op_51, &&op_52, &&op_53, &&op_54, &&op_55, &&op_56, &&op_57,
+	&&op_58, &&op_59, &&op_5A, &&op_5B, &&op_5C, &&op_5D, &&op_5E, &&op_5F,
+	&&op_60, &&op_61, &&op_62, &&op_63, &&op_64, &&op_65, &&op_66, &&op_67,
+	&&op_68, &&op_69, &&op_6A, &&op_6B, &&op_6C, &&op_6D, &&op_6E, &&op_6F,
+	&&op_70, &&op_71, &&op_72, &&op_73, &&op_74, &&op_75, &&op_76, &&op_77,
+	&&op_78, &&op_79, &&op_7A, &&op_7B, &&op_7C, &&op_7D, &&op_7E, &&op_7F,
+	&&op_80, &&op_81, &&op_82, &&op_83, &&op_84, &&op_85, &&op_86, &&op_87,
+	&&op_88, &&op_89, &&op_8A, &&op_8B, &&op_8C, &&op_8D, &&op_8E, &&op_8F,
+	&&op_90, &&op_91, &&op_92, &&op_93, &&op_94, &&op_95, &&op_96, &&op_97,
+	&&op_98, &&op_99, &&op_9A, &&op_9B, &&op_9C, &&op_9D, &&op_9E, &&op_9F,
+	&&op_A0, &&op_A1, &&op_A2, &&op_A3, &&op_A4, &&op_A5, &&op_A6, &&op_A7,
+	&&op_A8, &&op_A9, &&op_AA, &&op_AB, &&op_AC, &&op_AD, &&op_AE, &&op_AF,
+	&&op_B0, &&op_B1, &&op_B2, &&op_B3, &&op_B4, &&op_B5, &&op_B6, &&op_B7,
+	&&op_B8, &&op_B9, &&op_BA, &&op_BB, &&op_BC, &&op_BD, &&op_BE, &&op_BF,
+	&&op_C0, &&op_C1, &&op_C2, &&op_C3, &&op_C4, &&op_C5, &&op_C6, &&op_C7,
+	&&op_C8, &&op_C9, &&op_CA, &&op_CB, &&op_CC, &&op_CD, &&op_CE, &&op_CF,
+	&&op_D0, &&op_D1, &&op_D2, &&op_D3, &&op_D4, &&op_D5, &&op_D6, &&op_D7,
+	&&op_D8, &&op_D9, &&op_DA, &&op_DB, &&op_DC, &&op_DD, &&op_DE, &&op_DF,
+	&&op_E0, &&op_E1, &&op_E2, &&op_E3, &&op_E4, &&op_E5, &&op_E6, &&op_E7,
+	&&op_E8, &&op_E9, &&op_EA, &&op_EB, &&op_EC, &&op_ED, &&op_EE, &&op_EF,
+	&&op_F0, &&op_F1, &&op_F2, &&op_F3, &&op_F4, &&op_F5, &&op_F6, &&op_F7,
+	&&op_F8, &&op_F9, &&op_FA, &&op_FB, &&op_FC, &&op_FD, &&op_FE, &&op_FF
+    };
+
+    NEXT ();
+#else
+next:
+    FETCH ();
+    switch (opcode)
+    {
+#endif
+
+// ---- x0: branches and flag operations ----
+OPC (00) pc++; NEXT ();
+OPC (10) BRANCH (!(zero & 0x80), 2, OP1, SHUTDOWN ()) NEXT ();
+OPC (20) psw &= ~DirectPageFlag; dp = ram; pc++; NEXT ();
+OPC (30) BRANCH (zero & 0x80, 2, OP1, SHUTDOWN ()) NEXT ();
+OPC (40) psw |= DirectPageFlag; dp = ram + 0x100; pc++; NEXT ();
+OPC (50) BRANCH (!overflow, 2, OP1, ) NEXT ();
+OPC (60) carry = 0; pc++; NEXT ();
+OPC (70) BRANCH (overflow, 2, OP1, ) NEXT ();
+OPC (80) carry = 1; pc++; NEXT ();
+OPC (90) BRANCH (!carry, 2, OP1, SHUTDOWN ()) NEXT ();
+OPC (A0) psw |= Interrupt; pc++; NEXT ();
+OPC (B0) BRANCH (carry, 2, OP1, SHUTDOWN ()) NEXT ();
+OPC (C0) psw &= ~Interrupt; pc++; NEXT ();
+OPC (D0) BRANCH (zero != 0, 2, OP1, SHUTDOWN ()) NEXT ();
+OPC (E0) psw &= ~HalfCarry; overflow = 0; pc++; NEXT ();
+OPC (F0) BRANCH (zero == 0, 2, OP1, SHUTDOWN ()) NEXT ();
+
+// ---- x1: TCALL ----
+OPC (01) TCALL (0) NEXT ();
+OPC (11) TCALL (1) NEXT ();
+OPC (21) TCALL (2) NEXT ();
+OPC (31) TCALL (3) NEXT ();
+OPC (41) TCALL (4) NEXT ();
+OPC (51) TCALL (5) NEXT ();
+OPC (61) TCALL (6) NEXT ();
+OPC (71) TCALL (7) NEXT ();
+OPC (81) TCALL (8) NEXT ();
+OPC (91) TCALL (9) NEXT ();
+OPC (A1) TCALL (10) NEXT ();
+OPC (B1) TCALL (11) NEXT ();
+OPC (C1) TCALL (12) NEXT ();
+OPC (D1) TCALL (13) NEXT ();
+OPC (E1) TCALL (14) NEXT ();
+OPC (F1) TCALL (15) NEXT ();
+
+// ---- x2: SET1 / CLR1 dp.bit ----
+#define SET1(b) { uint8 t; GETZ (t, OP1); SETZ ((uint8) (t | (1 << (b))), OP1); pc += 2; }
+#define CLR1(b) { uint8 t; GETZ (t, OP1); SETZ ((uint8) (t & ~(1 << (b))), OP1); pc += 2; }
+OPC (02) SET1 (0) NEXT ();
+OPC (22) SET1 (1) NEXT ();
+OPC (42) SET1 (2) NEXT ();
+OPC (62) SET1 (3) NEXT ();
+OPC (82) SET1 (4) NEXT ();
+OPC (A2) SET1 (5) NEXT ();
+OPC (C2) SET1 (6) NEXT ();
+OPC (E2) SET1 (7) NEXT ();
+OPC (12) CLR1 (0) NEXT ();
+OPC (32) CLR1 (1) NEXT ();
+OPC (52) CLR1 (2) NEXT ();
+OPC (72) CLR1 (3) NEXT ();
+OPC (92) CLR1 (4) NEXT ();
+OPC (B2) CLR1 (5) NEXT ();
+OPC (D2) CLR1 (6) NEXT ();
+OPC (F2) CLR1 (7) NEXT ();
+
+// ---- x3: BBS / BBC dp.bit,rel ----
+#define BBS(b) { uint8 t; GETZ (t, OP1); BRANCH (t & (1 << (b)), 3, OP2, ) }
+#define BBC(b) { uint8 t; GETZ (t, OP1); BRANCH (!(t & (1 << (b))), 3, OP2, ) }
+OPC (03) BBS (0) NEXT ();
+OPC (23) BBS (1) NEXT ();
+OPC (43) BBS (2) NEXT ();
+OPC (63) BBS (3) NEXT ();
+OPC (83) BBS (4) NEXT ();
+OPC (A3) BBS (5) NEXT ();
+OPC (C3) BBS (6) NEXT ();
+OPC (E3) BBS (7) NEXT ();
+OPC (13) BBC (0) NEXT ();
+OPC (33) BBC (1) NEXT ();
+OPC (53) BBC (2) NEXT ();
+OPC (73) BBC (3) NEXT ();
+OPC (93) BBC (4) NEXT ();
+OPC (B3) BBC (5) NEXT ();
+OPC (D3) BBC (6) NEXT ();
+OPC (F3) BBC (7) NEXT ();
+
+// ---- x4..x9: ALU on A and memory-to-memory forms ----
+#define A_DP(OP)    { uint8 t; GETZ (t, OP1); OP (a, t); pc += 2; }
+#define A_DPX(OP)   { uint8 t; GETZ (t, OP1 + x); OP (a, t); pc += 2; }
+#define A_ABS(OP)   { uint8 t; ABSOLUTE () GET (t, addr); OP (a, t); pc += 3; }
+#define A_ABSX(OP)  { uint8 t; ABSOLUTE () addr += x; GET (t, addr); OP (a, t); pc += 3; }
+#define A_ABSY(OP)  { uint8 t; ABSOLUTE () addr += y; GET (t, addr); OP (a, t); pc += 3; }
+#define A_IX(OP)    { uint8 t; GETZ (t, x); OP (a, t); pc++; }
+#define A_DPXI(OP)  { uint8 t; INDEXED_X_INDIRECT () GET (t, addr); OP (a, t); pc += 2; }
+#define A_DPIY(OP)  { uint8 t; INDIRECT_INDEXED_Y () GET (t, addr); OP (a, t); pc += 2; }
+#define A_IMM(OP)   { uint8 t = OP1; OP (a, t); pc += 2; }
+
+// dp(dest),dp(src) / dp,#imm / (X),(Y) for the logical ops
+#define LOGIC_DPDP(op) \
+    { uint8 t, u; GETZ (t, OP1); GETZ (u, OP2); t op u; SETZ (t, OP2); SETZN8 (t) pc += 3; }
+#define LOGIC_DPIMM(op) \
+    { uint8 t = OP1, u; GETZ (u, OP2); t op u; SETZ (t, OP2); SETZN8 (t) pc += 3; }
+#define LOGIC_XY(op) \
+    { uint8 t, u; GETZ (t, x); GETZ (u, y); t op u; SETZN8 (t) SETZ (t, x); pc++; }
+
+// and the arithmetic ones, which read destination second
+#define ARITH_DPDP(OP) \
+    { uint8 s, d; GETZ (s, OP1); GETZ (d, OP2); OP (d, s); SETZ (d, OP2); pc += 3; }
+#define ARITH_DPIMM(OP) \
+    { uint8 s = OP1, d; GETZ (d, OP2); OP (d, s); SETZ (d, OP2); pc += 3; }
+#define ARITH_XY(OP) \
+    { uint8 d, s; GETZ (d, x); GETZ (s, y); OP (d, s); SETZ (d, x); pc++; }
+
+#define CMP_DPDP()  { uint8 s, d; GETZ (s, OP1); GETZ (d, OP2); CMP (d, s); pc += 3; }
+#define CMP_DPIMM() { uint8 s = OP1, d; GETZ (d, OP2); CMP (d, s); pc += 3; }
+#define CMP_XY()    { uint8 d, s; GETZ (d, x); GETZ (s, y); CMP (d, s); pc++; }
+
+#define ORA(r, t)  OR_ (r, t)
+#define ANDA(r, t) AND_ (r, t)
+#define EORA(r, t) EOR_ (r, t)
+
+OPC (04) A_DP (ORA) NEXT ();
+OPC (05) A_ABS (ORA) NEXT ();
+OPC (06) A_IX (ORA) NEXT ();
+OPC (07) A_DPXI (ORA) NEXT ();
+OPC (08) A_IMM (ORA) NEXT ();
+OPC (09) LOGIC_DPDP (|=) NEXT ();
+OPC (14) A_DPX (ORA) NEXT ();
+OPC (15) A_ABSX (ORA) NEXT ();
+OPC (16) A_ABSY (ORA) NEXT ();
+OPC (17) A_DPIY (ORA) NEXT ();
+OPC (18) LOGIC_DPIMM (|=) NEXT ();
+OPC (19) LOGIC_XY (|=) NEXT ();
+
+OPC (24) A_DP (ANDA) NEXT ();
+OPC (25) A_ABS (ANDA) NEXT ();
+OPC (26) A_IX (ANDA) NEXT ();
+OPC (27) A_DPXI (ANDA) NEXT ();
+OPC (28) A_IMM (ANDA) NEXT ();
+OPC (29) LOGIC_DPDP (&=) NEXT ();
+OPC (34) A_DPX (ANDA) NEXT ();
+OPC (35) A_ABSX (ANDA) NEXT ();
+OPC (36) A_ABSY (ANDA) NEXT ();
+OPC (37) A_DPIY (ANDA) NEXT ();
+OPC (38) LOGIC_DPIMM (&=) NEXT ();
+OPC (39) LOGIC_XY (&=) NEXT ();
+
+OPC (44) A_DP (EORA) NEXT ();
+OPC (45) A_ABS (EORA) NEXT ();
+OPC (46) A_IX (EORA) NEXT ();
+OPC (47) A_DPXI (EORA) NEXT ();
+OPC (48) A_IMM (EORA) NEXT ();
+OPC (49) LOGIC_DPDP (^=) NEXT ();
+OPC (54) A_DPX (EORA) NEXT ();
+OPC (55) A_ABSX (EORA) NEXT ();
+OPC (56) A_ABSY (EORA) NEXT ();
+OPC (57) A_DPIY (EORA) NEXT ();
+OPC (58) LOGIC_DPIMM (^=) NEXT ();
+OPC (59) LOGIC_XY (^=) NEXT ();
+
+OPC (64) A_DP (CMP) NEXT ();
+OPC (65) A_ABS (CMP) NEXT ();
+OPC (66) A_IX (CMP) NEXT ();
+OPC (67) A_DPXI (CMP) NEXT ();
+OPC (68) A_IMM (CMP) NEXT ();
+OPC (69) CMP_DPDP () NEXT ();
+OPC (74) A_DPX (CMP) NEXT ();
+OPC (75) A_ABSX (CMP) NEXT ();
+OPC (76) A_ABSY (CMP) NEXT ();
+OPC (77) A_DPIY (CMP) NEXT ();
+OPC (78) CMP_DPIMM () NEXT ();
+OPC (79) CMP_XY () NEXT ();
+
+OPC (84) A_DP (ADC) NEXT ();
+OPC (85) A_ABS (ADC) NEXT ();
+OPC (86) A_IX (ADC) NEXT ();
+OPC (87) A_DPXI (ADC) NEXT ();
+OPC (88) A_IMM (ADC) NEXT ();
+OPC (89) ARITH_DPDP (ADC) NEXT ();
+OPC (94) A_DPX (ADC) NEXT ();
+OPC (95) A_ABSX (ADC) NEXT ();
+OPC (96) A_ABSY (ADC) NEXT ();
+OPC (97) A_DPIY (ADC) NEXT ();
+OPC (98) ARITH_DPIMM (ADC) NEXT ();
+OPC (99) ARITH_XY (ADC) NEXT ();
+
+OPC (A4) A_DP (SBC) NEXT ();
+OPC (A5) A_ABS (SBC) NEXT ();
+OPC (A6) A_IX (SBC) NEXT ();
+OPC (A7) A_DPXI (SBC) NEXT ();
+OPC (A8) A_IMM (SBC) NEXT ();
+OPC (A9) ARITH_DPDP (SBC) NEXT ();
+OPC (B4) A_DPX (SBC) NEXT ();
+OPC (B5) A_ABSX (SBC) NEXT ();
+OPC (B6) A_ABSY (SBC) NEXT ();
+OPC (B7) A_DPIY (SBC) NEXT ();
+OPC (B8) ARITH_DPIMM (SBC) NEXT ();
+OPC (B9) ARITH_XY (SBC) NEXT ();
+
+// ---- stores ----
+OPC (C4) SETZ (a, OP1); pc += 2; NEXT ();
+OPC (C5) ABSOLUTE () SET (a, addr); pc += 3; NEXT ();
+OPC (C6) SETZ (a, x); pc++; NEXT ();
+OPC (C7) INDEXED_X_INDIRECT () SET (a, addr); pc += 2; NEXT ();
+OPC (C9) ABSOLUTE () SET (x, addr); pc += 3; NEXT ();
+OPC (CB) SETZ (y, OP1); pc += 2; NEXT ();
+OPC (CC) ABSOLUTE () SET (y, addr); pc += 3; NEXT ();
+OPC (D4) SETZ (a, OP1 + x); pc += 2; NEXT ();
+OPC (D5) ABSOLUTE () addr += x; SET (a, addr); pc += 3; NEXT ();
+OPC (D6) ABSOLUTE () addr += y; SET (a, addr); pc += 3; NEXT ();
+OPC (D7) INDIRECT_INDEXED_Y () SET (a, addr); pc += 2; NEXT ();
+OPC (D8) SETZ (x, OP1); pc += 2; NEXT ();
+OPC (D9) SETZ (x, OP1 + y); pc += 2; NEXT ();
+OPC (DB) SETZ (y, OP1 + x); pc += 2; NEXT ();
+OPC (8F) SETZ (OP1, OP2); pc += 3; NEXT ();
+OPC (FA) { uint8 t; GETZ (t, OP1); SETZ (t, OP2); } pc += 3; NEXT ();
+OPC (AF) SETZ (a, x); x++; pc++; NEXT ();
+
+// ---- loads ----
+OPC (E4) A_DP (MOV_) NEXT ();
+OPC (E5) A_ABS (MOV_) NEXT ();
+OPC (E6) A_IX (MOV_) NEXT ();
+OPC (E7) A_DPXI (MOV_) NEXT ();
+OPC (E8) A_IMM (MOV_) NEXT ();
+OPC (F4) A_DPX (MOV_) NEXT ();
+OPC (F5) A_ABSX (MOV_) NEXT ();
+OPC (F6) A_ABSY (MOV_) NEXT ();
+OPC (F7) A_DPIY (MOV_) NEXT ();
+OPC (BF) GETZ (a, x); x++; SETZN8 (a) pc++; NEXT ();
+OPC (CD) x = OP1; SETZN8 (x) pc += 2; NEXT ();
+OPC (8D) y = OP1; SETZN8 (y) pc += 2; NEXT ();
+OPC (E9) ABSOLUTE () GET (x, addr); SETZN8 (x) pc += 3; NEXT ();
+OPC (F8) GETZ (x, OP1); SETZN8 (x) pc += 2; NEXT ();
+OPC (F9) GETZ (x, OP1 + y); SETZN8 (x) pc += 2; NEXT ();
+OPC (EB) GETZ (y, OP1); SETZN8 (y) pc += 2; NEXT ();
+OPC (EC) ABSOLUTE () GET (y, addr); SETZN8 (y) pc += 3; NEXT ();
+OPC (FB) GETZ (y, OP1 + x); SETZN8 (y) pc += 2; NEXT ();
+
+// ---- register moves ----
+OPC (7D) a = x; SETZN8 (a) pc++; NEXT ();
+OPC (DD) a = y; SETZN8 (a) pc++; NEXT ();
+OPC (5D) x = a; SETZN8 (x) pc++; NEXT ();
+OPC (FD) y = a; SETZN8 (y) pc++; NEXT ();
+OPC (9D) x = sp; SETZN8 (x) pc++; NEXT ();
+OPC (BD) sp = x; pc++; NEXT ();
+
+// ---- compares against X and Y ----
+OPC (C8) CMP (x, OP1); pc += 2; NEXT ();
+OPC (1E) { uint8 t; ABSOLUTE () GET (t, addr); CMP (x, t); } pc += 3; NEXT ();
+OPC (3E) { uint8 t; GETZ (t, OP1); CMP (x, t); } pc += 2; NEXT ();
+OPC (AD) { uint8 t = OP1; CMP (y, t); } pc += 2; NEXT ();
+OPC (5E) { uint8 t; ABSOLUTE () GET (t, addr); CMP (y, t); } pc += 3; NEXT ();
+OPC (7E) { uint8 t; GETZ (t, OP1); CMP (y, t); } pc += 2; NEXT ();
+
+// ---- shifts and rotates ----
+#define SHIFT_DP(OP)  { uint8 t; GETZ (t, OP1); OP (t); SETZ (t, OP1); pc += 2; }
+#define SHIFT_DPX(OP) { uint8 t; GETZ (t, OP1 + x); OP (t); SETZ (t, OP1 + x); pc += 2; }
+#define SHIFT_ABS(OP) { uint8 t; ABSOLUTE () GET (t, addr); OP (t); SET (t, addr); pc += 3; }
+OPC (0B) SHIFT_DP (ASL) NEXT ();
+OPC (0C) SHIFT_ABS (ASL) NEXT ();
+OPC (1B) SHIFT_DPX (ASL) NEXT ();
+OPC (1C) ASL (a); pc++; NEXT ();
+OPC (2B) SHIFT_DP (ROL) NEXT ();
+OPC (2C) SHIFT_ABS (ROL) NEXT ();
+OPC (3B) SHIFT_DPX (ROL) NEXT ();
+OPC (3C) ROL (a); pc++; NEXT ();
+OPC (4B) SHIFT_DP (LSR) NEXT ();
+OPC (4C) SHIFT_ABS (LSR) NEXT ();
+OPC (5B) SHIFT_DPX (LSR) NEXT ();
+OPC (5C) LSR (a); pc++; NEXT ();
+OPC (6B) SHIFT_DP (ROR) NEXT ();
+OPC (6C) SHIFT_ABS (ROR) NEXT ();
+OPC (7B) SHIFT_DPX (ROR) NEXT ();
+OPC (7C) ROR (a); pc++; NEXT ();
+
+// ---- increments and decrements (feed the shutdown wait counter) ----
+#define INCDEC_REG(r, op) (r) op; SETZN8 (r) IAPU.WaitCounter++; pc++;
+#define INCDEC_DP(d, addrz) \
+    { uint8 t; GETZ (t, addrz); t += (d); SETZ (t, addrz); SETZN8 (t) IAPU.WaitCounter++; pc += 2; }
+#define INCDEC_ABS(d) \
+    { uint8 t; ABSOLUTE () GET (t, addr); t += (d); SET (t, addr); SETZN8 (t) IAPU.WaitCounter++; pc += 3; }
+OPC (3D) INCDEC_REG (x, ++) NEXT ();
+OPC (FC) INCDEC_REG (y, ++) NEXT ();
+OPC (BC) INCDEC_REG (a, ++) NEXT ();
+OPC (1D) INCDEC_REG (x, --) NEXT ();
+OPC (DC) INCDEC_REG (y, --) NEXT ();
+OPC (9C) INCDEC_REG (a, --) NEXT ();
+OPC (AB) INCDEC_DP (1, OP1) NEXT ();
+OPC (BB) INCDEC_DP (1, OP1 + x) NEXT ();
+OPC (AC) INCDEC_ABS (1) NEXT ();
+OPC (8B) INCDEC_DP (-1, OP1) NEXT ();
+OPC (9B) INCDEC_DP (-1, OP1 + x) NEXT ();
+OPC (8C) INCDEC_ABS (-1) NEXT ();
+
+// ---- 16-bit operations ----
+#define GETW_DP(w) \
+    { uint8 lo_, hi_; GETZ (lo_, OP1); GETZ (hi_, OP1 + 1); (w) = lo_ + (hi_ << 8); }
+OPC (1A)
+{
+    uint16 w;
+    GETW_DP (w)
+    w--;
+    SETZ ((uint8) w, OP1);
+    SETZ (w >> 8, OP1 + 1);
+    SETZN16 (w)
+    pc += 2;
+}
+NEXT ();
+OPC (3A)
+{
+    uint16 w;
+    GETW_DP (w)
+    w++;
+    SETZ ((uint8) w, OP1);
+    SETZ (w >> 8, OP1 + 1);
+    SETZN16 (w)
+    pc += 2;
+}
+NEXT ();
+OPC (5A)
+{
+    uint16 w;
+    GETW_DP (w)
+    int32 i32 = (int32) ((y << 8) | a) - (int32) w;
+    carry = i32 >= 0;
+    SETZN16 ((uint16) i32)
+    pc += 2;
+}
+NEXT ();
+OPC (7A)
+{
+    uint16 w;
+    GETW_DP (w)
+    uint16 ya = (y << 8) | a;
+    uint32 w32 = (uint32) ya + w;
+    carry = w32 >= 0x10000;
+    overflow = (~(ya ^ w) & (w ^ (uint16) w32) & 0x8000) != 0;
+    psw &= ~HalfCarry;
+    if ((ya ^ w ^ (uint16) w32) & 0x10)
+	psw |= HalfCarry;
+    ya = (uint16) w32;
+    a = (uint8) ya;
+    y = ya >> 8;
+    SETZN16 (ya)
+    pc += 2;
+}
+NEXT ();
+OPC (9A)
+{
+    uint16 w;
+    GETW_DP (w)
+    uint16 ya = (y << 8) | a;
+    int32 i32 = (int32) ya - (int32) w;
+    carry = i32 >= 0;
+    overflow = (((ya ^ w) & 0x8000) && ((ya ^ (uint16) i32) & 0x8000));
+    psw |= HalfCarry;
+    if ((ya ^ w ^ (uint16) i32) & 0x10)
+	psw &= ~HalfCarry;
+    ya = (uint16) i32;
+    a = (uint8) ya;
+    y = ya >> 8;
+    SETZN16 (ya)
+    pc += 2;
+}
+NEXT ();
+OPC (BA)
+{
+    GETZ (a, OP1);
+    GETZ (y, OP1 + 1);
+    uint16 ya = (y << 8) | a;
+    SETZN16 (ya)
+    pc += 2;
+}
+NEXT ();
+OPC (DA) SETZ (a, OP1); SETZ (y, OP1 + 1); pc += 2; NEXT ();
+OPC (CF)
+{
+    uint16 ya = (uint16) a * y;
+    a = (uint8) ya;
+    y = ya >> 8;
+    SETZN16 (ya)
+    pc++;
+}
+NEXT ();
+OPC (9E)
+{
+    if (x == 0)
+    {
+	overflow = 1;
+	y = 0xff;
+	a = 0xff;
+    }
+    else
+    {
+	uint16 ya = (y << 8) | a;
+	overflow = 0;
+	a = ya / x;
+	y = ya % x;
+    }
+    SETZN8 (a)
+    pc++;
+}
+NEXT ();
+
+// ---- bit operations on absolute memory ----
+OPC (0A)
+{
+    MEMBIT ()
+    if (!carry)
+    {
+	uint8 t;
+	GET (t, addr);
+	if (t & (1 << bit))
+	    carry = 1;
+    }
+    pc += 3;
+}
+NEXT ();
+OPC (2A)
+{
+    MEMBIT ()
+    if (!carry)
+    {
+	uint8 t;
+	GET (t, addr);
+	if (!(t & (1 << bit)))
+	    carry = 1;
+    }
+    pc += 3;
+}
+NEXT ();
+OPC (4A)
+{
+    MEMBIT ()
+    if (carry)
+    {
+	uint8 t;
+	GET (t, addr);
+	if (!(t & (1 << bit)))
+	    carry = 0;
+    }
+    pc += 3;
+}
+NEXT ();
+OPC (6A)
+{
+    MEMBIT ()
+    if (carry)
+    {
+	uint8 t;
+	GET (t, addr);
+	if (t & (1 << bit))
+	    carry = 0;
+    }
+    pc += 3;
+}
+NEXT ();
+OPC (8A)
+{
+    uint8 t;
+    MEMBIT ()
+    GET (t, addr);
+    if (t & (1 << bit))
+	carry = !carry;
+    pc += 3;
+}
+NEXT ();
+OPC (AA)
+{
+    uint8 t;
+    MEMBIT ()
+    GET (t, addr);
+    carry = (t & (1 << bit)) != 0;
+    pc += 3;
+}
+NEXT ();
+OPC (CA)
+{
+    uint8 t;
+    MEMBIT ()
+    GET (t, addr);
+    if (carry)
+	t |= (1 << bit);
+    else
+	t &= ~(1 << bit);
+    SET (t, addr);
+    pc += 3;
+}
+NEXT ();
+OPC (EA)
+{
+    uint8 t;
+    MEMBIT ()
+    GET (t, addr);
+    t ^= (1 << bit);
+    SET (t, addr);
+    pc += 3;
+}
+NEXT ();
+OPC (0E)
+{
+    uint8 t;
+    ABSOLUTE ()
+    GET (t, addr);
+    SET ((uint8) (t | a), addr);
+    t &= a;
+    SETZN8 (t)
+    pc += 3;
+}
+NEXT ();
+OPC (4E)
+{
+    uint8 t;
+    ABSOLUTE ()
+    GET (t, addr);
+    SET ((uint8) (t & ~a), addr);
+    t &= a;
+    SETZN8 (t)
+    pc += 3;
+}
+NEXT ();
+
+// ---- stack ----
+OPC (0D) PACK_STATUS () PUSH (psw) pc++; NEXT ();
+OPC (2D) PUSH (a) pc++; NEXT ();
+OPC (4D) PUSH (x) pc++; NEXT ();
+OPC (6D) PUSH (y) pc++; NEXT ();
+OPC (8E)
+    POP (psw)
+    UNPACK_STATUS ()
+    dp = (psw & DirectPageFlag) ? ram + 0x100 : ram;
+    pc++;
+    NEXT ();
+OPC (AE) POP (a) pc++; NEXT ();
+OPC (CE) POP (x) pc++; NEXT ();
+OPC (EE) POP (y) pc++; NEXT ();
+
+// ---- conditional loops ----
+OPC (2E) { uint8 t; GETZ (t, OP1); BRANCH (t != a, 3, OP2, SHUTDOWN ()) } NEXT ();
+OPC (DE) { uint8 t; GETZ (t, OP1 + x); BRANCH (t != a, 3, OP2, SHUTDOWN ()) } NEXT ();
+OPC (6E)
+{
+    uint8 z = OP1, t;
+    GETZ (t, z);
+    t--;
+    SETZ (t, z);
+    BRANCH (t != 0, 3, OP2, )
+}
+NEXT ();
+OPC (FE)
+{
+    RELATIVE (2, OP1)
+    y--;
+    if (y != 0)
+    {
+	pc = ram + (uint16) target16;
+	cycles += two_cycles;
+    }
+    else
+	pc += 2;
+}
+NEXT ();
+
+// ---- jumps, calls and returns ----
+OPC (2F) { RELATIVE (2, OP1) pc = ram + (uint16) target16; } NEXT ();
+OPC (5F) ABSOLUTE () pc = ram + addr; NEXT ();
+OPC (1F)
+{
+    uint8 lo, hi;
+    ABSOLUTE ()
+    GET (lo, addr + x);
+    GET (hi, addr + x + 1);
+    pc = ram + lo + (hi << 8);
+}
+NEXT ();
+OPC (3F) ABSOLUTE () PUSHW (pc + 3 - ram) pc = ram + addr; NEXT ();
+OPC (4F) { uint8 t = OP1; PUSHW (pc + 2 - ram) pc = ram + 0xff00 + t; } NEXT ();
+OPC (6F)
+    POPW (IAPU.Registers.PC)
+    pc = ram + IAPU.Registers.PC;
+    NEXT ();
+OPC (7F)
+    POP (psw)
+    UNPACK_STATUS ()
+    POPW (IAPU.Registers.PC)
+    pc = ram + IAPU.Registers.PC;
+    NEXT ();
+OPC (0F)
+    PUSHW (pc + 1 - ram)
+    PACK_STATUS ()
+    PUSH (psw)
+    psw |= BreakFlag;
+    psw &= ~Interrupt;
+    pc = ram + APU.ExtraRAM [0x20] + (APU.ExtraRAM [0x21] << 8);
+    NEXT ();
+
+// ---- miscellaneous ----
+OPC (ED) carry ^= 1; pc++; NEXT ();
+OPC (9F) a = (a >> 4) | (a << 4); SETZN8 (a) pc++; NEXT ();
+OPC (BE)
+    if ((a & 0x0f) > 9 || !(psw & HalfCarry))
+	a -= 6;
+    if (a > 0x9f || !carry)
+    {
+	a -= 0x60;
+	carry = 0;
+    }
+    else
+	carry = 1;
+    SETZN8 (a)
+    pc++;
+    NEXT ();
+OPC (DF)
+    if ((a & 0x0f) > 9 || (psw & HalfCarry))
+    {
+	if (a > 0xf0)
+	    carry = 1;
+	a += 6;
+    }
+    if (a > 0x9f || carry)
+    {
+	a += 0x60;
+	carry = 1;
+    }
+    else
+	carry = 0;
+    SETZN8 (a)
+    pc++;
+    NEXT ();
+OPC (EF)
+OPC (FF)
+    // SLEEP/STOP: stop at the next APU_EXECUTE, as the table core does.
+    IAPU.APUExecuting = FALSE;
+    pc++;
+    NEXT ();
+
+#ifndef __GNUC__
+    }
+#endif
+
+done:
+    SAVE_STATE ()
+}
+
+#ifdef SPC700_VERIFY
+static uint8 VerifyRAM [2][0x10000];
+
+static bool8 SameState (const struct SIAPU &i0, const struct SAPU &a0, int32 c0,
+						const struct SIAPU &i1, const struct SAPU &a1, int32 c1)
+{
+    return (i0.PC == i1.PC && i0.DirectPage == i1.DirectPage &&
+			i0.Registers.YA.W == i1.Registers.YA.W &&
+			i0.Registers.X == i1.Registers.X &&
+			i0.Registers.S == i1.Registers.S &&
+			i0.Registers.P == i1.Registers.P &&
+			i0.Registers.PC == i1.Registers.PC &&
+			i0._Carry == i1._Carry && i0._Zero == i1._Zero &&
+			i0._Overflow == i1._Overflow &&
+			i0.APUExecuting == i1.APUExecuting &&
+			i0.WaitAddress1 == i1.WaitAddress1 &&
+			i0.WaitAddress2 == i1.WaitAddress2 &&
+			i0.WaitCounter == i1.WaitCounter &&
+			c0 == c1 && memcmp (&a0, &a1, sizeof (a0)) == 0);
+}
+
+// Steps one instruction through the table core, rewinds, steps it through
+// the threaded core and compares. DSP side effects of the instruction are
+// applied twice, so this is a diagnostic build only.
+static void S9xAPUVerifyStep ()
+{
+    struct SIAPU iapu0 = IAPU;
+    struct SAPU apu0 = APU;
+    SSoundData sound0 = SoundData;
+    int32 cpu0 = CPU.Cycles;
+    uint8 op = *IAPU.PC;
+
+    memcpy (VerifyRAM [0], IAPU.RAM, 0x10000);
+
+    APU.Cycles += S9xAPUCycles [*IAPU.PC];
+    (*S9xApuOpcodes [*IAPU.PC]) ();
+
+    struct SIAPU iapu1 = IAPU;
+    struct SAPU apu1 = APU;
+    int32 cpu1 = CPU.Cycles;
+    memcpy (VerifyRAM [1], IAPU.RAM, 0x10000);
+
+    IAPU = iapu0;
+    APU = apu0;
+    SoundData = sound0;
+    CPU.Cycles = cpu0;
+    memcpy (IAPU.RAM, VerifyRAM [0], 0x10000);
+
+    S9xAPUExecuteRun (TRUE);
+
+    // Scratch fields the table core leaves behind
+    iapu1.Address = IAPU.Address;
+    iapu1.Bit = IAPU.Bit;
+
+    if (!SameState (iapu1, apu1, cpu1, IAPU, APU, CPU.Cycles) ||
+		memcmp (VerifyRAM [1], IAPU.RAM, 0x10000) != 0)
+    {
+		sprintf (String, "SPC700 cores disagree on opcode %02X at %04X",
+			op, (int) (iapu0.PC - IAPU.RAM));
+		S9xMessage (S9X_ERROR, S9X_APU_STOPPED, String);
+
+		// Carry on from the reference result.
+		IAPU = iapu1;
+		APU = apu1;
+		CPU.Cycles = cpu1;
+		memcpy (IAPU.RAM, VerifyRAM [1], 0x10000);
+    }
+}
+#endif
+
+void S9xAPUExecute ()
+{
+#ifdef SPC700_VERIFY
+    while (APU.Cycles <= CPU.Cycles)
+		S9xAPUVerifyStep ();
+#else
+    S9xAPUExecuteRun (FALSE);
+#endif
+}
+
+#endif // SPC700_FAST
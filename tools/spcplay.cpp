@@ -0,0 +1,364 @@
+/*
+ * spcplay - headless .spc player and APU throughput benchmark.
+ *
+ * Loads an .spc into the APU alone (no 65c816, no PPU), runs the SPC700 and
+ * the sound mixer scanline by scanline exactly as the emulator does, and
+ * renders the result to a WAV file as fast as the host allows. The rate it
+ * reaches is printed at the end, so the sound path can be measured on the
+ * handheld without a ROM or the menu.
+ *
+ * usage: spcplay [-t seconds] [-r rate] [-m] [-a] [-s] file.spc [out.wav]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "snes9x.h"
+#include "memmap.h"
+#include "apu.h"
+#include "soundux.h"
+#include "snapshot.h"
+#include "display.h"
+
+#define FIXED_POINT 0x10000UL
+#define FIXED_POINT_REMAINDER 0xffffUL
+#define FIXED_POINT_SHIFT 16
+
+// Same grouping as the device's default sound sync.
+#define SPCPLAY_CHUNK 128
+
+static void usage ()
+{
+    fprintf (stderr,
+		"usage: spcplay [-t seconds] [-r rate] [-m] [-a] [-s] file.spc [out.wav]\n"
+		"  -t  seconds to render (default 60)\n"
+		"  -r  output rate in Hz (default 44100)\n"
+		"  -m  mono output\n"
+		"  -a  use the accurate DSP core\n"
+		"  -s  mix every scanline instead of every %d samples\n"
+		"Without out.wav the audio is rendered and thrown away.\n",
+		SPCPLAY_CHUNK);
+    exit (1);
+}
+
+static void put16 (FILE *fp, uint32 v)
+{
+    fputc (v & 0xff, fp);
+    fputc ((v >> 8) & 0xff, fp);
+}
+
+static void put32 (FILE *fp, uint32 v)
+{
+    put16 (fp, v & 0xffff);
+    put16 (fp, v >> 16);
+}
+
+// Written once up front and again with the final sizes when done.
+static void WriteWavHeader (FILE *fp, int rate, int channels, uint32 frames)
+{
+    uint32 bytes = frames * channels * sizeof (int16);
+
+    fseek (fp, 0, SEEK_SET);
+    fwrite ("RIFF", 1, 4, fp);
+    put32 (fp, 36 + bytes);
+    fwrite ("WAVEfmt ", 1, 8, fp);
+    put32 (fp, 16);
+    put16 (fp, 1);
+    put16 (fp, channels);
+    put32 (fp, rate);
+    put32 (fp, rate * channels * sizeof (int16));
+    put16 (fp, channels * sizeof (int16));
+    put16 (fp, 16);
+    fwrite ("data", 1, 4, fp);
+    put32 (fp, bytes);
+}
+
+static void WriteSamples (FILE *fp, const int16 *buf, int count)
+{
+#ifdef LSB_FIRST
+    fwrite (buf, sizeof (int16), count, fp);
+#else
+    for (int i = 0; i < count; i++)
+		put16 (fp, (uint16) buf [i]);
+#endif
+}
+
+int main (int argc, char **argv)
+{
+    const char *spc_name = NULL;
+    const char *wav_name = NULL;
+    int seconds = 60;
+    int rate = 44100;
+    bool8 stereo = TRUE;
+    bool8 accurate = FALSE;
+    bool8 sync = FALSE;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+		if (!strcmp (argv [i], "-t") && i + 1 < argc)
+			seconds = atoi (argv [++i]);
+		else if (!strcmp (argv [i], "-r") && i + 1 < argc)
+			rate = atoi (argv [++i]);
+		else if (!strcmp (argv [i], "-m"))
+			stereo = FALSE;
+		else if (!strcmp (argv [i], "-a"))
+			accurate = TRUE;
+		else if (!strcmp (argv [i], "-s"))
+			sync = TRUE;
+		else if (argv [i][0] == '-')
+			usage ();
+		else if (!spc_name)
+			spc_name = argv [i];
+		else if (!wav_name)
+			wav_name = argv [i];
+		else
+			usage ();
+    }
+    if (!spc_name || seconds <= 0 || rate <= 0)
+		usage ();
+
+    ZeroMemory (&Settings, sizeof (Settings));
+    Settings.SoundPlaybackRate = rate;
+    Settings.Stereo = stereo;
+    Settings.APUEnabled = Settings.NextAPUEnabled = TRUE;
+    Settings.H_Max = SNES_CYCLES_PER_SCANLINE;
+    Settings.Shutdown = Settings.ShutdownMaster = TRUE;
+    Settings.DisableMasterVolume = TRUE;
+    Settings.InterpolatedSound = TRUE;
+    Settings.SoundSync = sync ? 2 : 1;
+    Settings.SoundResample = TRUE;
+    Settings.SoundCore = accurate ? SOUND_CORE_SDSP : SOUND_CORE_HLE;
+#ifndef FOREVER_16_BIT_SOUND
+    Settings.SixteenBitSound = TRUE;
+#endif
+    IAPU.OneCycle = ONE_APU_CYCLE;
+
+    if (!S9xInitAPU ())
+    {
+		fprintf (stderr, "spcplay: failed to init the APU\n");
+		return (1);
+    }
+    int channels = stereo ? 2 : 1;
+    S9xInitSound (rate, stereo, SOUND_BUFFER_SIZE);
+    S9xSetPlaybackRate (rate);
+
+    if (!S9xSPCLoad (spc_name))
+    {
+		fprintf (stderr, "spcplay: %s is not a readable .spc file\n", spc_name);
+		return (1);
+    }
+    S9xSetSoundMute (FALSE);
+
+    FILE *wav = NULL;
+    if (wav_name)
+    {
+		if (!(wav = fopen (wav_name, "wb")))
+		{
+			fprintf (stderr, "spcplay: cannot create %s\n", wav_name);
+			return (1);
+		}
+		WriteWavHeader (wav, rate, channels, 0);
+    }
+
+    static int16 buf [SPCPLAY_CHUNK * 2 * 2];
+    uint32 total = (uint32) seconds * rate;
+    uint32 done = 0;
+    uint32 flush = sync ? 1 : SPCPLAY_CHUNK;
+    uint32 line = 0;
+    struct timeval start, end;
+
+    gettimeofday (&start, NULL);
+    while (done < total)
+    {
+		// One scanline of SPC700 time, then the same HBLANK_END
+		// bookkeeping cpuexec.cpp does.
+		CPU.Cycles = Settings.H_Max;
+		APU_EXECUTE ();
+		if (IAPU.APUExecuting)
+			APU.Cycles -= Settings.H_Max;
+		else
+			APU.Cycles = 0;
+		S9xAPUTimerTick (line & 1);
+		line++;
+
+		so.err_counter += so.err_rate;
+		if ((so.err_counter >> FIXED_POINT_SHIFT) >= flush)
+		{
+			uint32 frames = so.err_counter >> FIXED_POINT_SHIFT;
+			so.err_counter &= FIXED_POINT_REMAINDER;
+			if (frames > total - done)
+				frames = total - done;
+			S9xMixSamples ((uint8 *) buf, frames * channels);
+			if (wav)
+				WriteSamples (wav, buf, frames * channels);
+			done += frames;
+		}
+    }
+    gettimeofday (&end, NULL);
+
+    if (wav)
+    {
+		WriteWavHeader (wav, rate, channels, done);
+		fclose (wav);
+    }
+
+    double secs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+    if (secs <= 0.0)
+		secs = 1e-6;
+    printf ("%s: %u samples (%u scanlines) in %.3f s\n", spc_name, done, line, secs);
+    printf ("%.0f samples/sec, %.1fx realtime (%s core, %d Hz %s)\n",
+		done / secs, done / secs / rate, accurate ? "accurate DSP" : "HLE",
+		rate, stereo ? "stereo" : "mono");
+
+    S9xDeinitAPU ();
+    return (0);
+}
+
+// The core calls back into the port layer for these; none of them are
+// reached when only the APU runs, but they have to resolve.
+
+bool JustifierOffscreen (void)
+{
+    return (true);
+}
+
+void JustifierButtons (uint32 &)
+{
+}
+
+void S9xProcessSound (unsigned int)
+{
+}
+
+bool8 S9xOpenSoundDevice (int, bool8, int)
+{
+    return (TRUE);
+}
+
+extern "C" {
+
+void S9xExit ()
+{
+    exit (1);
+}
+
+void S9xGenerateSound (void)
+{
+}
+
+void S9xMessage (int, int, const char *message)
+{
+    fprintf (stderr, "spcplay: %s\n", message);
+}
+
+const char *S9xGetSnapshotDirectory (void)
+{
+    return (".");
+}
+
+const char *osd_GetPackDir (void)
+{
+    return (".");
+}
+
+void S9xLoadSDD1Data (void)
+{
+}
+
+bool8_32 S9xInitUpdate ()
+{
+    return (TRUE);
+}
+
+bool8_32 S9xDeinitUpdate (int, int, bool8_32)
+{
+    return (TRUE);
+}
+
+const char *S9xGetFilename (const char *ex)
+{
+    return (ex);
+}
+
+const char *S9xGetFilenameInc (const char *ex)
+{
+    return (ex);
+}
+
+uint32 S9xReadJoypad (int)
+{
+    return (0);
+}
+
+bool8 S9xReadMousePosition (int, int &, int &, uint32 &)
+{
+    return (FALSE);
+}
+
+bool8 S9xReadSuperScopePosition (int &, int &, uint32 &)
+{
+    return (FALSE);
+}
+
+void S9xSyncSpeed (void)
+{
+}
+
+const char *S9xBasename (const char *f)
+{
+    const char *p;
+
+    if ((p = strrchr (f, '/')) != NULL || (p = strrchr (f, '\\')) != NULL)
+		return (p + 1);
+    return (f);
+}
+
+void S9xAutoSaveSRAM (void)
+{
+}
+
+}
+
+void _makepath (char *path, const char *, const char *dir,
+	const char *fname, const char *ext)
+{
+    *path = 0;
+    if (dir && *dir)
+    {
+		strcpy (path, dir);
+		strcat (path, "/");
+    }
+    strcat (path, fname);
+    if (ext && *ext)
+    {
+		strcat (path, ".");
+		strcat (path, ext);
+    }
+}
+
+void _splitpath (const char *path, char *drive, char *dir, char *fname,
+	char *ext)
+{
+    const char *slash = strrchr (path, '/');
+    const char *dot = strrchr (path, '.');
+
+    if (dot && slash && dot < slash)
+		dot = NULL;
+
+    *drive = 0;
+    *dir = 0;
+    if (slash)
+    {
+		strncat (dir, path, slash - path);
+		path = slash + 1;
+    }
+    strcpy (fname, path);
+    *ext = 0;
+    if (dot)
+    {
+		fname [dot - path] = 0;
+		strcpy (ext, dot + 1);
+    }
+}